@@ -0,0 +1,28 @@
+#!/bin/bash
+# 依次以触发模式0~3和不同线程数启动服务器，用loadgen压测并输出csv，便于比较改动前后的性能
+# 用法：bench/compare.sh [loadgen参数...]
+# 需要先make和make bench；服务器在当前目录下运行，资源目录为./resources
+# 环境变量：PORT(默认1317)、MODES(默认"0 1 2 3")、THREADS(默认"2 4 8")
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SERVER=${SERVER:-$ROOT/bin/server}
+LOADGEN=${LOADGEN:-$ROOT/bin/loadgen}
+PORT=${PORT:-1317}
+MODES=${MODES:-"0 1 2 3"}
+THREADS=${THREADS:-"2 4 8"}
+
+header=1
+for mode in $MODES; do
+    for threads in $THREADS; do
+        "$SERVER" -p "$PORT" -m "$mode" -t "$threads" > /dev/null 2>&1 &
+        pid=$!
+        # 等待端口可连接
+        for _ in $(seq 50); do
+            (echo > /dev/tcp/127.0.0.1/"$PORT") 2> /dev/null && break
+            sleep 0.1
+        done
+        "$LOADGEN" -p "$PORT" -f csv -l "trig=$mode threads=$threads" "$@" | tail -n +$((2 - header))
+        header=0
+        kill "$pid"
+        wait "$pid" 2> /dev/null || true
+    done
+done
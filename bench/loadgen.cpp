@@ -0,0 +1,740 @@
+/**
+ * @file loadgen.cpp
+ * @brief HTTP压测工具，每个线程一个epoll，维护固定数量的连接，闭环发送请求并统计吞吐和延迟分布
+ *
+ * 用法：loadgen [选项]
+ *   -a 地址      服务器地址，默认127.0.0.1
+ *   -p 端口      默认1316
+ *   -t 线程数    默认4
+ *   -c 连接数    所有线程的连接总数，默认64
+ *   -d 秒数      每个场景的测量时间，默认10
+ *   -w 秒数      每个场景开始前的预热时间，预热期间完成的请求不计入结果，默认1
+ *   -k 0|1       是否使用keep-alive，默认1；关闭时每个请求都新建连接
+ *   -P 深度      每个连接同时在途的请求数(流水线)，只在keep-alive下生效，默认1
+ *   -s 场景      逗号分隔，依次执行：small、large、404、login、register，默认small
+ *   -u 路径      覆盖small/large/404场景的请求路径
+ *   -U 用户:密码 login场景使用的账号，默认bench:bench
+ *   -T 毫秒      单个请求的超时，超时后关闭连接并重连，默认5000
+ *   -f text|csv  输出格式，csv每个场景一行，便于比较不同配置，默认text
+ *   -l 标签      csv输出的第一列，例如"trig=3 threads=6"
+ *
+ * register场景每个请求使用不同的用户名，会向数据库写入数据，只应在测试库上运行
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../code/metrics/histogram.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+enum SCENARIO
+{
+    SC_SMALL = 0,
+    SC_LARGE,
+    SC_NOTFOUND,
+    SC_LOGIN,
+    SC_REGISTER,
+    SC_COUNT,
+};
+
+static const char *const SCENARIO_NAMES[SC_COUNT] = {"small", "large", "404", "login", "register"};
+// 各场景默认的请求路径，large默认使用resources中自带的视频
+static const char *const SCENARIO_PATHS[SC_COUNT] = {
+    "/index.html", "/video/xxx.mp4", "/loadgen-not-found.html", "/login.html", "/register.html"};
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    int port = 1316;
+    int threads = 4;
+    int conns = 64;
+    int durationSec = 10;
+    int warmupSec = 1;
+    bool keepAlive = true;
+    int pipeline = 1;
+    std::vector<int> scenarios;
+    std::string path;
+    std::string user = "bench";
+    std::string password = "bench";
+    int timeoutMs = 5000;
+    bool csv = false;
+    std::string label;
+};
+
+static int64_t NowUs(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(BenchClock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief 一个压测连接
+ * 响应按到达顺序和在途请求一一对应，只解析状态行、Content-length和Connection，响应体只计数不保存
+ *
+ */
+struct Conn
+{
+    int fd = -1;
+    bool connecting = false;
+    std::string out;
+    size_t outPos = 0;
+    // 在途请求的发送时间，队头对应下一个到达的响应
+    std::deque<int64_t> sentUs;
+    // 未解析完的响应头
+    std::string head;
+    bool inBody = false;
+    uint64_t bodyLeft = 0;
+    int status = 0;
+    bool closeAfter = false;
+    // 当前响应已收到的字节数
+    uint64_t respBytes = 0;
+};
+
+/**
+ * @brief 一个压测线程的状态和统计
+ *
+ */
+struct Worker
+{
+    // 2xx、3xx、4xx、5xx
+    uint64_t statusClass[4] = {};
+    uint64_t completed = 0;
+    uint64_t bytes = 0;
+    uint64_t connects = 0;
+    uint64_t errors = 0;
+    uint64_t timeouts = 0;
+    uint64_t maxUs = 0;
+    // 单位us
+    Histogram latency;
+
+    const Options *opt = nullptr;
+    const struct sockaddr_in *addr = nullptr;
+    int scenario = SC_SMALL;
+    int id = 0;
+    uint64_t seq = 0;
+    int epfd = -1;
+    int64_t measureBeginUs = 0;
+    int64_t endUs = 0;
+    std::vector<Conn> conns;
+};
+
+static void Usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-a addr] [-p port] [-t threads] [-c conns] [-d sec] [-w sec] [-k 0|1] [-P depth]\n"
+            "          [-s small,large,404,login,register] [-u path] [-U user:pass] [-T ms] [-f text|csv] [-l label]\n",
+            prog);
+}
+
+static bool ParseScenarios(const char *arg, std::vector<int> &out)
+{
+    out.clear();
+    std::string list(arg);
+    size_t begin = 0;
+    while (begin <= list.size())
+    {
+        size_t end = list.find(',', begin);
+        std::string name = list.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+        int found = -1;
+        for (int i = 0; i < SC_COUNT; i++)
+        {
+            if (name == SCENARIO_NAMES[i])
+            {
+                found = i;
+            }
+        }
+        if (found < 0)
+        {
+            fprintf(stderr, "unknown scenario: %s\n", name.c_str());
+            return false;
+        }
+        out.push_back(found);
+        if (end == std::string::npos)
+        {
+            break;
+        }
+        begin = end + 1;
+    }
+    return !out.empty();
+}
+
+static void BuildRequest(Worker &worker, std::string &out)
+{
+    const Options &opt = *worker.opt;
+    const char *connection = opt.keepAlive ? "keep-alive" : "close";
+    if (worker.scenario == SC_LOGIN || worker.scenario == SC_REGISTER)
+    {
+        std::string body;
+        if (worker.scenario == SC_LOGIN)
+        {
+            body = "username=" + opt.user + "&password=" + opt.password;
+        }
+        else
+        {
+            // 注册的用户名不能重复
+            body = "username=lg" + std::to_string(NowUs()) + "_" + std::to_string(worker.id) + "_" +
+                   std::to_string(worker.seq++) + "&password=bench";
+        }
+        out += std::string("POST ") + SCENARIO_PATHS[worker.scenario] + " HTTP/1.1\r\n" +
+               "Host: " + opt.host + "\r\n" +
+               "Connection: " + connection + "\r\n" +
+               "Content-Type: application/x-www-form-urlencoded\r\n" +
+               "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        return;
+    }
+    const std::string path = opt.path.empty() ? SCENARIO_PATHS[worker.scenario] : opt.path;
+    out += "GET " + path + " HTTP/1.1\r\n" +
+           "Host: " + opt.host + "\r\n" +
+           "Connection: " + connection + "\r\n\r\n";
+}
+
+static void WatchWrite(Worker &worker, Conn &conn, bool on)
+{
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | (on ? EPOLLOUT : 0);
+    ev.data.u32 = static_cast<uint32_t>(&conn - &worker.conns[0]);
+    epoll_ctl(worker.epfd, EPOLL_CTL_MOD, conn.fd, &ev);
+}
+
+static void CloseConn(Worker &worker, Conn &conn)
+{
+    if (conn.fd >= 0)
+    {
+        epoll_ctl(worker.epfd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        close(conn.fd);
+    }
+    conn.fd = -1;
+    conn.connecting = false;
+    conn.out.clear();
+    conn.outPos = 0;
+    conn.sentUs.clear();
+    conn.head.clear();
+    conn.inBody = false;
+    conn.bodyLeft = 0;
+    conn.closeAfter = false;
+    conn.respBytes = 0;
+}
+
+// 把发送缓冲区中的数据尽量写出，写不完时关注可写事件
+static bool Flush(Worker &worker, Conn &conn)
+{
+    while (conn.outPos < conn.out.size())
+    {
+        ssize_t n = send(conn.fd, conn.out.data() + conn.outPos, conn.out.size() - conn.outPos, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                WatchWrite(worker, conn, true);
+                return true;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        conn.outPos += n;
+    }
+    conn.out.clear();
+    conn.outPos = 0;
+    WatchWrite(worker, conn, false);
+    return true;
+}
+
+// 补足在途请求，测量结束后不再发送新请求
+static bool FillPipeline(Worker &worker, Conn &conn, int64_t nowUs)
+{
+    int depth = worker.opt->keepAlive ? worker.opt->pipeline : 1;
+    if (nowUs >= worker.endUs)
+    {
+        return true;
+    }
+    bool added = false;
+    while (static_cast<int>(conn.sentUs.size()) < depth)
+    {
+        BuildRequest(worker, conn.out);
+        conn.sentUs.push_back(nowUs);
+        added = true;
+    }
+    return !added || Flush(worker, conn);
+}
+
+static void OpenConn(Worker &worker, Conn &conn)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        worker.errors++;
+        return;
+    }
+    int optval = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    // 不保留TIME_WAIT，短连接压测时避免耗尽本地端口
+    struct linger lg = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    conn.fd = fd;
+    worker.connects++;
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.u32 = static_cast<uint32_t>(&conn - &worker.conns[0]);
+    epoll_ctl(worker.epfd, EPOLL_CTL_ADD, fd, &ev);
+    int ret = connect(fd, reinterpret_cast<const struct sockaddr *>(worker.addr), sizeof(*worker.addr));
+    if (ret < 0 && errno != EINPROGRESS)
+    {
+        worker.errors++;
+        CloseConn(worker, conn);
+        return;
+    }
+    conn.connecting = true;
+}
+
+static void Reconnect(Worker &worker, Conn &conn)
+{
+    CloseConn(worker, conn);
+    if (NowUs() < worker.endUs)
+    {
+        OpenConn(worker, conn);
+    }
+}
+
+static void Complete(Worker &worker, Conn &conn, int64_t nowUs)
+{
+    int64_t sent = conn.sentUs.front();
+    conn.sentUs.pop_front();
+    // 预热期间完成的请求不计入结果
+    if (sent >= worker.measureBeginUs && nowUs <= worker.endUs)
+    {
+        uint64_t us = static_cast<uint64_t>(nowUs - sent);
+        worker.latency.Record(us);
+        worker.maxUs = us > worker.maxUs ? us : worker.maxUs;
+        worker.completed++;
+        worker.bytes += conn.respBytes;
+        int cls = conn.status / 100 - 2;
+        if (cls >= 0 && cls < 4)
+        {
+            worker.statusClass[cls]++;
+        }
+    }
+    conn.respBytes = 0;
+}
+
+static bool HeaderIs(const std::string &head, size_t pos, const char *name)
+{
+    return strncasecmp(head.c_str() + pos, name, strlen(name)) == 0;
+}
+
+// 解析响应头，返回false表示格式错误
+static bool ParseHead(Conn &conn)
+{
+    if (conn.head.compare(0, 5, "HTTP/") != 0)
+    {
+        return false;
+    }
+    size_t sp = conn.head.find(' ');
+    conn.status = sp == std::string::npos ? 0 : atoi(conn.head.c_str() + sp + 1);
+    conn.bodyLeft = 0;
+    conn.closeAfter = false;
+    size_t pos = conn.head.find("\r\n");
+    while (pos != std::string::npos && pos + 2 < conn.head.size())
+    {
+        pos += 2;
+        if (HeaderIs(conn.head, pos, "Content-Length:"))
+        {
+            conn.bodyLeft = strtoull(conn.head.c_str() + pos + 15, nullptr, 10);
+        }
+        else if (HeaderIs(conn.head, pos, "Connection:"))
+        {
+            size_t value = conn.head.find_first_not_of(' ', pos + 11);
+            conn.closeAfter = value != std::string::npos && HeaderIs(conn.head, value, "close");
+        }
+        pos = conn.head.find("\r\n", pos);
+    }
+    return conn.status > 0;
+}
+
+/**
+ * @brief 按顺序消费收到的数据，可能包含多个流水线响应
+ *
+ * @return false 连接需要关闭(出错或服务器要求关闭)
+ */
+static bool Consume(Worker &worker, Conn &conn, const char *data, size_t len, int64_t nowUs)
+{
+    while (len > 0)
+    {
+        if (!conn.inBody)
+        {
+            size_t old = conn.head.size();
+            conn.head.append(data, len);
+            size_t end = conn.head.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+            if (end == std::string::npos)
+            {
+                return conn.head.size() < 64 * 1024;
+            }
+            size_t used = end + 4 - old;
+            data += used;
+            len -= used;
+            conn.head.resize(end + 2);
+            if (conn.sentUs.empty() || !ParseHead(conn))
+            {
+                worker.errors++;
+                return false;
+            }
+            conn.head.clear();
+            conn.inBody = true;
+            conn.respBytes += end + 4;
+        }
+        size_t take = len < conn.bodyLeft ? len : static_cast<size_t>(conn.bodyLeft);
+        conn.bodyLeft -= take;
+        conn.respBytes += take;
+        data += take;
+        len -= take;
+        if (conn.bodyLeft == 0)
+        {
+            conn.inBody = false;
+            Complete(worker, conn, nowUs);
+            if (conn.closeAfter || !worker.opt->keepAlive)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void OnReadable(Worker &worker, Conn &conn)
+{
+    char buf[64 * 1024];
+    while (true)
+    {
+        ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+        int64_t nowUs = NowUs();
+        if (n > 0)
+        {
+            if (!Consume(worker, conn, buf, n, nowUs))
+            {
+                Reconnect(worker, conn);
+                return;
+            }
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            if (!FillPipeline(worker, conn, nowUs))
+            {
+                worker.errors++;
+                Reconnect(worker, conn);
+            }
+            return;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        // 服务器关闭了连接，在途请求计为错误
+        if (!conn.sentUs.empty() || conn.inBody)
+        {
+            worker.errors++;
+        }
+        Reconnect(worker, conn);
+        return;
+    }
+}
+
+static void OnWritable(Worker &worker, Conn &conn)
+{
+    if (conn.connecting)
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0)
+        {
+            worker.errors++;
+            CloseConn(worker, conn);
+            // 连接失败时稍后由超时检查重连，避免服务器不可用时空转
+            return;
+        }
+        conn.connecting = false;
+        if (!FillPipeline(worker, conn, NowUs()))
+        {
+            worker.errors++;
+            Reconnect(worker, conn);
+        }
+        return;
+    }
+    if (!Flush(worker, conn))
+    {
+        worker.errors++;
+        Reconnect(worker, conn);
+    }
+}
+
+// 处理超时的请求，重建失败的连接
+static void CheckTimeouts(Worker &worker, int64_t nowUs)
+{
+    int64_t limitUs = static_cast<int64_t>(worker.opt->timeoutMs) * 1000;
+    for (Conn &conn : worker.conns)
+    {
+        if (conn.fd < 0)
+        {
+            if (nowUs < worker.endUs)
+            {
+                OpenConn(worker, conn);
+            }
+        }
+        else if (!conn.sentUs.empty() && nowUs - conn.sentUs.front() > limitUs)
+        {
+            worker.timeouts++;
+            Reconnect(worker, conn);
+        }
+    }
+}
+
+static void RunWorker(Worker &worker, int connCount)
+{
+    worker.epfd = epoll_create1(EPOLL_CLOEXEC);
+    worker.conns.resize(connCount);
+    for (Conn &conn : worker.conns)
+    {
+        OpenConn(worker, conn);
+    }
+    std::vector<struct epoll_event> events(connCount > 0 ? connCount : 1);
+    int64_t lastCheckUs = NowUs();
+    while (true)
+    {
+        int64_t nowUs = NowUs();
+        if (nowUs >= worker.endUs)
+        {
+            break;
+        }
+        if (nowUs - lastCheckUs >= 100 * 1000)
+        {
+            CheckTimeouts(worker, nowUs);
+            lastCheckUs = nowUs;
+        }
+        int n = epoll_wait(worker.epfd, events.data(), static_cast<int>(events.size()), 50);
+        for (int i = 0; i < n; i++)
+        {
+            Conn &conn = worker.conns[events[i].data.u32];
+            if (conn.fd < 0)
+            {
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            {
+                if (conn.connecting)
+                {
+                    OnWritable(worker, conn);
+                    continue;
+                }
+                OnReadable(worker, conn);
+            }
+            if (conn.fd >= 0 && (events[i].events & EPOLLOUT))
+            {
+                OnWritable(worker, conn);
+            }
+        }
+    }
+    for (Conn &conn : worker.conns)
+    {
+        CloseConn(worker, conn);
+    }
+    close(worker.epfd);
+}
+
+static void PrintResult(const Options &opt, int scenario, const std::vector<std::unique_ptr<Worker>> &workers,
+                        double seconds, bool printHeader)
+{
+    uint64_t statusClass[4] = {};
+    uint64_t completed = 0, bytes = 0, connects = 0, errors = 0, timeouts = 0, maxUs = 0;
+    std::vector<uint64_t> counts(Histogram::BUCKETS, 0);
+    for (const auto &worker : workers)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            statusClass[i] += worker->statusClass[i];
+        }
+        completed += worker->completed;
+        bytes += worker->bytes;
+        connects += worker->connects;
+        errors += worker->errors;
+        timeouts += worker->timeouts;
+        maxUs = worker->maxUs > maxUs ? worker->maxUs : maxUs;
+        worker->latency.AddTo(counts);
+    }
+    double rps = completed / seconds;
+    double mbps = bytes / seconds / (1024 * 1024);
+    double p50 = Histogram::Percentile(counts, 0.50) / 1000.0;
+    double p90 = Histogram::Percentile(counts, 0.90) / 1000.0;
+    double p99 = Histogram::Percentile(counts, 0.99) / 1000.0;
+    double p999 = Histogram::Percentile(counts, 0.999) / 1000.0;
+    double maxMs = maxUs / 1000.0;
+
+    if (opt.csv)
+    {
+        if (printHeader)
+        {
+            printf("label,scenario,gen_threads,conns,keepalive,pipeline,requests,rps,mb_per_sec,"
+                   "p50_ms,p90_ms,p99_ms,p999_ms,max_ms,2xx,3xx,4xx,5xx,errors,timeouts,connects\n");
+        }
+        printf("\"%s\",%s,%d,%d,%d,%d,%llu,%.0f,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+               opt.label.c_str(), SCENARIO_NAMES[scenario], opt.threads, opt.conns, opt.keepAlive ? 1 : 0,
+               opt.keepAlive ? opt.pipeline : 1, (unsigned long long)completed, rps, mbps, p50, p90, p99, p999, maxMs,
+               (unsigned long long)statusClass[0], (unsigned long long)statusClass[1],
+               (unsigned long long)statusClass[2], (unsigned long long)statusClass[3],
+               (unsigned long long)errors, (unsigned long long)timeouts, (unsigned long long)connects);
+        fflush(stdout);
+        return;
+    }
+    printf("scenario=%s threads=%d conns=%d keepalive=%d pipeline=%d duration=%.1fs\n",
+           SCENARIO_NAMES[scenario], opt.threads, opt.conns, opt.keepAlive ? 1 : 0,
+           opt.keepAlive ? opt.pipeline : 1, seconds);
+    printf("  requests %llu  rps %.0f  transfer %.2f MB/s  connects %llu\n",
+           (unsigned long long)completed, rps, mbps, (unsigned long long)connects);
+    printf("  latency(ms) p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n", p50, p90, p99, p999, maxMs);
+    printf("  status 2xx %llu  3xx %llu  4xx %llu  5xx %llu  errors %llu  timeouts %llu\n",
+           (unsigned long long)statusClass[0], (unsigned long long)statusClass[1],
+           (unsigned long long)statusClass[2], (unsigned long long)statusClass[3],
+           (unsigned long long)errors, (unsigned long long)timeouts);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    Options opt;
+    int ch;
+    while ((ch = getopt(argc, argv, "a:p:t:c:d:w:k:P:s:u:U:T:f:l:h")) != -1)
+    {
+        switch (ch)
+        {
+        case 'a':
+            opt.host = optarg;
+            break;
+        case 'p':
+            opt.port = atoi(optarg);
+            break;
+        case 't':
+            opt.threads = atoi(optarg);
+            break;
+        case 'c':
+            opt.conns = atoi(optarg);
+            break;
+        case 'd':
+            opt.durationSec = atoi(optarg);
+            break;
+        case 'w':
+            opt.warmupSec = atoi(optarg);
+            break;
+        case 'k':
+            opt.keepAlive = atoi(optarg) != 0;
+            break;
+        case 'P':
+            opt.pipeline = atoi(optarg);
+            break;
+        case 's':
+            if (!ParseScenarios(optarg, opt.scenarios))
+            {
+                return 1;
+            }
+            break;
+        case 'u':
+            opt.path = optarg;
+            break;
+        case 'U':
+        {
+            std::string account(optarg);
+            size_t colon = account.find(':');
+            opt.user = account.substr(0, colon);
+            opt.password = colon == std::string::npos ? "" : account.substr(colon + 1);
+            break;
+        }
+        case 'T':
+            opt.timeoutMs = atoi(optarg);
+            break;
+        case 'f':
+            opt.csv = strcmp(optarg, "csv") == 0;
+            break;
+        case 'l':
+            opt.label = optarg;
+            break;
+        default:
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt.scenarios.empty())
+    {
+        opt.scenarios.push_back(SC_SMALL);
+    }
+    if (opt.threads <= 0 || opt.conns < opt.threads || opt.durationSec <= 0 || opt.warmupSec < 0 ||
+        opt.pipeline <= 0 || opt.timeoutMs <= 0)
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    if (inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr) != 1)
+    {
+        struct hostent *host = gethostbyname(opt.host.c_str());
+        if (!host || host->h_addrtype != AF_INET)
+        {
+            fprintf(stderr, "cannot resolve %s\n", opt.host.c_str());
+            return 1;
+        }
+        memcpy(&addr.sin_addr, host->h_addr_list[0], sizeof(addr.sin_addr));
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    for (size_t s = 0; s < opt.scenarios.size(); s++)
+    {
+        std::vector<std::unique_ptr<Worker>> workers;
+        int64_t beginUs = NowUs();
+        for (int i = 0; i < opt.threads; i++)
+        {
+            std::unique_ptr<Worker> worker(new Worker);
+            worker->opt = &opt;
+            worker->addr = &addr;
+            worker->scenario = opt.scenarios[s];
+            worker->id = i;
+            worker->measureBeginUs = beginUs + static_cast<int64_t>(opt.warmupSec) * 1000000;
+            worker->endUs = worker->measureBeginUs + static_cast<int64_t>(opt.durationSec) * 1000000;
+            workers.push_back(std::move(worker));
+        }
+        std::vector<std::thread> threads;
+        for (int i = 0; i < opt.threads; i++)
+        {
+            // 连接平均分给各线程，余数给前几个线程
+            int connCount = opt.conns / opt.threads + (i < opt.conns % opt.threads ? 1 : 0);
+            Worker *worker = workers[i].get();
+            threads.emplace_back([worker, connCount]
+                                 { RunWorker(*worker, connCount); });
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        PrintResult(opt, opt.scenarios[s], workers, opt.durationSec, s == 0);
+    }
+    return 0;
+}
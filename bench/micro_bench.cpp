@@ -0,0 +1,510 @@
+/**
+ * @file micro_bench.cpp
+ * @brief 核心组件的微基准测试，基于Google Benchmark
+ *
+ * 用法：microbench [--benchmark_filter=正则] [--benchmark_format=json|csv] [--benchmark_out=文件]
+ * 机器可读的结果用--benchmark_format=json输出，两次结果可以用Google Benchmark自带的
+ * tools/compare.py比较，发现回退
+ *
+ * 覆盖Buffer、HttpRequest::parse、HttpResponse::MakeResponse、HeapTimer、ThreadPool::AddTask、
+ * BlockDeque、Log::write和热点统计TopK::Add。资源文件和日志写在临时目录中，结束后删除
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "../code/buffer/buffer.h"
+#include "../code/http/httprequest.h"
+#include "../code/http/httpresponse.h"
+#include "../code/timer/heaptimer.h"
+#include "../code/pool/threadpool.h"
+#include "../code/log/blockqueue.h"
+#include "../code/log/log.h"
+#include "../code/metrics/topk.h"
+
+namespace
+{
+    // 临时目录，包含resources/和log/
+    std::string g_tmpDir;
+    std::string g_srcDir;
+
+    // 浏览器发出的典型请求头
+    const char BROWSER_GET[] =
+        "GET /index.html HTTP/1.1\r\n"
+        "Host: 127.0.0.1:1316\r\n"
+        "Connection: keep-alive\r\n"
+        "Cache-Control: max-age=0\r\n"
+        "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+        "sec-ch-ua-mobile: ?0\r\n"
+        "sec-ch-ua-platform: \"Linux\"\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+        "Chrome/124.0.0.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,"
+        "image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+        "Sec-Fetch-Site: none\r\n"
+        "Sec-Fetch-Mode: navigate\r\n"
+        "Sec-Fetch-User: ?1\r\n"
+        "Sec-Fetch-Dest: document\r\n"
+        "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+        "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n\r\n";
+
+    // 不带登录、注册路径，只测表单解析，不访问数据库
+    const char FORM_POST[] =
+        "POST /picture HTTP/1.1\r\n"
+        "Host: 127.0.0.1:1316\r\n"
+        "Connection: keep-alive\r\n"
+        "Content-Length: 43\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "Origin: http://127.0.0.1:1316\r\n"
+        "Referer: http://127.0.0.1:1316/login\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+        "Chrome/124.0.0.0 Safari/537.36\r\n"
+        "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n\r\n"
+        "username=%E5%BC%A0%E4%B8%89&password=abc123";
+
+    void WriteFile(const std::string &path, size_t size)
+    {
+        FILE *fp = fopen(path.c_str(), "w");
+        if (fp)
+        {
+            std::string data(size, 'x');
+            fwrite(data.data(), 1, data.size(), fp);
+            fclose(fp);
+        }
+    }
+
+    void SetUpDirs(void)
+    {
+        char tmpl[] = "/tmp/microbench.XXXXXX";
+        char *dir = mkdtemp(tmpl);
+        if (!dir)
+        {
+            perror("mkdtemp");
+            exit(1);
+        }
+        g_tmpDir = dir;
+        g_srcDir = g_tmpDir + "/resources/";
+        std::string cmd = "mkdir -p " + g_srcDir + " " + g_tmpDir + "/log";
+        if (system(cmd.c_str()) != 0)
+        {
+            exit(1);
+        }
+        WriteFile(g_srcDir + "index.html", 4 * 1024);
+        WriteFile(g_srcDir + "big.bin", 1024 * 1024);
+        WriteFile(g_srcDir + "404.html", 512);
+    }
+}
+
+/* ---------------- Buffer ---------------- */
+
+// 追加一段数据再全部取出，参数为每次追加的字节数
+static void BM_BufferAppendRetrieve(benchmark::State &state)
+{
+    Buffer buff;
+    std::string data(state.range(0), 'a');
+    for (auto _ : state)
+    {
+        buff.Append(data);
+        benchmark::DoNotOptimize(buff.Peek());
+        buff.RetrieveAll();
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_BufferAppendRetrieve)->Arg(64)->Arg(1024)->Arg(16 * 1024)->Arg(256 * 1024);
+
+// 像拼响应头一样多次追加短字符串，缓冲区反复扩容、腾挪
+static void BM_BufferAppendPieces(benchmark::State &state)
+{
+    const std::string pieces[] = {"HTTP/1.1 200 OK\r\n", "Connection: keep-alive\r\n",
+                                  "keep-alive: max=6, timeout=120\r\n", "Content-type: text/html\r\n",
+                                  "Content-length: 4096\r\n\r\n"};
+    Buffer buff;
+    for (auto _ : state)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            for (const auto &piece : pieces)
+            {
+                buff.Append(piece);
+            }
+            buff.Retrieve(buff.ReadableBytes() / 2);
+        }
+        buff.RetrieveAll();
+    }
+}
+BENCHMARK(BM_BufferAppendPieces);
+
+// 从管道读入数据，参数为每次读取的字节数，超过缓冲区可写空间时走readv的栈上缓冲
+static void BM_BufferReadFd(benchmark::State &state)
+{
+    int fds[2];
+    if (pipe(fds) < 0)
+    {
+        state.SkipWithError("pipe failed");
+        return;
+    }
+    std::string data(state.range(0), 'r');
+    Buffer buff;
+    int err = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        if (write(fds[1], data.data(), data.size()) != static_cast<ssize_t>(data.size()))
+        {
+            state.SkipWithError("write failed");
+            break;
+        }
+        state.ResumeTiming();
+        buff.ReadFd(fds[0], &err);
+        buff.RetrieveAll();
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    close(fds[0]);
+    close(fds[1]);
+}
+BENCHMARK(BM_BufferReadFd)->Arg(512)->Arg(16 * 1024)->Arg(60 * 1024);
+
+/* ---------------- HttpRequest ---------------- */
+
+static void ParseBench(benchmark::State &state, const char *message)
+{
+    const size_t len = strlen(message);
+    Buffer buff;
+    HttpRequest request;
+    for (auto _ : state)
+    {
+        buff.Append(message, len);
+        request.Init();
+        benchmark::DoNotOptimize(request.parse(buff));
+        buff.RetrieveAll();
+    }
+    state.SetBytesProcessed(state.iterations() * len);
+}
+
+static void BM_HttpRequestParseGet(benchmark::State &state)
+{
+    ParseBench(state, BROWSER_GET);
+}
+BENCHMARK(BM_HttpRequestParseGet);
+
+static void BM_HttpRequestParsePost(benchmark::State &state)
+{
+    ParseBench(state, FORM_POST);
+}
+BENCHMARK(BM_HttpRequestParsePost);
+
+// 判断请求是否接收完整，每次收到数据都会调用
+static void BM_HttpRequestProbe(benchmark::State &state)
+{
+    Buffer buff;
+    buff.Append(BROWSER_GET, strlen(BROWSER_GET));
+    int code = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(HttpRequest::Probe(buff, code));
+    }
+}
+BENCHMARK(BM_HttpRequestProbe);
+
+/* ---------------- HttpResponse ---------------- */
+
+static void ResponseBench(benchmark::State &state, const char *target, int code)
+{
+    Buffer buff;
+    HttpResponse response;
+    for (auto _ : state)
+    {
+        std::string path(target);
+        response.Init(g_srcDir, path, true, code);
+        response.MakeResponse(buff);
+        benchmark::DoNotOptimize(response.File());
+        response.UnmapFile();
+        buff.RetrieveAll();
+    }
+}
+
+// 小文件：stat、open、mmap加上拼响应头
+static void BM_HttpResponseSmallFile(benchmark::State &state)
+{
+    ResponseBench(state, "/index.html", 200);
+}
+BENCHMARK(BM_HttpResponseSmallFile);
+
+static void BM_HttpResponseLargeFile(benchmark::State &state)
+{
+    ResponseBench(state, "/big.bin", 200);
+}
+BENCHMARK(BM_HttpResponseLargeFile);
+
+static void BM_HttpResponseNotFound(benchmark::State &state)
+{
+    ResponseBench(state, "/missing.html", 200);
+}
+BENCHMARK(BM_HttpResponseNotFound);
+
+// 管理接口等由内存生成的响应体
+static void BM_HttpResponseContent(benchmark::State &state)
+{
+    Buffer buff;
+    HttpResponse response;
+    const std::string content(state.range(0), 'm');
+    for (auto _ : state)
+    {
+        std::string path("/metrics");
+        std::string body(content);
+        response.Init(g_srcDir, path, true, 200);
+        response.SetContent("text/plain; version=0.0.4", body);
+        response.MakeResponse(buff);
+        buff.RetrieveAll();
+    }
+}
+BENCHMARK(BM_HttpResponseContent)->Arg(256)->Arg(16 * 1024);
+
+/* ---------------- HeapTimer ---------------- */
+
+// 插入n个定时器，参数为定时器数量
+static void BM_HeapTimerAdd(benchmark::State &state)
+{
+    const int n = static_cast<int>(state.range(0));
+    for (auto _ : state)
+    {
+        HeapTimer timer;
+        for (int i = 0; i < n; i++)
+        {
+            timer.add(i, 60000 + (i * 7919) % 10000, [] {});
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_HeapTimerAdd)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond);
+
+// n个连接中随机一个收到数据，延长其定时器
+static void BM_HeapTimerAdjust(benchmark::State &state)
+{
+    const int n = static_cast<int>(state.range(0));
+    HeapTimer timer;
+    for (int i = 0; i < n; i++)
+    {
+        timer.add(i, 60000, [] {});
+    }
+    std::mt19937 rng(12345);
+    std::vector<int> ids(4096);
+    for (auto &id : ids)
+    {
+        id = static_cast<int>(rng() % n);
+    }
+    size_t next = 0;
+    int timeout = 60000;
+    for (auto _ : state)
+    {
+        timer.adjust(ids[next++ & 4095], ++timeout);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HeapTimerAdjust)->RangeMultiplier(10)->Range(10000, 1000000);
+
+// 删除堆顶再插入，模拟连接不断超时、新连接不断到来
+static void BM_HeapTimerPopAdd(benchmark::State &state)
+{
+    const int n = static_cast<int>(state.range(0));
+    HeapTimer timer;
+    for (int i = 0; i < n; i++)
+    {
+        timer.add(i, 60000 + i % 1000, [] {});
+    }
+    int id = n;
+    for (auto _ : state)
+    {
+        timer.pop();
+        timer.add(id++, 61000, [] {});
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HeapTimerPopAdd)->RangeMultiplier(10)->Range(10000, 1000000);
+
+/* ---------------- ThreadPool ---------------- */
+
+// 一个线程连续提交短任务并等待完成，参数为工作线程数
+static void BM_ThreadPoolAddTask(benchmark::State &state)
+{
+    const int batch = 10000;
+    ThreadPool pool(state.range(0));
+    std::atomic<int> done(0);
+    for (auto _ : state)
+    {
+        done.store(0, std::memory_order_relaxed);
+        for (int i = 0; i < batch; i++)
+        {
+            pool.AddTask([&done]
+                         { done.fetch_add(1, std::memory_order_relaxed); });
+        }
+        while (done.load(std::memory_order_relaxed) < batch)
+        {
+            std::this_thread::yield();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_ThreadPoolAddTask)->Arg(2)->Arg(4)->Arg(8)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+// 多个线程同时提交，只测提交本身，任务为空
+static void BM_ThreadPoolAddTaskContended(benchmark::State &state)
+{
+    static ThreadPool *pool = nullptr;
+    if (state.thread_index() == 0)
+    {
+        pool = new ThreadPool(4);
+    }
+    for (auto _ : state)
+    {
+        pool->AddTask([] {});
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0)
+    {
+        delete pool;
+        pool = nullptr;
+    }
+}
+BENCHMARK(BM_ThreadPoolAddTaskContended)->ThreadRange(1, 8)->UseRealTime();
+
+/* ---------------- BlockDeque ---------------- */
+
+// 多个线程在同一个队列上push、pop，每个线程先放后取，队列不会满也不会长时间空
+static void BM_BlockDequeContended(benchmark::State &state)
+{
+    static BlockDeque<int> *deque = nullptr;
+    if (state.thread_index() == 0)
+    {
+        deque = new BlockDeque<int>(1024);
+    }
+    int item = 0;
+    for (auto _ : state)
+    {
+        deque->push_back(item);
+        deque->pop(item);
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0)
+    {
+        delete deque;
+        deque = nullptr;
+    }
+}
+BENCHMARK(BM_BlockDequeContended)->ThreadRange(1, 8)->UseRealTime();
+
+// 一个生产者、一个消费者，队列容量为参数，生产者快于消费者时会阻塞
+static void BM_BlockDequeProducerConsumer(benchmark::State &state)
+{
+    const int batch = 100000;
+    for (auto _ : state)
+    {
+        BlockDeque<int> deque(state.range(0));
+        std::thread consumer([&deque]
+                             {
+                                 int item;
+                                 for (int i = 0; i < batch; i++)
+                                 {
+                                     deque.pop(item);
+                                 } });
+        for (int i = 0; i < batch; i++)
+        {
+            deque.push_back(i);
+        }
+        consumer.join();
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_BlockDequeProducerConsumer)->Arg(64)->Arg(1024)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/* ---------------- TopK ---------------- */
+
+// 多个线程同时记录，路径按Zipf近似分布，少数路径占大部分请求，热点路径反复尝试更新堆
+static void BM_TopKAdd(benchmark::State &state)
+{
+    static TopK *topk = nullptr;
+    static std::vector<std::string> keys;
+    if (state.thread_index() == 0)
+    {
+        topk = new TopK("bench.topk", 20, 4096, 4);
+        keys.clear();
+        for (int i = 0; i < 10000; i++)
+        {
+            keys.push_back("/static/file" + std::to_string(i) + ".html");
+        }
+    }
+    std::mt19937 rng(state.thread_index() + 1);
+    // 取两个均匀随机数中较小的一个的平方，小下标出现得多
+    std::uniform_real_distribution<double> dist(0, 1);
+    std::vector<size_t> order(4096);
+    for (size_t &index : order)
+    {
+        double x = std::min(dist(rng), dist(rng));
+        index = static_cast<size_t>(x * x * keys.size());
+    }
+    size_t n = 0;
+    for (auto _ : state)
+    {
+        const std::string &key = keys[order[n++ & 4095]];
+        topk->Add(key.data(), key.size());
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0)
+    {
+        delete topk;
+        topk = nullptr;
+    }
+}
+BENCHMARK(BM_TopKAdd)->ThreadRange(1, 8)->UseRealTime();
+
+/* ---------------- Log ---------------- */
+
+// 日志写入的前端开销，多个线程同时写，后台线程写文件
+static void BM_LogWrite(benchmark::State &state)
+{
+    Log *log = Log::Instance();
+    int n = 0;
+    for (auto _ : state)
+    {
+        log->write(1, "client[%d] in, path %s, %d bytes", n++, "/index.html", 4096);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogWrite)->ThreadRange(1, 8)->UseRealTime();
+
+// 经过LOG_INFO宏，按日志配置可能只记录参数，在后台线程格式化
+static void BM_LogMacro(benchmark::State &state)
+{
+    int n = 0;
+    for (auto _ : state)
+    {
+        LOG_INFO("client[%d] in, path %s, %d bytes", n++, "/index.html", 4096);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogMacro)->ThreadRange(1, 8)->UseRealTime();
+
+int main(int argc, char **argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    SetUpDirs();
+    // 等级为info，解析请求时的LOG_DEBUG不会写入；缓冲区满时阻塞，测的是持续写入的吞吐
+    Log::Instance()->init(1, (g_tmpDir + "/log").c_str(), ".log", 1024);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    std::string cmd = "rm -rf " + g_tmpDir;
+    return system(cmd.c_str()) == 0 ? 0 : 1;
+}
@@ -0,0 +1,892 @@
+/**
+ * @file replay.cpp
+ * @brief 回放服务器录制的流量(见TrafficCapture)，按录制时的连接和到达时间重新发送请求，统计延迟分布
+ *
+ * 用法：replay [选项] 录制文件
+ *   -a 地址      服务器地址，默认127.0.0.1
+ *   -p 端口      默认1316
+ *   -t 线程数    连接按开始时间轮流分给各线程，默认4
+ *   -x 倍速      1为原速，2为两倍速，0为不等待、尽快发送，默认1
+ *   -n 次数      首尾相接重复回放的次数，默认1
+ *   -P           不等待在途请求的响应，按时间直接发送(流水线)；默认等上一批响应收完再发下一段
+ *   -T 毫秒      单个请求的超时，超时后放弃该连接，默认5000
+ *   -d 秒数      最长回放时间，0为不限，默认0
+ *   -f text|csv  输出格式，默认text
+ *   -l 标签      csv输出的第一列
+ *
+ * 每段数据的发送时间为连接开始时间加上录制时的相对时间除以倍速；连接开始时间同样按倍速缩放
+ * 默认是闭环回放，服务器变慢时后续数据顺延，lag为实际发送比计划晚的时间，lag较大说明回放跟不上录制的节奏
+ * 延迟从发出请求的最后一段数据到收完响应，一段数据中的多个请求按流水线处理
+ * 录制时被丢弃数据的连接只回放缺口之前的部分
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+#include "../code/log/capture.h"
+#include "../code/metrics/histogram.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    int port = 1316;
+    int threads = 4;
+    double speed = 1.0;
+    int loops = 1;
+    bool pipeline = false;
+    int timeoutMs = 5000;
+    int maxSec = 0;
+    bool csv = false;
+    std::string label;
+    std::string file;
+};
+
+static int64_t NowUs(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(BenchClock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief 连接上一次读到的数据
+ *
+ */
+struct Chunk
+{
+    // 相对连接开始的时间
+    int64_t atUs;
+    uint64_t offset;
+    std::string data;
+    // 以这段数据结尾的完整请求数
+    int requests;
+};
+
+/**
+ * @brief 一个录制的连接
+ *
+ */
+struct Session
+{
+    // 相对录制中第一个连接的开始时间
+    int64_t startUs = 0;
+    std::vector<Chunk> chunks;
+    // 关闭时间，相对连接开始，-1表示没有录到关闭
+    int64_t closeUs = -1;
+    // 录制时有数据被丢弃，只保留缺口之前的部分
+    bool gap = false;
+};
+
+/**
+ * @brief 回放中的一个连接
+ * 响应按到达顺序和在途请求一一对应，只解析状态行、Content-length和Connection，响应体只计数不保存
+ *
+ */
+struct Conn
+{
+    const Session *session = nullptr;
+    // 计划的开始时间，相对回放开始，已按倍速缩放
+    int64_t startUs = 0;
+    int fd = -1;
+    bool connecting = false;
+    bool done = false;
+    // 下一段要发送的数据
+    size_t next = 0;
+    std::string out;
+    size_t outPos = 0;
+    std::deque<int64_t> sentUs;
+    std::string head;
+    bool inBody = false;
+    uint64_t bodyLeft = 0;
+    int status = 0;
+    bool closeAfter = false;
+    uint64_t respBytes = 0;
+};
+
+/**
+ * @brief 一个回放线程的状态和统计
+ *
+ */
+struct Worker
+{
+    uint64_t statusClass[4] = {};
+    uint64_t completed = 0;
+    uint64_t bytes = 0;
+    uint64_t connects = 0;
+    uint64_t errors = 0;
+    uint64_t timeouts = 0;
+    // 连接提前结束而没有发送的数据段
+    uint64_t skipped = 0;
+    uint64_t maxUs = 0;
+    uint64_t maxLagUs = 0;
+    // 单位us
+    Histogram latency;
+    Histogram lag;
+
+    const Options *opt = nullptr;
+    const struct sockaddr_in *addr = nullptr;
+    int64_t beginUs = 0;
+    int64_t endUs = 0;
+    int epfd = -1;
+    // 按开始时间排列，nextOpen之前的已经开始
+    std::vector<Conn> conns;
+    size_t nextOpen = 0;
+    std::vector<uint32_t> active;
+};
+
+static void Usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-a addr] [-p port] [-t threads] [-x speed] [-n loops] [-P] [-T ms] [-d sec]\n"
+            "          [-f text|csv] [-l label] capture-file\n",
+            prog);
+}
+
+static bool HeaderIs(const std::string &head, size_t pos, const char *name)
+{
+    return strncasecmp(head.c_str() + pos, name, strlen(name)) == 0;
+}
+
+/**
+ * @brief 把连接的数据流切分成请求，记下每个请求在哪一段数据中结束
+ * 按请求头结尾加Content-Length切分，最后不完整的请求不计入
+ *
+ */
+static void CountRequests(Session &session)
+{
+    std::string stream;
+    std::vector<size_t> ends;
+    for (const Chunk &chunk : session.chunks)
+    {
+        stream += chunk.data;
+        ends.push_back(stream.size());
+    }
+    size_t pos = 0;
+    while (pos < stream.size())
+    {
+        size_t end = stream.find("\r\n\r\n", pos);
+        if (end == std::string::npos)
+        {
+            break;
+        }
+        uint64_t bodyLen = 0;
+        size_t line = stream.find("\r\n", pos);
+        while (line < end)
+        {
+            line += 2;
+            if (HeaderIs(stream, line, "Content-Length:"))
+            {
+                bodyLen = strtoull(stream.c_str() + line + 15, nullptr, 10);
+            }
+            line = stream.find("\r\n", line);
+        }
+        if (end + 4 + bodyLen > stream.size())
+        {
+            break;
+        }
+        pos = end + 4 + bodyLen;
+        size_t index = std::lower_bound(ends.begin(), ends.end(), pos) - ends.begin();
+        session.chunks[index].requests++;
+    }
+}
+
+/**
+ * @brief 读取录制文件，按连接整理记录
+ * 各线程的记录在文件中不按时间排列，数据段按偏移排序，偏移不连续处为录制时丢弃的数据
+ *
+ */
+static bool LoadCapture(const std::string &file, std::vector<Session> &sessions, uint64_t &gaps)
+{
+    FILE *fp = fopen(file.c_str(), "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot open %s: %s\n", file.c_str(), strerror(errno));
+        return false;
+    }
+    std::string buf;
+    char block[64 * 1024];
+    size_t n;
+    while ((n = fread(block, 1, sizeof(block), fp)) > 0)
+    {
+        buf.append(block, n);
+    }
+    fclose(fp);
+    if (buf.size() < sizeof(TrafficCapture::FILE_MAGIC) ||
+        memcmp(buf.data(), TrafficCapture::FILE_MAGIC, sizeof(TrafficCapture::FILE_MAGIC)) != 0)
+    {
+        fprintf(stderr, "%s is not a capture file\n", file.c_str());
+        return false;
+    }
+
+    struct Raw
+    {
+        int64_t openUs = INT64_MAX;
+        int64_t closeUs = -1;
+        std::vector<Chunk> chunks;
+    };
+    std::unordered_map<uint64_t, Raw> raws;
+    size_t pos = sizeof(TrafficCapture::FILE_MAGIC);
+    while (pos + 1 + sizeof(CaptureRecord) <= buf.size())
+    {
+        CaptureRecord record;
+        memcpy(&record, buf.data() + pos + 1, sizeof(record));
+        if (buf[pos] != record.type || pos + 1 + sizeof(record) + record.len > buf.size())
+        {
+            fprintf(stderr, "corrupted record at offset %zu, ignoring the rest\n", pos);
+            break;
+        }
+        const char *data = buf.data() + pos + 1 + sizeof(record);
+        pos += 1 + sizeof(record) + record.len;
+        Raw &raw = raws[record.connId];
+        if (record.type == TrafficCapture::ENTRY_OPEN)
+        {
+            raw.openUs = record.timeUs;
+        }
+        else if (record.type == TrafficCapture::ENTRY_CLOSE)
+        {
+            raw.closeUs = record.timeUs;
+        }
+        else if (record.type == TrafficCapture::ENTRY_DATA && record.len > 0)
+        {
+            raw.chunks.push_back({record.timeUs, record.offset, std::string(data, record.len), 0});
+        }
+    }
+
+    int64_t baseUs = INT64_MAX;
+    for (auto &item : raws)
+    {
+        Raw &raw = item.second;
+        std::sort(raw.chunks.begin(), raw.chunks.end(), [](const Chunk &a, const Chunk &b)
+                  { return a.offset < b.offset; });
+        // 没有录到打开(文件从中途开始)时以第一段数据为开始
+        if (!raw.chunks.empty())
+        {
+            raw.openUs = std::min(raw.openUs, raw.chunks[0].atUs);
+        }
+        baseUs = std::min(baseUs, raw.openUs);
+    }
+    for (auto &item : raws)
+    {
+        Raw &raw = item.second;
+        Session session;
+        uint64_t expect = 0;
+        for (Chunk &chunk : raw.chunks)
+        {
+            if (chunk.offset != expect)
+            {
+                session.gap = true;
+                break;
+            }
+            expect += chunk.data.size();
+            chunk.atUs -= raw.openUs;
+            session.chunks.push_back(std::move(chunk));
+        }
+        if (session.chunks.empty())
+        {
+            continue;
+        }
+        gaps += session.gap ? 1 : 0;
+        session.startUs = raw.openUs - baseUs;
+        session.closeUs = raw.closeUs >= 0 && !session.gap ? raw.closeUs - raw.openUs : -1;
+        CountRequests(session);
+        sessions.push_back(std::move(session));
+    }
+    std::sort(sessions.begin(), sessions.end(), [](const Session &a, const Session &b)
+              { return a.startUs < b.startUs; });
+    return true;
+}
+
+// 录制时间换算为回放开始后的时间，倍速为0时全部立即发生
+static int64_t Scale(const Options &opt, int64_t us)
+{
+    return opt.speed > 0 ? static_cast<int64_t>(us / opt.speed) : 0;
+}
+
+static void WatchWrite(Worker &worker, Conn &conn, bool on)
+{
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | (on ? EPOLLOUT : 0);
+    ev.data.u32 = static_cast<uint32_t>(&conn - &worker.conns[0]);
+    epoll_ctl(worker.epfd, EPOLL_CTL_MOD, conn.fd, &ev);
+}
+
+// 结束连接，没有发送的数据段计为skipped
+static void Finish(Worker &worker, Conn &conn)
+{
+    if (conn.fd >= 0)
+    {
+        epoll_ctl(worker.epfd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        close(conn.fd);
+    }
+    conn.fd = -1;
+    conn.done = true;
+    worker.skipped += conn.session->chunks.size() - conn.next;
+    conn.out.clear();
+    conn.out.shrink_to_fit();
+    conn.head.clear();
+}
+
+static bool Flush(Worker &worker, Conn &conn)
+{
+    while (conn.outPos < conn.out.size())
+    {
+        ssize_t n = send(conn.fd, conn.out.data() + conn.outPos, conn.out.size() - conn.outPos, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                WatchWrite(worker, conn, true);
+                return true;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        conn.outPos += n;
+    }
+    conn.out.clear();
+    conn.outPos = 0;
+    WatchWrite(worker, conn, false);
+    return true;
+}
+
+static void OpenConn(Worker &worker, Conn &conn)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        worker.errors++;
+        Finish(worker, conn);
+        return;
+    }
+    int optval = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    // 不保留TIME_WAIT，录制中短连接较多时避免耗尽本地端口
+    struct linger lg = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    conn.fd = fd;
+    worker.connects++;
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.u32 = static_cast<uint32_t>(&conn - &worker.conns[0]);
+    epoll_ctl(worker.epfd, EPOLL_CTL_ADD, fd, &ev);
+    int ret = connect(fd, reinterpret_cast<const struct sockaddr *>(worker.addr), sizeof(*worker.addr));
+    if (ret < 0 && errno != EINPROGRESS)
+    {
+        worker.errors++;
+        Finish(worker, conn);
+        return;
+    }
+    conn.connecting = true;
+}
+
+/**
+ * @brief 发送到期的数据段，到了录制的关闭时间且没有在途请求时关闭连接
+ *
+ * @return int64_t 下一次需要处理的时间，INT64_MAX表示只需等待网络事件
+ */
+static int64_t Advance(Worker &worker, Conn &conn, int64_t nowUs)
+{
+    const Options &opt = *worker.opt;
+    const Session &session = *conn.session;
+    if (conn.fd < 0 || conn.connecting || conn.done)
+    {
+        return INT64_MAX;
+    }
+    bool added = false;
+    while (conn.next < session.chunks.size())
+    {
+        // 闭环回放时等在途请求的响应收完
+        if (!opt.pipeline && (!conn.sentUs.empty() || conn.inBody))
+        {
+            break;
+        }
+        const Chunk &chunk = session.chunks[conn.next];
+        int64_t dueUs = worker.beginUs + conn.startUs + Scale(opt, chunk.atUs);
+        if (dueUs > nowUs)
+        {
+            if (added && !Flush(worker, conn))
+            {
+                worker.errors++;
+                Finish(worker, conn);
+                return INT64_MAX;
+            }
+            return dueUs;
+        }
+        if (opt.speed > 0)
+        {
+            uint64_t lagUs = static_cast<uint64_t>(nowUs - dueUs);
+            worker.lag.Record(lagUs);
+            worker.maxLagUs = std::max(worker.maxLagUs, lagUs);
+        }
+        conn.out += chunk.data;
+        for (int i = 0; i < chunk.requests; i++)
+        {
+            conn.sentUs.push_back(nowUs);
+        }
+        conn.next++;
+        added = true;
+    }
+    if (added && !Flush(worker, conn))
+    {
+        worker.errors++;
+        Finish(worker, conn);
+        return INT64_MAX;
+    }
+    if (conn.next == session.chunks.size() && conn.sentUs.empty() && !conn.inBody && conn.out.empty())
+    {
+        int64_t closeUs = worker.beginUs + conn.startUs + (session.closeUs >= 0 ? Scale(opt, session.closeUs) : 0);
+        if (closeUs > nowUs)
+        {
+            return closeUs;
+        }
+        Finish(worker, conn);
+    }
+    return INT64_MAX;
+}
+
+static void Complete(Worker &worker, Conn &conn, int64_t nowUs)
+{
+    int64_t sent = conn.sentUs.front();
+    conn.sentUs.pop_front();
+    uint64_t us = static_cast<uint64_t>(nowUs - sent);
+    worker.latency.Record(us);
+    worker.maxUs = std::max(worker.maxUs, us);
+    worker.completed++;
+    worker.bytes += conn.respBytes;
+    int cls = conn.status / 100 - 2;
+    if (cls >= 0 && cls < 4)
+    {
+        worker.statusClass[cls]++;
+    }
+    conn.respBytes = 0;
+}
+
+static bool ParseHead(Conn &conn)
+{
+    if (conn.head.compare(0, 5, "HTTP/") != 0)
+    {
+        return false;
+    }
+    size_t sp = conn.head.find(' ');
+    conn.status = sp == std::string::npos ? 0 : atoi(conn.head.c_str() + sp + 1);
+    conn.bodyLeft = 0;
+    conn.closeAfter = false;
+    size_t pos = conn.head.find("\r\n");
+    while (pos != std::string::npos && pos + 2 < conn.head.size())
+    {
+        pos += 2;
+        if (HeaderIs(conn.head, pos, "Content-Length:"))
+        {
+            conn.bodyLeft = strtoull(conn.head.c_str() + pos + 15, nullptr, 10);
+        }
+        else if (HeaderIs(conn.head, pos, "Connection:"))
+        {
+            size_t value = conn.head.find_first_not_of(' ', pos + 11);
+            conn.closeAfter = value != std::string::npos && HeaderIs(conn.head, value, "close");
+        }
+        pos = conn.head.find("\r\n", pos);
+    }
+    return conn.status > 0;
+}
+
+/**
+ * @brief 按顺序消费收到的数据，可能包含多个流水线响应
+ *
+ * @return false 连接需要结束(出错或服务器要求关闭)
+ */
+static bool Consume(Worker &worker, Conn &conn, const char *data, size_t len, int64_t nowUs)
+{
+    while (len > 0)
+    {
+        if (!conn.inBody)
+        {
+            size_t old = conn.head.size();
+            conn.head.append(data, len);
+            size_t end = conn.head.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+            if (end == std::string::npos)
+            {
+                return conn.head.size() < 64 * 1024;
+            }
+            size_t used = end + 4 - old;
+            data += used;
+            len -= used;
+            conn.head.resize(end + 2);
+            // 没有对应请求的响应，通常是服务器拒绝了不完整或格式错误的请求
+            if (conn.sentUs.empty() || !ParseHead(conn))
+            {
+                worker.errors++;
+                return false;
+            }
+            conn.head.clear();
+            conn.inBody = true;
+            conn.respBytes += end + 4;
+        }
+        size_t take = len < conn.bodyLeft ? len : static_cast<size_t>(conn.bodyLeft);
+        conn.bodyLeft -= take;
+        conn.respBytes += take;
+        data += take;
+        len -= take;
+        if (conn.bodyLeft == 0)
+        {
+            conn.inBody = false;
+            Complete(worker, conn, nowUs);
+            if (conn.closeAfter)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void OnReadable(Worker &worker, Conn &conn)
+{
+    char buf[64 * 1024];
+    while (true)
+    {
+        ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+        if (n > 0)
+        {
+            if (!Consume(worker, conn, buf, n, NowUs()))
+            {
+                Finish(worker, conn);
+                return;
+            }
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        // 服务器关闭了连接，在途请求计为错误
+        if (!conn.sentUs.empty() || conn.inBody)
+        {
+            worker.errors++;
+        }
+        Finish(worker, conn);
+        return;
+    }
+}
+
+static void OnWritable(Worker &worker, Conn &conn)
+{
+    if (conn.connecting)
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        conn.connecting = false;
+        if (err != 0)
+        {
+            worker.errors++;
+            Finish(worker, conn);
+        }
+        return;
+    }
+    if (!Flush(worker, conn))
+    {
+        worker.errors++;
+        Finish(worker, conn);
+    }
+}
+
+static void RunWorker(Worker &worker)
+{
+    const Options &opt = *worker.opt;
+    worker.epfd = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<struct epoll_event> events(256);
+    int64_t limitUs = static_cast<int64_t>(opt.timeoutMs) * 1000;
+    while (worker.nextOpen < worker.conns.size() || !worker.active.empty())
+    {
+        int64_t nowUs = NowUs();
+        if (worker.endUs > 0 && nowUs >= worker.endUs)
+        {
+            break;
+        }
+        int64_t wakeUs = nowUs + 50 * 1000;
+        while (worker.nextOpen < worker.conns.size())
+        {
+            Conn &conn = worker.conns[worker.nextOpen];
+            int64_t openUs = worker.beginUs + conn.startUs;
+            if (openUs > nowUs)
+            {
+                wakeUs = std::min(wakeUs, openUs);
+                break;
+            }
+            worker.active.push_back(static_cast<uint32_t>(worker.nextOpen++));
+            OpenConn(worker, conn);
+        }
+        for (size_t i = 0; i < worker.active.size();)
+        {
+            Conn &conn = worker.conns[worker.active[i]];
+            if (!conn.done && !conn.sentUs.empty() && nowUs - conn.sentUs.front() > limitUs)
+            {
+                worker.timeouts++;
+                Finish(worker, conn);
+            }
+            if (!conn.done)
+            {
+                wakeUs = std::min(wakeUs, Advance(worker, conn, nowUs));
+            }
+            if (conn.done)
+            {
+                worker.active[i] = worker.active.back();
+                worker.active.pop_back();
+                continue;
+            }
+            i++;
+        }
+
+        int waitMs = static_cast<int>(std::max<int64_t>(0, (wakeUs - nowUs + 999) / 1000));
+        int n = epoll_wait(worker.epfd, events.data(), static_cast<int>(events.size()), waitMs);
+        for (int i = 0; i < n; i++)
+        {
+            Conn &conn = worker.conns[events[i].data.u32];
+            if (conn.fd < 0)
+            {
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            {
+                if (conn.connecting)
+                {
+                    OnWritable(worker, conn);
+                    continue;
+                }
+                OnReadable(worker, conn);
+            }
+            if (conn.fd >= 0 && (events[i].events & EPOLLOUT))
+            {
+                OnWritable(worker, conn);
+            }
+        }
+    }
+    for (uint32_t index : worker.active)
+    {
+        if (!worker.conns[index].done)
+        {
+            Finish(worker, worker.conns[index]);
+        }
+    }
+    close(worker.epfd);
+}
+
+static void PrintResult(const Options &opt, size_t sessions, uint64_t requests, uint64_t gaps,
+                        const std::vector<std::unique_ptr<Worker>> &workers, double seconds)
+{
+    uint64_t statusClass[4] = {};
+    uint64_t completed = 0, bytes = 0, connects = 0, errors = 0, timeouts = 0, skipped = 0, maxUs = 0, maxLagUs = 0;
+    std::vector<uint64_t> counts(Histogram::BUCKETS, 0);
+    std::vector<uint64_t> lagCounts(Histogram::BUCKETS, 0);
+    for (const auto &worker : workers)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            statusClass[i] += worker->statusClass[i];
+        }
+        completed += worker->completed;
+        bytes += worker->bytes;
+        connects += worker->connects;
+        errors += worker->errors;
+        timeouts += worker->timeouts;
+        skipped += worker->skipped;
+        maxUs = std::max(maxUs, worker->maxUs);
+        maxLagUs = std::max(maxLagUs, worker->maxLagUs);
+        worker->latency.AddTo(counts);
+        worker->lag.AddTo(lagCounts);
+    }
+    seconds = seconds > 0 ? seconds : 1e-6;
+    double rps = completed / seconds;
+    double mbps = bytes / seconds / (1024 * 1024);
+    double p50 = Histogram::Percentile(counts, 0.50) / 1000.0;
+    double p90 = Histogram::Percentile(counts, 0.90) / 1000.0;
+    double p99 = Histogram::Percentile(counts, 0.99) / 1000.0;
+    double p999 = Histogram::Percentile(counts, 0.999) / 1000.0;
+    double maxMs = maxUs / 1000.0;
+    double lagP99 = Histogram::Percentile(lagCounts, 0.99) / 1000.0;
+    double lagMax = maxLagUs / 1000.0;
+
+    if (opt.csv)
+    {
+        printf("label,speed,gen_threads,sessions,requests,completed,rps,mb_per_sec,"
+               "p50_ms,p90_ms,p99_ms,p999_ms,max_ms,lag_p99_ms,lag_max_ms,2xx,3xx,4xx,5xx,errors,timeouts,skipped\n");
+        printf("\"%s\",%g,%d,%zu,%llu,%llu,%.0f,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+               opt.label.c_str(), opt.speed, opt.threads, sessions, (unsigned long long)requests,
+               (unsigned long long)completed, rps, mbps, p50, p90, p99, p999, maxMs, lagP99, lagMax,
+               (unsigned long long)statusClass[0], (unsigned long long)statusClass[1],
+               (unsigned long long)statusClass[2], (unsigned long long)statusClass[3],
+               (unsigned long long)errors, (unsigned long long)timeouts, (unsigned long long)skipped);
+        fflush(stdout);
+        return;
+    }
+    printf("file=%s speed=%g loops=%d threads=%d pipeline=%d duration=%.1fs\n",
+           opt.file.c_str(), opt.speed, opt.loops, opt.threads, opt.pipeline ? 1 : 0, seconds);
+    printf("  sessions %zu (%llu with gaps)  requests %llu  completed %llu  connects %llu\n",
+           sessions, (unsigned long long)gaps, (unsigned long long)requests, (unsigned long long)completed,
+           (unsigned long long)connects);
+    printf("  rps %.0f  transfer %.2f MB/s\n", rps, mbps);
+    printf("  latency(ms) p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n", p50, p90, p99, p999, maxMs);
+    if (opt.speed > 0)
+    {
+        printf("  lag(ms) p99 %.3f  max %.3f\n", lagP99, lagMax);
+    }
+    printf("  status 2xx %llu  3xx %llu  4xx %llu  5xx %llu  errors %llu  timeouts %llu  skipped %llu\n",
+           (unsigned long long)statusClass[0], (unsigned long long)statusClass[1],
+           (unsigned long long)statusClass[2], (unsigned long long)statusClass[3],
+           (unsigned long long)errors, (unsigned long long)timeouts, (unsigned long long)skipped);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    Options opt;
+    int ch;
+    while ((ch = getopt(argc, argv, "a:p:t:x:n:PT:d:f:l:h")) != -1)
+    {
+        switch (ch)
+        {
+        case 'a':
+            opt.host = optarg;
+            break;
+        case 'p':
+            opt.port = atoi(optarg);
+            break;
+        case 't':
+            opt.threads = atoi(optarg);
+            break;
+        case 'x':
+            opt.speed = atof(optarg);
+            break;
+        case 'n':
+            opt.loops = atoi(optarg);
+            break;
+        case 'P':
+            opt.pipeline = true;
+            break;
+        case 'T':
+            opt.timeoutMs = atoi(optarg);
+            break;
+        case 'd':
+            opt.maxSec = atoi(optarg);
+            break;
+        case 'f':
+            opt.csv = strcmp(optarg, "csv") == 0;
+            break;
+        case 'l':
+            opt.label = optarg;
+            break;
+        default:
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1 || opt.threads <= 0 || opt.speed < 0 || opt.loops <= 0 || opt.timeoutMs <= 0 ||
+        opt.maxSec < 0)
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+    opt.file = argv[optind];
+
+    std::vector<Session> sessions;
+    uint64_t gaps = 0;
+    if (!LoadCapture(opt.file, sessions, gaps))
+    {
+        return 1;
+    }
+    if (sessions.empty())
+    {
+        fprintf(stderr, "no connections with data in %s\n", opt.file.c_str());
+        return 1;
+    }
+    uint64_t requests = 0;
+    // 一轮的长度取最后一个连接的结束时间，下一轮接在其后
+    int64_t spanUs = 0;
+    for (const Session &session : sessions)
+    {
+        for (const Chunk &chunk : session.chunks)
+        {
+            requests += chunk.requests;
+        }
+        int64_t endUs = session.startUs + std::max(session.closeUs, session.chunks.back().atUs);
+        spanUs = std::max(spanUs, endUs + 1000);
+    }
+    requests *= opt.loops;
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    if (inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr) != 1)
+    {
+        struct hostent *host = gethostbyname(opt.host.c_str());
+        if (!host || host->h_addrtype != AF_INET)
+        {
+            fprintf(stderr, "cannot resolve %s\n", opt.host.c_str());
+            return 1;
+        }
+        memcpy(&addr.sin_addr, host->h_addr_list[0], sizeof(addr.sin_addr));
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    int64_t beginUs = NowUs();
+    for (int i = 0; i < opt.threads; i++)
+    {
+        std::unique_ptr<Worker> worker(new Worker);
+        worker->opt = &opt;
+        worker->addr = &addr;
+        worker->beginUs = beginUs;
+        worker->endUs = opt.maxSec > 0 ? beginUs + static_cast<int64_t>(opt.maxSec) * 1000000 : 0;
+        workers.push_back(std::move(worker));
+    }
+    // 连接按开始时间轮流分给各线程，每个线程内仍按开始时间排列
+    size_t index = 0;
+    for (int loop = 0; loop < opt.loops; loop++)
+    {
+        for (const Session &session : sessions)
+        {
+            Conn conn;
+            conn.session = &session;
+            conn.startUs = Scale(opt, session.startUs + spanUs * loop);
+            workers[index++ % workers.size()]->conns.push_back(conn);
+        }
+    }
+    std::vector<std::thread> threads;
+    for (auto &worker : workers)
+    {
+        Worker *w = worker.get();
+        threads.emplace_back([w]
+                             { RunWorker(*w); });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    PrintResult(opt, sessions.size() * opt.loops, requests, gaps, workers, (NowUs() - beginUs) / 1e6);
+    return 0;
+}
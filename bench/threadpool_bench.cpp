@@ -0,0 +1,141 @@
+/**
+ * @file threadpool_bench.cpp
+ * @brief 线程池基准测试，比较原来的单锁队列线程池和工作窃取线程池的吞吐
+ *
+ * 用法：poolbench [任务数] [每个任务的空转次数]
+ * 任务全部由一个线程提交，模拟epoll线程向线程池分发读写事件
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <functional>
+#include <memory>
+
+#include "../code/pool/threadpool.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+/**
+ * @brief 原来的线程池实现：一个互斥锁、一个条件变量保护一个std::queue
+ *
+ */
+class LockedPool
+{
+private:
+    struct Pool
+    {
+        std::mutex mtx;
+        std::condition_variable cond;
+        bool isClosed = false;
+        std::queue<std::function<void()>> tasks;
+    };
+    std::shared_ptr<Pool> pool_;
+
+public:
+    explicit LockedPool(size_t threadCount) : pool_(std::make_shared<Pool>())
+    {
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            std::thread([pool = pool_]
+                        {
+                            std::unique_lock<std::mutex> locker(pool->mtx);
+                            while (true)
+                            {
+                                if (!pool->tasks.empty())
+                                {
+                                    auto task = std::move(pool->tasks.front());
+                                    pool->tasks.pop();
+                                    locker.unlock();
+                                    task();
+                                    locker.lock();
+                                }
+                                else if (pool->isClosed)
+                                {
+                                    break;
+                                }
+                                else
+                                {
+                                    pool->cond.wait(locker);
+                                }
+                            } })
+                .detach();
+        }
+    }
+    ~LockedPool()
+    {
+        {
+            std::lock_guard<std::mutex> locker(pool_->mtx);
+            pool_->isClosed = true;
+        }
+        pool_->cond.notify_all();
+    }
+    template <class F>
+    void AddTask(F &&task)
+    {
+        {
+            std::lock_guard<std::mutex> locker(pool_->mtx);
+            pool_->tasks.emplace(std::forward<F>(task));
+        }
+        pool_->cond.notify_one();
+    }
+};
+
+static void Spin(int n)
+{
+    for (volatile int i = 0; i < n; i++)
+    {
+    }
+}
+
+/**
+ * @brief 提交tasks个任务并等待全部完成
+ *
+ * @return double 每秒完成的任务数
+ */
+template <class P>
+static double Run(P &pool, int tasks, int work)
+{
+    std::atomic<int> done(0);
+    auto start = BenchClock::now();
+    for (int i = 0; i < tasks; i++)
+    {
+        pool.AddTask([&done, work]
+                     {
+                         Spin(work);
+                         done.fetch_add(1, std::memory_order_relaxed); });
+    }
+    while (done.load(std::memory_order_relaxed) < tasks)
+    {
+        std::this_thread::yield();
+    }
+    double sec = std::chrono::duration<double>(BenchClock::now() - start).count();
+    return tasks / sec;
+}
+
+int main(int argc, char *argv[])
+{
+    int tasks = argc > 1 ? atoi(argv[1]) : 1000000;
+    int work = argc > 2 ? atoi(argv[2]) : 100;
+    printf("tasks=%d work=%d\n", tasks, work);
+    printf("%8s %16s %16s %8s\n", "threads", "locked(task/s)", "stealing(task/s)", "speedup");
+    const int threadNums[] = {4, 8, 16, 32, 64};
+    for (int threads : threadNums)
+    {
+        double locked, stealing;
+        {
+            LockedPool pool(threads);
+            locked = Run(pool, tasks, work);
+        }
+        {
+            ThreadPool pool(threads);
+            stealing = Run(pool, tasks, work);
+        }
+        printf("%8d %16.0f %16.0f %7.2fx\n", threads, locked, stealing, stealing / locked);
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * @file timer_bench.cpp
+ * @brief 定时器基准测试，比较HeapTimer和TimeWheel在大量长连接下的开销
+ *
+ * 用法：timerbench [连接数] [活跃事件数]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <thread>
+
+#include "../code/timer/heaptimer.h"
+#include "../code/timer/timewheel.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double ElapsedNs(BenchClock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+}
+
+static void BenchHeap(int conns, int events, const std::vector<int> &ids)
+{
+    HeapTimer timer;
+    auto start = BenchClock::now();
+    for (int i = 0; i < conns; i++)
+    {
+        timer.add(i, 60000, [] {});
+    }
+    double addNs = ElapsedNs(start) / conns;
+
+    start = BenchClock::now();
+    for (int i = 0; i < events; i++)
+    {
+        timer.adjust(ids[i], 60000);
+    }
+    double adjustNs = ElapsedNs(start) / events;
+
+    start = BenchClock::now();
+    for (int i = 0; i < 1000; i++)
+    {
+        timer.GetNextTick();
+    }
+    double tickNs = ElapsedNs(start) / 1000;
+    printf("HeapTimer  conns=%d add=%.1fns adjust=%.1fns GetNextTick=%.1fns\n",
+           conns, addNs, adjustNs, tickNs);
+}
+
+// 定时器到期比期限晚超过该值记为延迟，留出睡眠和缓存时钟的误差
+static const int64_t LATE_TOLERANCE_MS = 10;
+
+// 返回false表示有定时器提前或延迟触发
+static bool BenchWheel(int conns, int events, const std::vector<int> &ids)
+{
+    std::vector<WheelNode> nodes(conns);
+    size_t fired = 0;
+    TimeWheel timer([&fired](WheelNode *)
+                    { fired++; });
+    auto start = BenchClock::now();
+    for (int i = 0; i < conns; i++)
+    {
+        nodes[i].id = i;
+        timer.add(&nodes[i], 60000);
+    }
+    double addNs = ElapsedNs(start) / conns;
+
+    start = BenchClock::now();
+    for (int i = 0; i < events; i++)
+    {
+        timer.adjust(&nodes[ids[i]], 60000);
+    }
+    double adjustNs = ElapsedNs(start) / events;
+
+    start = BenchClock::now();
+    for (int i = 0; i < 1000; i++)
+    {
+        timer.GetNextTick();
+    }
+    double tickNs = ElapsedNs(start) / 1000;
+
+    start = BenchClock::now();
+    for (int i = 0; i < conns; i++)
+    {
+        timer.cancel(&nodes[i]);
+    }
+    double cancelNs = ElapsedNs(start) / conns;
+    printf("TimeWheel  conns=%d add=%.1fns adjust=%.1fns GetNextTick=%.1fns cancel=%.1fns\n",
+           conns, addNs, adjustNs, tickNs, cancelNs);
+
+    // 到期正确性：短超时的节点全部到期，不会提前触发，也不会明显延迟
+    std::mt19937 rng(1);
+    std::vector<int64_t> deadline(conns);
+    size_t early = 0;
+    size_t late = 0;
+    int64_t maxLateMs = 0;
+    fired = 0;
+    TimeWheel expiring([&](WheelNode *node)
+                       {
+        fired++;
+        int64_t lateMs = CachedClock::NowMs() - deadline[node->id];
+        if (lateMs < 0)
+        {
+            early++;
+        }
+        else if (lateMs > LATE_TOLERANCE_MS)
+        {
+            late++;
+        }
+        maxLateMs = std::max(maxLateMs, lateMs); });
+    CachedClock::Refresh();
+    for (int i = 0; i < conns; i++)
+    {
+        int timeout = 1 + rng() % 600;
+        deadline[i] = CachedClock::NowMs() + timeout;
+        expiring.add(&nodes[i], timeout);
+    }
+    start = BenchClock::now();
+    while (expiring.size() > 0)
+    {
+        // 和服务器的事件循环一样，每轮刷新一次缓存时钟
+        CachedClock::Refresh();
+        int wait = expiring.GetNextTick();
+        if (wait > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(wait));
+        }
+    }
+    printf("TimeWheel  expired=%zu/%d early=%zu late=%zu(max %lldms) in %.0fms\n",
+           fired, conns, early, late, static_cast<long long>(maxLateMs), ElapsedNs(start) / 1e6);
+    bool ok = fired == static_cast<size_t>(conns) && early == 0 && late == 0;
+
+    // 少量定时器隔一段时间加入一个，第0层的槽大多为空，高层的节点要按下放时间及时处理，不能等到第0层的下一个节点
+    int sparse = std::min(conns, 64);
+    int added = 0;
+    early = late = 0;
+    maxLateMs = 0;
+    fired = 0;
+    CachedClock::Refresh();
+    int64_t nextAdd = CachedClock::NowMs();
+    start = BenchClock::now();
+    while (added < sparse || expiring.size() > 0)
+    {
+        CachedClock::Refresh();
+        int64_t now = CachedClock::NowMs();
+        if (added < sparse && now >= nextAdd)
+        {
+            int timeout = 1 + rng() % 600;
+            deadline[added] = now + timeout;
+            expiring.add(&nodes[added], timeout);
+            added++;
+            nextAdd = now + 37;
+        }
+        int wait = expiring.GetNextTick();
+        if (added < sparse && (wait < 0 || wait > nextAdd - now))
+        {
+            wait = static_cast<int>(nextAdd - now);
+        }
+        if (wait > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(wait));
+        }
+    }
+    printf("TimeWheel  sparse expired=%zu/%d early=%zu late=%zu(max %lldms) in %.0fms\n",
+           fired, sparse, early, late, static_cast<long long>(maxLateMs), ElapsedNs(start) / 1e6);
+    return ok && fired == static_cast<size_t>(sparse) && early == 0 && late == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int conns = argc > 1 ? atoi(argv[1]) : 100000;
+    int events = argc > 2 ? atoi(argv[2]) : 1000000;
+    std::mt19937 rng(42);
+    std::vector<int> ids(events);
+    for (auto &id : ids)
+    {
+        id = rng() % conns;
+    }
+    BenchHeap(conns, events, ids);
+    if (!BenchWheel(conns, events, ids))
+    {
+        printf("TimeWheel  FAILED: timers fired early or late\n");
+        return 1;
+    }
+    return 0;
+}
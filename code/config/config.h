@@ -0,0 +1,232 @@
+/**
+ * @file config.h
+ * @brief 服务器可选配置，构造WebServer时传入，不传则使用默认值
+ *
+ */
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/**
+ * @brief 连接各阶段的超时设置，单位ms，<=0表示该阶段不限时
+ *
+ */
+struct TimeoutConfig
+{
+    // 请求头必须在该时间内接收完整，从连接建立或收到新请求的第一个字节开始计时
+    int headerMS = 10000;
+    // 请求头接收完后，请求体必须在该时间内接收完整
+    int bodyMS = 30000;
+    // keep-alive连接两个请求之间的最长空闲时间，由WebServer构造函数的timeoutMS参数指定
+    int idleMS = 60000;
+    // 发送响应的宽限时间，加上按最低发送速率计算的时间即为发送阶段的期限
+    int writeStallMS = 10000;
+    // 最低发送速率，单位字节/秒，<=0表示只使用宽限时间
+    int minSendRate = 1024;
+};
+
+/**
+ * @brief 请求大小的上限，在请求接收完整之前检查，超过时返回431/413并关闭连接
+ *
+ */
+struct RequestLimitConfig
+{
+    // 请求行加请求头的最大字节数，0表示不限制
+    size_t maxHeaderBytes = 8192;
+    // Content-Length的最大值，0表示不限制
+    size_t maxBodyBytes = 1024 * 1024;
+};
+
+/**
+ * @brief 一条执行通道的线程数和队列长度
+ * threads<=0表示不单独建立线程池，这类请求和静态请求一起处理
+ *
+ */
+struct LaneConfig
+{
+    int threads;
+    // 每个线程的任务队列长度，队列满时新请求直接返回503
+    int queueSize;
+};
+
+/**
+ * @brief 线程池弹性伸缩设置
+ * 控制线程周期性地统计任务排队时间，p99超过目标时增加线程，持续空闲时减少线程
+ *
+ */
+struct ElasticConfig
+{
+    // 关闭时线程数固定
+    bool enabled = false;
+    int minThreads = 2;
+    int maxThreads = 32;
+    // 任务排队时间p99的目标，单位us
+    int targetP99Us = 2000;
+    // 采样周期，单位ms
+    int intervalMs = 100;
+    // 有线程持续空闲超过该时间则减少一个线程，单位ms
+    int idleShrinkMs = 5000;
+};
+
+/**
+ * @brief 日志的可选设置，延迟格式化和二进制文件只在异步日志下生效
+ *
+ */
+struct LogConfig
+{
+    // 调用处只记录格式串编号和参数，由后台线程格式化
+    bool deferred = false;
+    // 日志文件为二进制格式，由logdecode导出为文本，开启后也使用延迟格式化
+    bool binary = false;
+    // 刷新策略：距上次刷新超过flushIntervalMs、未刷新的数据超过flushBytes，
+    // 或写入等级不低于flushLevel的日志时刷新文件，同步日志同样适用
+    int flushIntervalMs = 1000;
+    int flushBytes = 256 * 1024;
+    int flushLevel = 3;
+    // 日志文件每次预分配的大小，单位字节，<=0表示不预分配
+    int preallocBytes = 4 * 1024 * 1024;
+    // 切换文件后用gzip压缩旧文件
+    bool compress = false;
+
+    // 过载保护，ERROR不受以下任何策略影响，总是写入
+    // 缓冲区满时丢弃日志并计数，而不是让请求线程等待后台线程
+    bool dropOnFull = true;
+    // 每个调用处每秒最多写入的行数，<=0表示不限制
+    int siteRateLimit = 0;
+    // DEBUG、INFO按概率采样，1表示全部写入
+    double debugSample = 1.0;
+    double infoSample = 1.0;
+    // 有日志被丢弃时，每隔dropSummaryMs写一行汇总，<=0表示不写
+    int dropSummaryMs = 10000;
+};
+
+/**
+ * @brief 访问日志设置，每个请求一条二进制记录，由accesslog工具导出和统计
+ *
+ */
+struct AccessLogConfig
+{
+    bool enabled = false;
+    // 文件写在dir下，每天一个，如2022_03_12.access
+    const char *dir = "./log";
+    // 每个线程的缓冲区大小，单位KB，写满时丢弃记录
+    int ringKB = 256;
+    // 后台线程写入文件的周期
+    int flushIntervalMs = 1000;
+};
+
+/**
+ * @brief 流量录制设置，按连接采样记录收到的原始请求和到达时间，用bench/replay回放
+ * 录制文件包含请求的原始内容(如登录表单中的密码)，只应在测试环境中开启
+ *
+ */
+struct CaptureConfig
+{
+    bool enabled = false;
+    // 文件写在dir下，每次启动一个，如capture_20220312_100000.cap
+    const char *dir = "./log";
+    // 录制的连接比例，1表示全部
+    double sampleRate = 0.1;
+    // 文件达到该大小后停止录制，单位MB
+    int maxMB = 256;
+    // 每个线程的缓冲区大小，单位KB，写满时该连接停止录制
+    int ringKB = 1024;
+    // 后台线程写入文件的周期
+    int flushIntervalMs = 1000;
+};
+
+/**
+ * @brief 指标设置，开启后在path上以Prometheus文本格式输出
+ *
+ */
+struct MetricsConfig
+{
+    bool enabled = false;
+    const char *path = "/metrics";
+};
+
+/**
+ * @brief 管理接口设置
+ * port为0且没有unixPath时管理接口(如指标)经过主端口提供，由管理通道处理；
+ * port大于0时在127.0.0.1:port上提供，unixPath不为空时在该unix socket上提供，
+ * 两者可以同时使用，此时主端口不再响应这些路径
+ *
+ */
+struct AdminConfig
+{
+    int port = 0;
+    const char *unixPath = nullptr;
+    // 运行状态快照(连接表、定时器、线程池、数据库连接池、日志队列)，
+    // 只在单独监听本机端口或unix socket时提供，不经过主端口暴露
+    const char *statePath = "/admin/state";
+};
+
+/**
+ * @brief 请求追踪设置，按采样率记录请求各阶段的时间，在path上导出为Chrome trace JSON
+ *
+ */
+struct TraceConfig
+{
+    // 0表示关闭，1表示追踪所有请求
+    double sampleRate = 0;
+    // 保存最近多少个请求
+    int capacity = 4096;
+    const char *path = "/admin/trace";
+};
+
+/**
+ * @brief 锁争用统计设置
+ * 开启后各模块的互斥锁、信号量按名字统计获取次数、争用次数、等待和持有时间，在path上输出文本报告，
+ * 开启指标时同时以webserver_lock_*输出；关闭时加锁只多一次判断
+ *
+ */
+struct LockStatsConfig
+{
+    bool enabled = false;
+    const char *path = "/admin/locks";
+    // 服务器析构时把报告写入日志
+    bool reportOnExit = true;
+};
+
+/**
+ * @brief 热点统计设置，用count-min sketch加小顶堆流式统计请求最多的路径和客户端地址
+ * 开启后每个请求在两个sketch上各做depth次原子加，在path上输出文本报告，
+ * 开启指标时同时以webserver_hot_*输出；客户端地址只在管理接口单独监听时输出
+ *
+ */
+struct HotSpotConfig
+{
+    bool enabled = false;
+    // 每类保留的热点数量
+    int k = 20;
+    // sketch每行的计数器数量和行数，估计值偏大的幅度约为总请求数的2.7/width
+    int width = 4096;
+    int depth = 4;
+    // 每隔decaySec秒所有计数减半，热点反映最近的流量，<=0表示不衰减
+    int decaySec = 60;
+    const char *path = "/admin/hot";
+};
+
+struct ServerConfig
+{
+    TimeoutConfig timeout;
+    RequestLimitConfig limits;
+    // 缓存时钟使用CLOCK_*_COARSE，读取更快但精度只有一个时钟节拍(通常1~4ms)
+    bool coarseClock = false;
+    // 数据库通道，处理登录、注册等需要访问数据库的请求
+    LaneConfig dbLane = {2, 64};
+    // 静态请求通道的弹性伸缩，开启后threadNum为初始线程数
+    ElasticConfig elastic;
+    // 管理通道，处理路径以adminPrefix开头的请求
+    LaneConfig adminLane = {1, 16};
+    const char *adminPrefix = "/admin/";
+    LogConfig log;
+    AccessLogConfig accessLog;
+    CaptureConfig capture;
+    MetricsConfig metrics;
+    TraceConfig trace;
+    LockStatsConfig locks;
+    HotSpotConfig hot;
+    AdminConfig admin;
+};
+
+#endif
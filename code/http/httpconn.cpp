@@ -1,15 +1,43 @@
 #include "httpconn.h"
+#include "../metrics/probes.h"
 using namespace std;
 
 const char *HttpConn::srcDir;
-atomic<int> HttpConn::userCount;
+ShardedCounter HttpConn::userCount;
 bool HttpConn::isET;
+bool HttpConn::accessLog;
+bool HttpConn::captureTraffic;
+TimeoutConfig HttpConn::timeout;
+
+// 热数据必须放在一个缓存行内
+static_assert(sizeof(HttpConn) == 64, "HttpConn hot record should fit in one cache line");
 
 HttpConn::HttpConn(/* args */)
 {
     fd_ = -1;
-    addr_ = {0};
+    gen_ = 0;
     isClose_ = true;
+    phase_ = PHASE_IDLE;
+    holders_ = 0;
+    deadline_ = INT64_MAX;
+    iovCnt_ = 0;
+    iov_[0] = {nullptr, 0};
+    iov_[1] = {nullptr, 0};
+    cold_.reset(new Cold());
+    cold_->addr = {0};
+    cold_->openMs = 0;
+    cold_->beginUs = 0;
+    cold_->parsedUs = 0;
+    cold_->handleUs = 0;
+    cold_->respondedUs = 0;
+    cold_->responseBytes = 0;
+    cold_->traced = false;
+    cold_->snapshot.fd = -1;
+    cold_->snapshot.gen = 0;
+    cold_->snapshot.ip = 0;
+    cold_->snapshot.port = 0;
+    cold_->snapshot.openMs = 0;
+    cold_->snapshot.writeBytes = 0;
 }
 
 HttpConn::~HttpConn()
@@ -17,29 +45,69 @@ HttpConn::~HttpConn()
     Close();
 }
 
-void HttpConn::Init(int sockFd, const sockaddr_in &addr)
+void *HttpConn::operator new(size_t size)
+{
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, alignof(HttpConn), size) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void HttpConn::operator delete(void *ptr)
+{
+    free(ptr);
+}
+
+void HttpConn::Init(int sockFd, const sockaddr_in &addr, uint32_t gen)
 {
     assert(sockFd > 0);
     // 每有一个新连接，都会创建一个新的文件描述符
     userCount++;
-    addr_ = addr;
+    cold_->addr = addr;
+    cold_->openMs = CachedClock::NowMs();
     fd_ = sockFd;
+    gen_ = gen;
+    Cold::Snapshot &snapshot = cold_->snapshot;
+    snapshot.fd.store(sockFd, std::memory_order_relaxed);
+    snapshot.gen.store(gen, std::memory_order_relaxed);
+    snapshot.ip.store(addr.sin_addr.s_addr, std::memory_order_relaxed);
+    snapshot.port.store(addr.sin_port, std::memory_order_relaxed);
+    snapshot.openMs.store(cold_->openMs, std::memory_order_relaxed);
+    snapshot.writeBytes.store(0, std::memory_order_relaxed);
     // 每init一个都会创建一个缓冲区
-    writeBuff_.RetrieveAll();
-    readBuff_.RetrieveAll();
+    cold_->writeBuff.RetrieveAll();
+    cold_->readBuff.RetrieveAll();
     isClose_ = false;
-    LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
+    // 新连接从接收请求头开始计时
+    phase_ = PHASE_IDLE;
+    SetPhase_(PHASE_HEADER, timeout.headerMS);
+    if (Timed_())
+    {
+        cold_->beginUs = AccessLog::NowUs();
+    }
+    StartTrace_();
+    cold_->captureId = captureTraffic ? TrafficCapture::Instance()->Open() : 0;
+    cold_->captureBytes = 0;
+    LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount.Load());
 }
 
 void HttpConn::Close(void)
 {
-    response_.UnmapFile();
-    if (isClose_ == false)
+    // 事件循环和工作线程可能同时关闭，只有抢到的一方关闭fd，另一方不会关掉已被新连接复用的fd
+    if (!isClose_.exchange(true, std::memory_order_acq_rel))
     {
-        isClose_ = true;
+        cold_->response.UnmapFile();
         userCount--;
+        if (cold_->captureId != 0)
+        {
+            TrafficCapture::Instance()->Close(cold_->captureId, cold_->captureBytes);
+            cold_->captureId = 0;
+        }
+        LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)userCount.Load());
+        // fd关闭后可能立刻被新连接复用，对象随之被重新Init，所以放在最后
         close(fd_);
-        LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
     }
 }
 
@@ -48,20 +116,38 @@ int HttpConn::GetFd(void) const
     return fd_;
 }
 
+HttpConn::Info HttpConn::GetInfo(void) const
+{
+    const Cold::Snapshot &snapshot = cold_->snapshot;
+    Info info;
+    info.fd = snapshot.fd.load(std::memory_order_relaxed);
+    info.gen = snapshot.gen.load(std::memory_order_relaxed);
+    memset(&info.addr, 0, sizeof(info.addr));
+    info.addr.sin_family = AF_INET;
+    info.addr.sin_addr.s_addr = snapshot.ip.load(std::memory_order_relaxed);
+    info.addr.sin_port = snapshot.port.load(std::memory_order_relaxed);
+    info.phase = GetPhase();
+    info.readBytes = cold_->readBuff.ReadableBytes();
+    info.writeBytes = snapshot.writeBytes.load(std::memory_order_relaxed);
+    info.openMs = snapshot.openMs.load(std::memory_order_relaxed);
+    info.deadlineMs = GetDeadline();
+    return info;
+}
+
 const char *HttpConn::GetIP(void) const
 {
     // 将IP从主机转换为点分十进制的字符串形式
-    return inet_ntoa(addr_.sin_addr);
+    return inet_ntoa(cold_->addr.sin_addr);
 }
 
 sockaddr_in HttpConn::GetAddr(void) const
 {
-    return addr_;
+    return cold_->addr;
 }
 
 int HttpConn::GetPort(void) const
 {
-    return addr_.sin_port;
+    return cold_->addr.sin_port;
 }
 
 ssize_t HttpConn::read(int *saveErrno)
@@ -69,11 +155,18 @@ ssize_t HttpConn::read(int *saveErrno)
     ssize_t len = -1;
     do
     {
-        len = readBuff_.ReadFd(fd_, saveErrno);
+        len = cold_->readBuff.ReadFd(fd_, saveErrno);
         if (len <= 0)
         {
             break;
         }
+        // 新读到的数据在缓冲区可写位置之前；记录失败说明缓冲区满，之后的数据不再完整，停止录制
+        if (cold_->captureId != 0 &&
+            !TrafficCapture::Instance()->Data(cold_->captureId, cold_->captureBytes,
+                                              cold_->readBuff.BeginWriteConst() - len, len))
+        {
+            cold_->captureId = 0;
+        }
     } while (isET);
     return len;
 }
@@ -81,6 +174,7 @@ ssize_t HttpConn::read(int *saveErrno)
 ssize_t HttpConn::write(int *saveErrno)
 {
     ssize_t len = -1;
+    USDT_PROBE2(write_start, fd_, ToWriteBytes());
     do
     {
         len = writev(fd_, iov_, iovCnt_);
@@ -89,6 +183,11 @@ ssize_t HttpConn::write(int *saveErrno)
             *saveErrno = errno;
             break;
         }
+        if (ServerMetrics::enabled)
+        {
+            ServerMetrics::bytesOut.Add(len);
+        }
+        Trace(RequestTracer::STAGE_FIRST_WRITE);
         // 传输结束
         if (iov_[0].iov_len + iov_[1].iov_len == 0)
         {
@@ -100,7 +199,7 @@ ssize_t HttpConn::write(int *saveErrno)
             iov_[1].iov_len -= (len - iov_[0].iov_len);
             if (iov_[0].iov_len)
             {
-                writeBuff_.RetrieveAll();
+                cold_->writeBuff.RetrieveAll();
                 iov_[0].iov_len = 0;
             }
         }
@@ -108,43 +207,265 @@ ssize_t HttpConn::write(int *saveErrno)
         {
             iov_[0].iov_base = (uint8_t *)iov_[0].iov_base + len;
             iov_[0].iov_len -= len;
-            writeBuff_.Retrieve(len);
+            cold_->writeBuff.Retrieve(len);
         }
     } while (isET || ToWriteBytes() > 10240);
+    cold_->snapshot.writeBytes.store(ToWriteBytes(), std::memory_order_relaxed);
+    USDT_PROBE3(write_done, fd_, len, len < 0 ? *saveErrno : 0);
     return len;
 }
 
-bool HttpConn::process(void)
+/**
+ * @brief 切换连接阶段，并从现在开始计算该阶段的期限，阶段不变时期限也不变
+ *
+ * @param phase 新阶段
+ * @param timeoutMs 该阶段的超时时间，<=0表示不限时
+ * @param restart 阶段不变时也重新计算期限
+ */
+void HttpConn::SetPhase_(CONN_PHASE phase, int timeoutMs, bool restart)
+{
+    if (GetPhase() == phase && !restart)
+    {
+        return;
+    }
+    phase_.store(phase, std::memory_order_relaxed);
+    deadline_.store(timeoutMs > 0 ? TimeWheel::NowMs() + timeoutMs : INT64_MAX,
+                    std::memory_order_relaxed);
+}
+
+void HttpConn::BeginRequest(void)
+{
+    if (GetPhase() == PHASE_IDLE)
+    {
+        SetPhase_(PHASE_HEADER, timeout.headerMS);
+        if (Timed_())
+        {
+            cold_->beginUs = AccessLog::NowUs();
+        }
+        StartTrace_();
+    }
+}
+
+// 请求开始时决定是否追踪
+void HttpConn::StartTrace_(void)
+{
+    if (!RequestTracer::enabled)
+    {
+        return;
+    }
+    Cold &cold = *cold_;
+    cold.traced = RequestTracer::Instance()->Sample();
+    if (cold.traced)
+    {
+        memset(cold.traceUs, 0, sizeof(cold.traceUs));
+        cold.traceUs[RequestTracer::STAGE_BEGIN] = CachedClock::PreciseUs();
+    }
+}
+
+void HttpConn::FinishRequest(void)
+{
+    if (RequestTracer::enabled && cold_->traced)
+    {
+        Trace(RequestTracer::STAGE_COMPLETED);
+        RequestTracer::Record record;
+        record.fd = fd_;
+        record.status = cold_->response.Code();
+        snprintf(record.path, sizeof(record.path), "%s", cold_->request.path().c_str());
+        memcpy(record.us, cold_->traceUs, sizeof(record.us));
+        RequestTracer::Instance()->Submit(record);
+        // 流水线中的下一个请求从现在开始
+        StartTrace_();
+    }
+    if (!Timed_())
+    {
+        return;
+    }
+    Cold &cold = *cold_;
+    int64_t now = AccessLog::NowUs();
+    // 各阶段的起点依次不早于前一个阶段，出现倒挂时记为0
+    auto span = [](int64_t from, int64_t to)
+    {
+        return static_cast<uint32_t>(to > from ? to - from : 0);
+    };
+    uint32_t recvUs = span(cold.beginUs, cold.parsedUs);
+    uint32_t queueUs = span(cold.parsedUs, cold.handleUs);
+    uint32_t handleUs = span(cold.handleUs, cold.respondedUs);
+    uint32_t sendUs = span(cold.respondedUs, now);
+    if (ServerMetrics::enabled)
+    {
+        ServerMetrics::stageUs[ServerMetrics::STAGE_RECV].Record(recvUs);
+        ServerMetrics::stageUs[ServerMetrics::STAGE_QUEUE].Record(queueUs);
+        ServerMetrics::stageUs[ServerMetrics::STAGE_HANDLE].Record(handleUs);
+        ServerMetrics::stageUs[ServerMetrics::STAGE_SEND].Record(sendUs);
+        ServerMetrics::requestUs.Record(span(cold.beginUs, now));
+        ServerMetrics::RecordStatus(cold.response.Code());
+    }
+    if (accessLog)
+    {
+        AccessRecord record;
+        memset(&record, 0, sizeof(record));
+        record.peerIp = cold.addr.sin_addr.s_addr;
+        record.peerPort = ntohs(cold.addr.sin_port);
+        record.status = static_cast<uint16_t>(cold.response.Code());
+        record.method = AccessLog::MethodId(cold.request.method());
+        record.keepAlive = cold.response.IsKeepAlive() ? 1 : 0;
+        record.bytes = cold.responseBytes;
+        record.recvUs = recvUs;
+        record.queueUs = queueUs;
+        record.handleUs = handleUs;
+        record.sendUs = sendUs;
+        const std::string &path = cold.request.path();
+        AccessLog::Instance()->Record(record, path.data(), path.size());
+    }
+    // 流水线中的下一个请求可能已经在读缓冲区中，从现在开始计时
+    cold.beginUs = now;
+}
+
+bool HttpConn::ParseRequest(void)
 {
-    request_.Init();
-    if (readBuff_.ReadableBytes() <= 0)
+    HttpRequest &request = cold_->request;
+    Buffer &readBuff = cold_->readBuff;
+
+    request.Init();
+    if (readBuff.ReadableBytes() <= 0)
     {
+        // 响应发送完毕，等待keep-alive连接的下一个请求
+        if (GetPhase() == PHASE_WRITE)
+        {
+            SetPhase_(PHASE_IDLE, timeout.idleMS);
+        }
         return false;
     }
-    else if (request_.parse(readBuff_))
+
+    // 请求报文不完整时继续接收，阶段期限不会因为收到零碎数据而延长
+    HttpRequest::PARSE_STATE recvState = HttpRequest::Probe(readBuff, cold_->rejectCode);
+    if (cold_->rejectCode != 0)
     {
-        LOG_DEBUG("%s", request_.path().c_str());
-        response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
+        // 不解析，由MakeResponse返回该状态码并关闭连接，剩余数据随连接丢弃
+        cold_->parseOk = false;
+        return true;
+    }
+    if (recvState == HttpRequest::HEADERS)
+    {
+        SetPhase_(PHASE_HEADER, timeout.headerMS);
+        return false;
+    }
+    else if (recvState == HttpRequest::BODY)
+    {
+        SetPhase_(PHASE_BODY, timeout.bodyMS);
+        return false;
+    }
+
+    int64_t parseStartUs = ServerMetrics::enabled ? AccessLog::NowUs() : 0;
+    cold_->parseOk = request.parse(readBuff);
+    Trace(RequestTracer::STAGE_PARSED);
+    if (Timed_())
+    {
+        cold_->parsedUs = AccessLog::NowUs();
+        if (ServerMetrics::enabled)
+        {
+            ServerMetrics::parseUs.Record(cold_->parsedUs - parseStartUs);
+        }
+    }
+    return true;
+}
+
+void HttpConn::MakeResponse(int code)
+{
+    HttpRequest &request = cold_->request;
+    HttpResponse &response = cold_->response;
+
+    if (code == -1 && cold_->rejectCode != 0)
+    {
+        code = cold_->rejectCode;
+    }
+    BeginHandle_(code != -1);
+    if (code != -1)
+    {
+        // 拒绝请求后关闭连接，减轻服务器负担
+        response.Init(srcDir, request.path(), false, code);
+    }
+    else if (cold_->parseOk)
+    {
+        // 登录、注册需要访问数据库
+        request.Verify();
+        LOG_DEBUG("%s", request.path().c_str());
+        response.Init(srcDir, request.path(), request.IsKeepAlive(), 200);
     }
     else
     {
-        response_.Init(srcDir, request_.path(), false, 400);
+        response.Init(srcDir, request.path(), false, 400);
+    }
+
+    PrepareWrite_();
+}
+
+void HttpConn::MakeResponse(int code, const std::string &type, std::string &body)
+{
+    BeginHandle_(false);
+    cold_->response.Init(srcDir, cold_->request.path(), cold_->request.IsKeepAlive(), code);
+    cold_->response.SetContent(type, body);
+    PrepareWrite_();
+}
+
+// 开始生成响应，记录处理阶段的起点
+void HttpConn::BeginHandle_(bool rejected)
+{
+    Trace(RequestTracer::STAGE_HANDLE_START);
+    if (HotSpots::enabled)
+    {
+        // 被拒绝的请求可能没有解析出路径，只计入客户端地址
+        HotSpots::Record(rejected ? std::string() : cold_->request.path(), cold_->addr.sin_addr.s_addr,
+                         CachedClock::NowMs());
     }
+    if (Timed_())
+    {
+        cold_->handleUs = AccessLog::NowUs();
+        // 拒绝的请求没有经过解析，排队时间从开始接收算起
+        if (rejected && cold_->parsedUs < cold_->beginUs)
+        {
+            cold_->parsedUs = cold_->beginUs;
+        }
+    }
+}
+
+/**
+ * @brief 生成响应报文，设置writev向量和发送阶段的期限
+ *
+ */
+void HttpConn::PrepareWrite_(void)
+{
+    HttpResponse &response = cold_->response;
+    Buffer &writeBuff = cold_->writeBuff;
 
     // HTTP响应报文（MakeResponse没有添加响应体内容，也没有发送数据）
-    response_.MakeResponse(writeBuff_);
+    response.MakeResponse(writeBuff);
     // 响应行、响应头的起始地址和长度
-    iov_[0].iov_base = const_cast<char *>(writeBuff_.Peek());
-    iov_[0].iov_len = writeBuff_.ReadableBytes();
+    iov_[0].iov_base = const_cast<char *>(writeBuff.Peek());
+    iov_[0].iov_len = writeBuff.ReadableBytes();
     iovCnt_ = 1;
 
     // 文件
-    if (response_.FileLen() > 0 && response_.File())
+    if (response.FileLen() > 0 && response.File())
     {
-        iov_[1].iov_base = response_.File();
-        iov_[1].iov_len = response_.FileLen();
+        iov_[1].iov_base = response.File();
+        iov_[1].iov_len = response.FileLen();
         iovCnt_ = 2;
     }
-    LOG_DEBUG("filesize:%d, %d to %d", response_.FileLen(), iovCnt_, ToWriteBytes());
-    return true;
+    // 发送期限 = 宽限时间 + 按最低发送速率发送全部数据所需的时间
+    int writeMs = timeout.writeStallMS;
+    if (writeMs > 0 && timeout.minSendRate > 0)
+    {
+        writeMs += static_cast<int>(static_cast<int64_t>(ToWriteBytes()) * 1000 / timeout.minSendRate);
+    }
+    // 流水线请求会连续进入发送阶段，每个响应都重新计算期限
+    SetPhase_(PHASE_WRITE, writeMs, true);
+    cold_->snapshot.writeBytes.store(ToWriteBytes(), std::memory_order_relaxed);
+    if (Timed_())
+    {
+        cold_->responseBytes = ToWriteBytes();
+        cold_->respondedUs = AccessLog::NowUs();
+    }
+    Trace(RequestTracer::STAGE_HANDLED);
+    LOG_DEBUG("filesize:%d, %d to %d", response.FileLen(), iovCnt_, ToWriteBytes());
 }
\ No newline at end of file
@@ -22,65 +22,231 @@
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <errno.h>
+#include <atomic>
+#include <memory>
 
 #include "../log/log.h"
+#include "../log/accesslog.h"
+#include "../log/capture.h"
+#include "../metrics/servermetrics.h"
+#include "../metrics/tracer.h"
+#include "../metrics/topk.h"
 #include "../pool/sqlconnRAII.h"
 #include "../buffer/buffer.h"
+#include "../metrics/shardedcounter.h"
+#include "../timer/timewheel.h"
+#include "../config/config.h"
 #include "httprequest.h"
 #include "httpresponse.h"
 
-class HttpConn
+/**
+ * @brief HTTP连接
+ * 每次事件都会访问的热数据(fd、writev向量、关闭标志)放在对象开头并按缓存行对齐
+ * 地址、读写缓冲区、请求和响应这些体积大的冷数据单独分配，避免挤占热数据所在的缓存行
+ *
+ */
+class alignas(64) HttpConn
 {
+public:
+    // 连接所处阶段，每个阶段有各自的超时期限
+    enum CONN_PHASE
+    {
+        PHASE_HEADER,
+        PHASE_BODY,
+        PHASE_WRITE,
+        PHASE_IDLE,
+    };
+
 private:
+    /* 热数据 */
     int fd_;
-    struct sockaddr_in addr_;
-
-    bool isClose_;
+    // 连接槽代数，和fd一起登记到epoll中，用于识别过期事件
+    uint32_t gen_;
+    std::atomic<bool> isClose_;
+    std::atomic<uint8_t> phase_;
+    // 持有连接的工作线程数，事件循环转交任务前+1，工作线程交还epoll或关闭连接后-1
+    // 不为0时定时器不关闭连接；复用对象时不清零，上一个连接迟到的-1不会让计数回绕
+    std::atomic<uint8_t> holders_;
 
     /* iovCnt_、iov_都是用于writev函数，用于在一次函数调用中写多个非连续缓冲区 */
     int iovCnt_;
     // 向量元素
     struct iovec iov_[2];
 
-    // 读缓冲区
-    Buffer readBuff_;
-    // 写缓冲区
-    Buffer writeBuff_;
+    /* 冷数据 */
+    struct Cold
+    {
+        struct sockaddr_in addr;
+        // 连接建立的时间，单调时钟ms
+        int64_t openMs;
+        // 读缓冲区
+        Buffer readBuff;
+        // 写缓冲区
+        Buffer writeBuff;
+
+        HttpRequest request;
+        HttpResponse response;
+        // 最近一次解析请求是否成功
+        bool parseOk;
+        // 请求在接收完整之前就被判定不合法时应返回的状态码(400/413/431)，否则为0
+        int rejectCode;
+
+        // 当前请求各阶段开始的时间，单调时钟us，只在开启访问日志时记录
+        int64_t beginUs;
+        int64_t parsedUs;
+        int64_t handleUs;
+        int64_t respondedUs;
+        // 响应的总字节数，发送过程中ToWriteBytes会减少，生成响应时先记下
+        uint64_t responseBytes;
+
+        // 当前请求是否被追踪采样，以及各追踪阶段的时间，单调时钟us
+        bool traced;
+        int64_t traceUs[RequestTracer::STAGE_COUNT];
+
+        // 流量录制的连接编号，0表示不录制；已录制的字节数
+        uint64_t captureId;
+        uint64_t captureBytes;
+
+        // 供管理接口读取的状态快照，由持有连接的线程写入，管理线程只读这些原子字段
+        struct Snapshot
+        {
+            std::atomic<int> fd;
+            std::atomic<uint32_t> gen;
+            // 对端地址，网络字节序
+            std::atomic<uint32_t> ip;
+            std::atomic<uint16_t> port;
+            std::atomic<int64_t> openMs;
+            // 还未发送的响应字节数
+            std::atomic<size_t> writeBytes;
+        } snapshot;
+    };
+    std::unique_ptr<Cold> cold_;
+    // 当前阶段的期限，单调时钟ms，由工作线程和主线程在各自持有连接时修改
+    std::atomic<int64_t> deadline_;
 
-    HttpRequest request_;
-    HttpResponse response_;
+    void SetPhase_(CONN_PHASE phase, int timeoutMs, bool restart = false);
+    void BeginHandle_(bool rejected);
+    void StartTrace_(void);
+    void PrepareWrite_(void);
+    // 是否需要记录请求各阶段的时间
+    static bool Timed_(void) { return accessLog || ServerMetrics::enabled; }
 
 public:
     HttpConn(/* args */);
     ~HttpConn();
 
-    void Init(int sockFd, const sockaddr_in &addr);
+    // C++14的new不保证超过16字节的对齐，手动按缓存行分配
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
+    void Init(int sockFd, const sockaddr_in &addr, uint32_t gen = 0);
     ssize_t read(int *saveErrno);
     ssize_t write(int *saveErrno);
 
     void Close(void);
     int GetFd(void) const;
+    uint32_t GetGen(void) const { return gen_; }
+    bool IsClose(void) const { return isClose_.load(std::memory_order_acquire); }
+    // 事件循环把连接交给工作线程之前调用
+    void Hold(void) { holders_.fetch_add(1, std::memory_order_relaxed); }
+    // 工作线程交还连接(ModFd之后)或关闭连接之后调用，这是工作线程对连接的最后一次访问
+    void Release(void) { holders_.fetch_sub(1, std::memory_order_release); }
+    bool IsHeld(void) const { return holders_.load(std::memory_order_acquire) != 0; }
     int GetPort(void) const;
 
     const char *GetIP(void) const;
     sockaddr_in GetAddr(void) const;
 
-    bool process(void);
+    /**
+     * @brief 解析读缓冲区中完整的请求
+     *
+     * @return true 解析出一个请求，之后需要调用MakeResponse
+     * @return false 没有数据或请求不完整，继续等待读事件
+     */
+    bool ParseRequest(void);
+    /**
+     * @brief 根据解析结果生成响应，需要时先访问数据库验证表单
+     *
+     * @param code 不为-1时忽略请求，直接返回该状态码，如过载时的503
+     */
+    void MakeResponse(int code = -1);
+    // 响应体由程序生成，如管理接口的输出，body被移走
+    void MakeResponse(int code, const std::string &type, std::string &body);
+    // 解析并生成响应，返回false表示请求还不完整
+    bool process(void)
+    {
+        if (!ParseRequest())
+        {
+            return false;
+        }
+        MakeResponse();
+        return true;
+    }
+    const HttpRequest &GetRequest(void) const { return cold_->request; }
     int ToWriteBytes(void)
     {
         return iov_[0].iov_len + iov_[1].iov_len;
     }
+    // 按响应而不是请求头判断，响应告知客户端关闭(如拒绝请求)时发送完就关闭连接，不再处理后面的请求
     bool IsKeepAlive(void) const
     {
-        return request_.IsKeepAlive();
+        return cold_->response.IsKeepAlive();
+    }
+
+    // 连接的运行状态，供管理接口查看
+    struct Info
+    {
+        int fd;
+        uint32_t gen;
+        sockaddr_in addr;
+        CONN_PHASE phase;
+        // 读缓冲区中未解析的字节数，以及还未发送的响应字节数
+        size_t readBytes;
+        size_t writeBytes;
+        int64_t openMs;
+        int64_t deadlineMs;
+    };
+    /**
+     * @brief 由管理线程在不持有连接的情况下读取，不会打断事件循环和工作线程
+     * 只读取快照、阶段、期限和读缓冲区位置这些原子字段，各字段分别读取，
+     * 连接正在被处理或被复用时字段之间可能不一致，只用于排查问题
+     *
+     */
+    Info GetInfo(void) const;
+
+    CONN_PHASE GetPhase(void) const
+    {
+        return static_cast<CONN_PHASE>(phase_.load(std::memory_order_relaxed));
+    }
+    int64_t GetDeadline(void) const
+    {
+        return deadline_.load(std::memory_order_relaxed);
+    }
+    // 空闲的keep-alive连接收到新数据，开始接收下一个请求头
+    void BeginRequest(void);
+    // 响应发送完毕，写一条访问日志，并开始流水线中下一个请求的计时
+    void FinishRequest(void);
+    // 记录当前请求到达某个追踪阶段的时间，每个阶段只记第一次，请求未被采样时不读取时钟
+    void Trace(RequestTracer::TRACE_STAGE stage)
+    {
+        if (RequestTracer::enabled && cold_->traced && cold_->traceUs[stage] == 0)
+        {
+            cold_->traceUs[stage] = CachedClock::PreciseUs();
+        }
     }
 
     // ET模式？
     static bool isET;
     // resources目录
     static const char *srcDir;
-    // 用户数量
-    static std::atomic<int> userCount;
+    // 各阶段超时设置
+    static TimeoutConfig timeout;
+    // 用户数量，按线程分片计数，避免accept和close所在线程争用同一缓存行
+    static ShardedCounter userCount;
+    // 是否写访问日志
+    static bool accessLog;
+    // 是否录制流量，录制的连接由TrafficCapture采样决定
+    static bool captureTraffic;
 };
 
 #endif
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "httprequest.h"
+#include "../metrics/probes.h"
 using namespace std;
 
+RequestLimitConfig HttpRequest::limits;
+
 HttpRequest::HttpRequest(/* args */)
 {
     Init();
@@ -29,6 +32,7 @@ void HttpRequest::Init(void)
     method_ = path_ = version_ = body_ = "";
     // 默认是请求行状态
     state_ = REQUEST_LINE;
+    verifyTag_ = -1;
     header_.clear();
     post_.clear();
 }
@@ -56,9 +60,18 @@ bool HttpRequest::parse(Buffer &buff)
     {
         return false;
     }
+    USDT_PROBE1(parse_start, buff.ReadableBytes());
     // 从缓存空间中获取数据内容
     while (buff.ReadableBytes() && state_ != FINISH)
     {
+        if (state_ == BODY)
+        {
+            // 请求体按Content-Length截取，之后的数据属于keep-alive连接的下一个请求
+            size_t len = min(buff.ReadableBytes(), ContentLength_());
+            ParseBody_(string(buff.Peek(), len));
+            buff.Retrieve(len);
+            break;
+        }
         // 寻找\r\n的地址，并把地址赋值给缓存区中
         const char *lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
         // line是从每一行首项元素开始到\r\n的字符串
@@ -68,20 +81,21 @@ bool HttpRequest::parse(Buffer &buff)
         case REQUEST_LINE:
             if (!ParseRequestLine_(line))
             {
+                USDT_PROBE3(parse_done, 0, method_.c_str(), path_.c_str());
                 return false;
             }
             ParsePath_();
             break;
         case HEADERS:
-            ParseHeader_(line);
-            if (buff.ReadableBytes() <= 2)
+            if (line.empty())
             {
-                // 请求体没有内容，只有\r\n
-                state_ = FINISH;
+                // 空行结束请求头，没有请求体时请求到此结束
+                state_ = ContentLength_() > 0 ? BODY : FINISH;
+            }
+            else
+            {
+                ParseHeader_(line);
             }
-            break;
-        case BODY:
-            ParseBody_(line);
             break;
         default:
             break;
@@ -94,9 +108,106 @@ bool HttpRequest::parse(Buffer &buff)
         buff.RetrieveUntil(lineEnd + 2);
     }
     LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
+    USDT_PROBE3(parse_done, 1, method_.c_str(), path_.c_str());
+    return true;
+}
+
+HttpRequest::PARSE_STATE HttpRequest::Probe(const Buffer &buff, int &code)
+{
+    const char HEADER_END[] = "\r\n\r\n";
+    const char CONTENT_LENGTH[] = "content-length:";
+    const char *begin = buff.Peek();
+    const char *end = buff.BeginWriteConst();
+    const char *headerEnd = search(begin, end, HEADER_END, HEADER_END + 4);
+    code = 0;
+    // 请求头还没收完就已超过上限时直接拒绝，不再继续接收
+    size_t headerLen = static_cast<size_t>(headerEnd == end ? end - begin : headerEnd + 4 - begin);
+    if (limits.maxHeaderBytes > 0 && headerLen > limits.maxHeaderBytes)
+    {
+        code = 431;
+        return FINISH;
+    }
+    if (headerEnd == end)
+    {
+        return HEADERS;
+    }
+    // 在请求头中查找Content-Length，忽略大小写；有多个时无法确定请求体的边界，按不合法处理
+    size_t contentLen = 0;
+    bool hasLength = false;
+    const size_t keyLen = sizeof(CONTENT_LENGTH) - 1;
+    for (const char *line = begin; line < headerEnd;)
+    {
+        const char *lineEnd = search(line, headerEnd, HEADER_END, HEADER_END + 2);
+        if (static_cast<size_t>(lineEnd - line) >= keyLen &&
+            strncasecmp(line, CONTENT_LENGTH, keyLen) == 0)
+        {
+            if (hasLength || !ParseContentLength_(line + keyLen, lineEnd, contentLen))
+            {
+                code = 400;
+                return FINISH;
+            }
+            hasLength = true;
+        }
+        line = lineEnd + 2;
+    }
+    if (limits.maxBodyBytes > 0 && contentLen > limits.maxBodyBytes)
+    {
+        code = 413;
+        return FINISH;
+    }
+    if (static_cast<size_t>(end - (headerEnd + 4)) < contentLen)
+    {
+        return BODY;
+    }
+    return FINISH;
+}
+
+bool HttpRequest::ParseContentLength_(const char *begin, const char *end, size_t &len)
+{
+    while (begin < end && (*begin == ' ' || *begin == '\t'))
+    {
+        begin++;
+    }
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t'))
+    {
+        end--;
+    }
+    if (begin == end)
+    {
+        return false;
+    }
+    len = 0;
+    for (; begin < end; begin++)
+    {
+        if (*begin < '0' || *begin > '9')
+        {
+            return false;
+        }
+        size_t digit = static_cast<size_t>(*begin - '0');
+        if (len > (SIZE_MAX - digit) / 10)
+        {
+            return false;
+        }
+        len = len * 10 + digit;
+    }
     return true;
 }
 
+size_t HttpRequest::ContentLength_(void) const
+{
+    // 请求先经过Probe检查，到这里最多只有一个合法的Content-Length
+    for (const auto &item : header_)
+    {
+        if (strcasecmp(item.first.c_str(), "Content-Length") == 0)
+        {
+            size_t len = 0;
+            const char *value = item.second.c_str();
+            return ParseContentLength_(value, value + item.second.size(), len) ? len : 0;
+        }
+    }
+    return 0;
+}
+
 void HttpRequest::ParsePath_(void)
 {
     // 添加后缀，默认资源是/index.html
@@ -154,7 +265,6 @@ void HttpRequest::ParseHeader_(const string &line)
 void HttpRequest::ParseBody_(const string &line)
 {
     body_ = line;
-    std::cout << line << std::endl;
     // 获取请求体内容
     ParsePost_();
     state_ = FINISH;
@@ -187,21 +297,40 @@ void HttpRequest::ParsePost_(void)
             LOG_DEBUG("Tag:%d", tag);
             if (tag == 0 || tag == 1)
             {
-                // tag=1表示登录
-                bool isLogin = (tag == 1);
-                if (UserVerify(post_["username"], post_["password"], isLogin))
-                {
-                    path_ = "/welcome.html";
-                }
-                else
-                {
-                    path_ = "/error.html";
-                }
+                // 只记录下来，由Verify访问数据库
+                verifyTag_ = tag;
             }
         }
     }
 }
 
+void HttpRequest::Verify(void)
+{
+    if (verifyTag_ < 0)
+    {
+        return;
+    }
+    // tag=1表示登录
+    bool isLogin = (verifyTag_ == 1);
+    verifyTag_ = -1;
+    int64_t startUs = ServerMetrics::enabled ? CachedClock::PreciseUs() : 0;
+    USDT_PROBE2(verify_start, post_["username"].c_str(), isLogin);
+    bool ok = UserVerify(post_["username"], post_["password"], isLogin);
+    USDT_PROBE2(verify_done, isLogin, ok);
+    if (ServerMetrics::enabled)
+    {
+        ServerMetrics::dbUs.Record(CachedClock::PreciseUs() - startUs);
+    }
+    if (ok)
+    {
+        path_ = "/welcome.html";
+    }
+    else
+    {
+        path_ = "/error.html";
+    }
+}
+
 /*
     编码目的在于让程序能够处理URL中的特殊符号
     https://www.jianshu.com/p/7aa8821c29c1
@@ -269,7 +398,7 @@ bool HttpRequest::UserVerify(const std::string &name, const std::string &pwd, bo
     {
         return false;
     }
-    LOG_INFO("Veriry name:%s pwd:%s", name, pwd);
+    LOG_INFO("Veriry name:%s pwd:%s", name.c_str(), pwd.c_str());
     // 获取空闲sql连接
     MYSQL *sql;
     SqlConnRAII(&sql, SqlConnPool::Instance());
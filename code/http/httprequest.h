@@ -7,12 +7,16 @@
 // 正则表达式头文件
 #include <regex>
 #include <errno.h>
+#include <stdlib.h>
+#include <strings.h>
 #include <mysql/mysql.h>
 
 #include "../log/log.h"
 #include "../buffer/buffer.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/sqlconnRAII.h"
+#include "../metrics/servermetrics.h"
+#include "../config/config.h"
 
 /**
  * @brief 这个类用于处理HTTP请求，并不是说服务器发送一个HTTP请求到另一个服务器
@@ -66,6 +70,18 @@ private:
      */
     void ParseBody_(const std::string &line);
 
+    // 请求头中Content-Length的值，忽略大小写，没有时返回0
+    size_t ContentLength_(void) const;
+    /**
+     * @brief 解析Content-Length的值，Probe和parse共用
+     * 只接受十进制数字，前后可以有空白；负数、其他字符、空值和溢出都不合法
+     *
+     * @param begin 值的起始位置，即冒号之后
+     * @param end 值的结束位置，即行尾
+     * @param len 解析出的长度
+     * @return false 值不合法
+     */
+    static bool ParseContentLength_(const char *begin, const char *end, size_t &len);
     void ParsePath_(void);
     void ParsePost_(void);
     void ParseFromUrlencoded_(void);
@@ -74,6 +90,8 @@ private:
 
     // 用一个状态机来表示HTTP的状态？
     PARSE_STATE state_;
+    // 待验证的表单，0为注册，1为登录，-1表示不需要访问数据库
+    int verifyTag_;
     std::string method_, path_, version_, body_;
     std::unordered_map<std::string, std::string> header_;
     std::unordered_map<std::string, std::string> post_;
@@ -83,6 +101,9 @@ private:
     static int ConvertHex(char ch);
 
 public:
+    // 请求大小的上限，由WebServer在启动时设置
+    static RequestLimitConfig limits;
+
     HttpRequest(/* args */);
     ~HttpRequest() = default;
 
@@ -94,6 +115,16 @@ public:
      * @return true 解析成功；false 解析失败
      */
     bool parse(Buffer &buff);
+    /**
+     * @brief 检查缓冲区中的请求报文是否接收完整，不消耗缓冲区内容
+     * 同时检查请求大小和Content-Length，不合法的请求不必等待接收完整
+     *
+     * @param buff 请求报文内容
+     * @param code 请求不合法时为应返回的状态码：Content-Length不合法或有多个时400，
+     *             请求头超过上限时431，请求体超过上限时413；合法时为0
+     * @return PARSE_STATE 请求头未收完返回HEADERS，请求体未收完返回BODY，完整或不合法返回FINISH
+     */
+    static PARSE_STATE Probe(const Buffer &buff, int &code);
 
     std::string path(void) const;
     std::string &path(void);
@@ -102,6 +133,15 @@ public:
     std::string GetPost(const std::string &key) const;
     std::string GetPost(const char *key) const;
 
+    // 请求是否需要访问数据库，解析之后据此把请求分派到数据库通道
+    bool NeedsVerify(void) const { return verifyTag_ >= 0; }
+    /**
+     * @brief 验证登录、注册表单，并根据结果改写请求路径
+     * 从解析中分离出来，耗时的数据库访问不占用处理静态请求的线程
+     *
+     */
+    void Verify(void);
+
     bool IsKeepAlive(void) const;
 };
 
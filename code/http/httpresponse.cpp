@@ -31,6 +31,9 @@ const std::unordered_map<int, std::string> HttpResponse::CODE_STATUS = {
     {400, "Bad Request"},
     {403, "Forbidden"},
     {404, "Not Found"},
+    {413, "Payload Too Large"},
+    {431, "Request Header Fields Too Large"},
+    {503, "Service Unavailable"},
 };
 
 // 错误code后缀
@@ -41,7 +44,8 @@ const std::unordered_map<int, std::string> HttpResponse::CODE_PATH = {
 };
 
 HttpResponse::HttpResponse(/* args */) : code_(-1), path_(""), srcDir_(""),
-                                         isKeepAlive_(false), mmFile_(nullptr), mmFileStat_({0})
+                                         isKeepAlive_(false), mmFile_(nullptr), mmFileStat_({0}),
+                                         hasContent_(false)
 {
 }
 
@@ -65,25 +69,54 @@ void HttpResponse::Init(const std::string &srcDir, std::string &path,
     srcDir_ = srcDir;
     mmFile_ = nullptr;
     mmFileStat_ = {0};
+    hasContent_ = false;
+    content_.clear();
+}
+
+void HttpResponse::SetContent(const std::string &type, std::string &body)
+{
+    hasContent_ = true;
+    contentType_ = type;
+    content_.swap(body);
 }
 
 void HttpResponse::MakeResponse(Buffer &buff)
 {
-    // 判断请求的资源文件
-    // stat方法获取文件属性，并把属性存到缓存中
-    // S_ISDIR宏判断是否为文件。为目录则返回404错误
-    // st_mode是文件对应模式，用状态码判断是否属于文件或目录
-    if (stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode))
+    if (hasContent_)
     {
-        code_ = 404;
+        AddStateLine_(buff);
+        AddHeader_(buff);
+        buff.Append("Content-length: " + to_string(content_.size()) + "\r\n\r\n");
+        buff.Append(content_);
+        return;
     }
-    else if (!(mmFileStat_.st_mode & S_IROTH))
+    // 服务器自身的错误(如过载时的503)和没有错误页面的拒绝(如请求过大时的413、431)不对应任何文件，直接生成响应体
+    if (IsBareError_())
     {
-        code_ = 403;
+        AddStateLine_(buff);
+        AddHeader_(buff);
+        ErrorContent(buff, CODE_STATUS.find(code_)->second);
+        return;
     }
-    else if (code_ == -1)
+    // 判断请求的资源文件
+    // stat方法获取文件属性，并把属性存到缓存中
+    // S_ISDIR宏判断是否为文件。为目录则返回404错误
+    // st_mode是文件对应模式，用状态码判断是否属于文件或目录
+    // 已经确定的错误(如请求不合法时的400)直接使用错误页面，不再查找请求的资源
+    if (code_ < 400)
     {
-        code_ = 200;
+        if (stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode))
+        {
+            code_ = 404;
+        }
+        else if (!(mmFileStat_.st_mode & S_IROTH))
+        {
+            code_ = 403;
+        }
+        else if (code_ == -1)
+        {
+            code_ = 200;
+        }
     }
 
     ErrorHtml_();
@@ -142,7 +175,16 @@ void HttpResponse::AddHeader_(Buffer &buff)
     {
         buff.Append("close\r\n");
     }
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
+    // Date头直接使用缓存时钟每秒格式化一次的字符串
+    buff.Append("Date: ");
+    buff.Append(CachedClock::Second().httpDate);
+    buff.Append("\r\n");
+    if (hasContent_)
+    {
+        buff.Append("Content-type: " + contentType_ + "\r\n");
+        return;
+    }
+    buff.Append("Content-type: " + (IsBareError_() ? string("text/html") : GetFileType_()) + "\r\n");
 }
 
 /**
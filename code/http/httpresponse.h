@@ -12,6 +12,7 @@
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "../timer/cachedclock.h"
 
 // 和httprequest处理请求报文不同，httpresponse创建响应报文
 
@@ -24,6 +25,8 @@ private:
 
     void ErrorHtml_(void);
     std::string GetFileType_(void);
+    // 没有对应错误页面的错误状态码，响应体由ErrorContent生成
+    bool IsBareError_(void) const { return code_ >= 400 && CODE_PATH.count(code_) == 0; }
 
     int code_;
     bool isKeepAlive_;
@@ -35,6 +38,10 @@ private:
     char *mmFile_;
     // 文件属性
     struct stat mmFileStat_;
+    // 由程序生成的响应体，如管理接口的输出，设置后不再读取文件
+    bool hasContent_;
+    std::string content_;
+    std::string contentType_;
 
     static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
     static const std::unordered_map<int, std::string> CODE_STATUS;
@@ -46,12 +53,16 @@ public:
 
     void Init(const std::string &srcDir, std::string &path,
               bool isKeepAlive = false, int code = -1);
+    // 在Init之后调用，响应体使用body而不是文件，body被移走
+    void SetContent(const std::string &type, std::string &body);
     void MakeResponse(Buffer &buff);
     void UnmapFile(void);
     char *File(void);
     size_t FileLen(void) const;
     void ErrorContent(Buffer &buff, std::string message);
     int Code(void) const { return code_; };
+    // 响应是否保持连接，拒绝请求和解析失败时为false
+    bool IsKeepAlive(void) const { return isKeepAlive_; }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,268 @@
+#include "accesslog.h"
+#include <sys/stat.h>
+
+using namespace std;
+
+const char AccessLog::FILE_MAGIC[8] = {'W', 'S', 'A', 'C', 'C', 'L', '1', '\0'};
+const char *AccessLog::OTHER_PATH = "<other>";
+
+namespace
+{
+    // 线程退出时关闭自己的缓冲区，剩余记录由后台线程写完后释放
+    struct AccessRingHolder
+    {
+        shared_ptr<LogRing> ring;
+        ~AccessRingHolder()
+        {
+            if (ring)
+            {
+                ring->Close();
+            }
+        }
+    };
+    thread_local AccessRingHolder tlsRing;
+}
+
+AccessLog::AccessLog()
+{
+    ringSize_ = 0;
+    flushIntervalMs_ = 1000;
+    isOpen_ = false;
+    ringsVersion_ = 0;
+    closing_ = false;
+    records_ = 0;
+    dropped_ = 0;
+    toDay_ = 0;
+}
+
+AccessLog::~AccessLog()
+{
+    if (writeThread_ && writeThread_->joinable())
+    {
+        closing_.store(true, memory_order_release);
+        readable_.NotifyAll();
+        writeThread_->join();
+    }
+    sink_.Close();
+}
+
+AccessLog *AccessLog::Instance(void)
+{
+    static AccessLog inst;
+    return &inst;
+}
+
+void AccessLog::Init(const char *dir, size_t ringSize, int flushIntervalMs)
+{
+    if (writeThread_)
+    {
+        return;
+    }
+    dir_ = dir;
+    // 一条记录加路径不超过300字节，至少能放下几十条
+    ringSize_ = max(ringSize, static_cast<size_t>(16 * 1024));
+    flushIntervalMs_ = flushIntervalMs > 0 ? flushIntervalMs : 1000;
+    pathIds_.clear();
+    pathIds_[OTHER_PATH] = 0;
+    writeThread_.reset(new thread([this]
+                                  { Run_(); }));
+    isOpen_.store(true, memory_order_release);
+}
+
+LogRing *AccessLog::LocalRing_(void)
+{
+    if (!tlsRing.ring)
+    {
+        tlsRing.ring = make_shared<LogRing>(ringSize_);
+        lock_guard<mutex> locker(ringsMtx_);
+        rings_.push_back(tlsRing.ring);
+        ringsVersion_.fetch_add(1, memory_order_release);
+    }
+    return tlsRing.ring.get();
+}
+
+/**
+ * @brief 把记录和路径拷贝到当前线程的缓冲区
+ * 访问日志不能拖慢请求，缓冲区满时直接丢弃；只有缓冲区已用过半时才唤醒后台线程
+ *
+ */
+void AccessLog::Record(const AccessRecord &record, const char *path, size_t pathLen)
+{
+    if (!IsOpen())
+    {
+        return;
+    }
+    pathLen = min(pathLen, MAX_PATH_LEN);
+    LogRing *ring = LocalRing_();
+    LogRecord *slot = ring->Reserve(static_cast<uint32_t>(sizeof(AccessRecord) + pathLen));
+    if (slot == nullptr)
+    {
+        dropped_.fetch_add(1, memory_order_relaxed);
+        readable_.NotifyOne();
+        return;
+    }
+    AccessRecord *dst = reinterpret_cast<AccessRecord *>(slot->Data());
+    memcpy(dst, &record, sizeof(record));
+    if (dst->timeUs == 0)
+    {
+        dst->timeUs = CachedClock::WallUs();
+    }
+    memcpy(slot->Data() + sizeof(AccessRecord), path, pathLen);
+    slot->timeUs = dst->timeUs;
+    ring->Commit();
+    if (ring->HalfFull())
+    {
+        readable_.NotifyOne();
+    }
+}
+
+void AccessLog::OpenFile_(const struct tm &t)
+{
+    char fileName[256];
+    snprintf(fileName, sizeof(fileName), "%s/%04d_%02d_%02d.access",
+             dir_.c_str(), t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+    if (!sink_.Open(fileName, 0))
+    {
+        mkdir(dir_.c_str(), 0777);
+        sink_.Open(fileName, 0);
+    }
+    if (sink_.IsOpen() && sink_.Size() == 0)
+    {
+        sink_.Append(FILE_MAGIC, sizeof(FILE_MAGIC));
+    }
+    // 新文件中的路径都要重新定义
+    defined_.assign(pathIds_.size(), false);
+    toDay_ = t.tm_mday;
+}
+
+/**
+ * @brief 路径换成编号，不同路径超过MAX_PATHS后都记为OTHER_PATH
+ *
+ */
+uint32_t AccessLog::PathId_(const char *path, size_t pathLen)
+{
+    string key(path, pathLen);
+    auto it = pathIds_.find(key);
+    if (it != pathIds_.end())
+    {
+        return it->second;
+    }
+    if (pathIds_.size() >= MAX_PATHS)
+    {
+        return 0;
+    }
+    uint32_t id = static_cast<uint32_t>(pathIds_.size());
+    pathIds_.emplace(move(key), id);
+    return id;
+}
+
+void AccessLog::WriteRecord_(const AccessRecord &record, const char *path, size_t pathLen)
+{
+    // 同一秒内的记录共用一次localtime_r的结果
+    static int64_t lastSec = -1;
+    static struct tm t;
+    int64_t sec = record.timeUs / 1000000;
+    if (sec != lastSec)
+    {
+        time_t now = static_cast<time_t>(sec);
+        localtime_r(&now, &t);
+        lastSec = sec;
+    }
+    if (!sink_.IsOpen() || toDay_ != t.tm_mday)
+    {
+        OpenFile_(t);
+    }
+
+    uint32_t id = PathId_(path, pathLen);
+    if (id >= defined_.size())
+    {
+        defined_.resize(id + 1, false);
+    }
+    if (!defined_[id])
+    {
+        const char *name = id == 0 ? OTHER_PATH : path;
+        uint16_t len = static_cast<uint16_t>(id == 0 ? strlen(OTHER_PATH) : pathLen);
+        char type = ENTRY_PATH;
+        sink_.Append(&type, 1);
+        sink_.Append(&id, sizeof(id));
+        sink_.Append(&len, sizeof(len));
+        sink_.Append(name, len);
+        defined_[id] = true;
+    }
+    AccessRecord out = record;
+    out.pathId = id;
+    char type = ENTRY_ACCESS;
+    sink_.Append(&type, 1);
+    sink_.Append(&out, sizeof(out));
+}
+
+size_t AccessLog::Drain_(const vector<shared_ptr<LogRing>> &rings)
+{
+    size_t count = 0;
+    for (const auto &ring : rings)
+    {
+        const LogRecord *slot;
+        while ((slot = ring->Front()) != nullptr)
+        {
+            AccessRecord record;
+            memcpy(&record, slot->Data(), sizeof(record));
+            WriteRecord_(record, slot->Data() + sizeof(AccessRecord), slot->len - sizeof(AccessRecord));
+            ring->Pop();
+            count++;
+        }
+    }
+    records_.fetch_add(count, memory_order_relaxed);
+    return count;
+}
+
+void AccessLog::Run_(void)
+{
+    vector<shared_ptr<LogRing>> rings;
+    uint64_t version = 0;
+    while (true)
+    {
+        bool closing = closing_.load(memory_order_acquire);
+        if (ringsVersion_.load(memory_order_acquire) != version)
+        {
+            lock_guard<mutex> locker(ringsMtx_);
+            // 顺带移除所属线程已退出且已取空的缓冲区
+            for (auto it = rings_.begin(); it != rings_.end();)
+            {
+                if ((*it)->IsClosed() && (*it)->Empty())
+                {
+                    it = rings_.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            rings = rings_;
+            version = ringsVersion_.load(memory_order_relaxed);
+        }
+        Drain_(rings);
+        // 访问日志按周期成批写入，每个周期最多一次writev
+        sink_.Flush();
+        if (closing)
+        {
+            break;
+        }
+
+        uint32_t key = readable_.PrepareWait();
+        if (closing_.load(memory_order_acquire))
+        {
+            readable_.CancelWait();
+            continue;
+        }
+        readable_.Wait(key, flushIntervalMs_);
+        // 所属线程已退出的缓冲区在下一轮取空后移除
+        for (size_t i = 0; i < rings.size(); i++)
+        {
+            if (rings[i]->IsClosed())
+            {
+                ringsVersion_.fetch_add(1, memory_order_release);
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,164 @@
+/**
+ * @file accesslog.h
+ * @brief 结构化访问日志，每个请求一条定长二进制记录，由后台线程批量写入文件
+ *
+ */
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "logring.h"
+#include "logsink.h"
+#include "../pool/mpmcqueue.h"
+#include "../timer/cachedclock.h"
+
+/**
+ * @brief 一个请求的访问记录，定长，本机字节序
+ *
+ */
+struct AccessRecord
+{
+    // 响应发送完成时的墙上时间，单位us
+    int64_t timeUs;
+    // 对端地址，IP为网络字节序，端口为主机字节序
+    uint32_t peerIp;
+    uint16_t peerPort;
+    uint16_t status;
+    // 路径编号，对应文件中的ENTRY_PATH定义
+    uint32_t pathId;
+    uint8_t method;
+    uint8_t keepAlive;
+    uint16_t reserved;
+    // 响应的总字节数，包括响应头和文件
+    uint64_t bytes;
+    // 各阶段耗时，单位us
+    // 接收：从开始接收请求到解析完成
+    uint32_t recvUs;
+    // 排队：从解析完成到开始生成响应，包括等待执行通道
+    uint32_t queueUs;
+    // 处理：生成响应，包括访问数据库
+    uint32_t handleUs;
+    // 发送：从生成响应到发送完成
+    uint32_t sendUs;
+};
+
+/**
+ * @brief 访问日志
+ * 工作线程把记录和路径写入本线程的环形缓冲区，不加锁；缓冲区满时丢弃并计数，不阻塞请求
+ * 后台线程取出记录，把路径换成编号后写入文件，每天一个文件
+ *
+ * 文件格式：以FILE_MAGIC开头，之后每条以一个字节的类型开始
+ *   ENTRY_PATH：  u32编号, u16长度, 路径      每个文件中第一次用到某个编号前写入
+ *   ENTRY_ACCESS：AccessRecord
+ *
+ */
+class AccessLog
+{
+public:
+    static const char FILE_MAGIC[8];
+
+    enum ENTRY_TYPE
+    {
+        ENTRY_PATH = 'P',
+        ENTRY_ACCESS = 'A',
+    };
+
+    enum ACCESS_METHOD
+    {
+        METHOD_OTHER = 0,
+        METHOD_GET,
+        METHOD_POST,
+        METHOD_HEAD,
+        METHOD_PUT,
+        METHOD_DELETE,
+        METHOD_COUNT,
+    };
+
+    // 路径超长时截断
+    static const size_t MAX_PATH_LEN = 255;
+    // 不同路径数量的上限，超出后都记为编号0，即OTHER_PATH
+    static const uint32_t MAX_PATHS = 65536;
+    static const char *OTHER_PATH;
+
+    static AccessLog *Instance(void);
+
+    /**
+     * @brief 打开访问日志并启动后台线程，只能调用一次
+     *
+     * @param dir 日志目录
+     * @param ringSize 每个线程的缓冲区大小，单位字节
+     * @param flushIntervalMs 后台线程取记录、刷新文件的周期
+     */
+    void Init(const char *dir, size_t ringSize, int flushIntervalMs = 1000);
+    bool IsOpen(void) const { return isOpen_.load(std::memory_order_relaxed); }
+
+    // 记录一个请求，timeUs为0时使用当前时间
+    void Record(const AccessRecord &record, const char *path, size_t pathLen);
+
+    uint64_t Records(void) const { return records_.load(std::memory_order_relaxed); }
+    uint64_t Dropped(void) const { return dropped_.load(std::memory_order_relaxed); }
+
+    // 单调时钟，单位us，用于计算各阶段耗时
+    static int64_t NowUs(void) { return CachedClock::PreciseUs(); }
+
+    static uint8_t MethodId(const std::string &method)
+    {
+        for (int i = METHOD_GET; i < METHOD_COUNT; i++)
+        {
+            if (method == MethodName(i))
+            {
+                return static_cast<uint8_t>(i);
+            }
+        }
+        return METHOD_OTHER;
+    }
+    static const char *MethodName(int method)
+    {
+        static const char *const NAMES[METHOD_COUNT] = {"OTHER", "GET", "POST", "HEAD", "PUT", "DELETE"};
+        return method >= 0 && method < METHOD_COUNT ? NAMES[method] : NAMES[METHOD_OTHER];
+    }
+
+private:
+    AccessLog();
+    ~AccessLog();
+
+    LogRing *LocalRing_(void);
+    void Run_(void);
+    size_t Drain_(const std::vector<std::shared_ptr<LogRing>> &rings);
+    void WriteRecord_(const AccessRecord &record, const char *path, size_t pathLen);
+    uint32_t PathId_(const char *path, size_t pathLen);
+    void OpenFile_(const struct tm &t);
+
+    std::string dir_;
+    size_t ringSize_;
+    int flushIntervalMs_;
+    std::atomic<bool> isOpen_;
+
+    std::mutex ringsMtx_;
+    std::vector<std::shared_ptr<LogRing>> rings_;
+    std::atomic<uint64_t> ringsVersion_;
+    EventCount readable_;
+    std::atomic<bool> closing_;
+    std::atomic<uint64_t> records_;
+    std::atomic<uint64_t> dropped_;
+    std::unique_ptr<std::thread> writeThread_;
+
+    /* 以下只由后台线程访问 */
+    LogSink sink_;
+    int toDay_;
+    // 路径到编号，编号0保留给OTHER_PATH
+    std::unordered_map<std::string, uint32_t> pathIds_;
+    // 当前文件中已经写入定义的路径编号
+    std::vector<bool> defined_;
+};
+
+#endif
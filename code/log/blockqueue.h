@@ -20,6 +20,7 @@
 #include <sys/time.h>
 
 #include <chrono>
+#include "../metrics/lockstats.h"
 
 template <class T>
 class BlockDeque
@@ -29,12 +30,12 @@ private:
     std::deque<T> deq_;
     // 队列容纳能力
     size_t capacity_;
-    std::mutex mtx_;
+    ProfiledMutex mtx_;
     bool isClose_;
 
-    // 生产者消费者模型
-    std::condition_variable condConsumer_;
-    std::condition_variable condProducer_;
+    // 生产者消费者模型，condition_variable_any可以配合ProfiledMutex使用
+    std::condition_variable_any condConsumer_;
+    std::condition_variable_any condProducer_;
 
 public:
     // explicit为显示构造函数
@@ -60,7 +61,7 @@ public:
 };
 
 template <class T>
-BlockDeque<T>::BlockDeque(size_t maxCapacity) : capacity_(maxCapacity)
+BlockDeque<T>::BlockDeque(size_t maxCapacity) : capacity_(maxCapacity), mtx_("blockdeque")
 {
     assert(maxCapacity > 0);
     isClose_ = false;
@@ -77,7 +78,7 @@ template <class T>
 void BlockDeque<T>::Close(void)
 {
     {
-        std::lock_guard<std::mutex> locker(mtx_);
+        std::lock_guard<ProfiledMutex> locker(mtx_);
         deq_.clear();
         isClose_ = true;
     }
@@ -95,56 +96,56 @@ void BlockDeque<T>::flush(void)
 template <class T>
 void BlockDeque<T>::clear(void)
 {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<ProfiledMutex> locker(mtx_);
     deq_.clear();
 }
 
 template <class T>
 T BlockDeque<T>::front(void)
 {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<ProfiledMutex> locker(mtx_);
     return deq_.front();
 }
 
 template <class T>
 T BlockDeque<T>::back(void)
 {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<ProfiledMutex> locker(mtx_);
     return deq_.back();
 }
 
 template <class T>
 size_t BlockDeque<T>::size(void)
 {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<ProfiledMutex> locker(mtx_);
     return deq_.size();
 }
 
 template <class T>
 size_t BlockDeque<T>::capacity(void)
 {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<ProfiledMutex> locker(mtx_);
     return capacity_;
 }
 
 template <class T>
 bool BlockDeque<T>::full(void)
 {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<ProfiledMutex> locker(mtx_);
     return deq_.size() >= capacity_;
 }
 
 template <class T>
 bool BlockDeque<T>::empty(void)
 {
-    std::lock_guard<std::mutex> locker(mtx_);
+    std::lock_guard<ProfiledMutex> locker(mtx_);
     return deq_.empty();
 }
 
 template <class T>
 void BlockDeque<T>::push_back(const T &item)
 {
-    std::unique_lock<std::mutex> locker(mtx_);
+    std::unique_lock<ProfiledMutex> locker(mtx_);
     while (deq_.size() >= capacity_)
     {
         condProducer_.wait(locker);
@@ -156,7 +157,7 @@ void BlockDeque<T>::push_back(const T &item)
 template <class T>
 void BlockDeque<T>::push_front(const T &item)
 {
-    std::unique_lock<std::mutex> locker(mtx_);
+    std::unique_lock<ProfiledMutex> locker(mtx_);
     while (deq_.size() >= capacity_)
     {
         condProducer_.wait(locker);
@@ -168,7 +169,7 @@ void BlockDeque<T>::push_front(const T &item)
 template <class T>
 bool BlockDeque<T>::pop(T &item)
 {
-    std::unique_lock<std::mutex> locker(mtx_);
+    std::unique_lock<ProfiledMutex> locker(mtx_);
     // 空队列等待
     while (deq_.empty())
     {
@@ -188,7 +189,7 @@ bool BlockDeque<T>::pop(T &item)
 template <class T>
 bool BlockDeque<T>::pop(T &item, int timeOut)
 {
-    std::unique_lock<std::mutex> locker(mtx_);
+    std::unique_lock<ProfiledMutex> locker(mtx_);
     while (deq_.empty())
     {
         if (condConsumer_.wait_for(locker, std::chrono::seconds(timeOut)) ==
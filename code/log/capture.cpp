@@ -0,0 +1,277 @@
+#include "capture.h"
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+const char TrafficCapture::FILE_MAGIC[8] = {'W', 'S', 'C', 'A', 'P', 'T', '1', '\0'};
+
+namespace
+{
+    // 线程退出时关闭自己的缓冲区，剩余记录由后台线程写完后释放
+    struct CaptureRingHolder
+    {
+        shared_ptr<LogRing> ring;
+        ~CaptureRingHolder()
+        {
+            if (ring)
+            {
+                ring->Close();
+            }
+        }
+    };
+    thread_local CaptureRingHolder tlsRing;
+}
+
+TrafficCapture::TrafficCapture()
+{
+    ringSize_ = 0;
+    maxChunk_ = 0;
+    threshold_ = 0;
+    maxBytes_ = 0;
+    flushIntervalMs_ = 1000;
+    isOpen_ = false;
+    full_ = false;
+    ringsVersion_ = 0;
+    closing_ = false;
+    nextId_ = 1;
+    conns_ = 0;
+    bytes_ = 0;
+    dropped_ = 0;
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    if (writeThread_ && writeThread_->joinable())
+    {
+        closing_.store(true, memory_order_release);
+        readable_.NotifyAll();
+        writeThread_->join();
+    }
+    sink_.Close();
+}
+
+TrafficCapture *TrafficCapture::Instance(void)
+{
+    static TrafficCapture inst;
+    return &inst;
+}
+
+void TrafficCapture::Init(const char *dir, size_t ringSize, double sampleRate, uint64_t maxBytes, int flushIntervalMs)
+{
+    if (writeThread_)
+    {
+        return;
+    }
+    ringSize_ = max(ringSize, static_cast<size_t>(64 * 1024));
+    // LogRing单条记录不能超过容量的一半，再留出余量让一次读到的数据拆成的几条不至于立刻占满
+    maxChunk_ = ringSize_ / 8;
+    sampleRate = min(max(sampleRate, 0.0), 1.0);
+    threshold_ = static_cast<uint64_t>(sampleRate * 4294967296.0);
+    maxBytes_ = maxBytes;
+    flushIntervalMs_ = flushIntervalMs > 0 ? flushIntervalMs : 1000;
+
+    time_t now = time(nullptr);
+    struct tm t;
+    localtime_r(&now, &t);
+    char fileName[256];
+    snprintf(fileName, sizeof(fileName), "%s/capture_%04d%02d%02d_%02d%02d%02d.cap", dir,
+             t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+    path_ = fileName;
+    // 录制文件包含请求内容，创建时就只允许属主读写；O_EXCL保证是自己新建的文件，
+    // 不会沿用别人预先建好(权限更宽或指向其他位置的链接)的同名文件，打不开时不录制
+    if (!sink_.Open(fileName, 0, O_EXCL, 0600))
+    {
+        if (errno != ENOENT)
+        {
+            return;
+        }
+        mkdir(dir, 0777);
+        if (!sink_.Open(fileName, 0, O_EXCL, 0600))
+        {
+            return;
+        }
+    }
+    sink_.Append(FILE_MAGIC, sizeof(FILE_MAGIC));
+    writeThread_.reset(new thread([this]
+                                  { Run_(); }));
+    isOpen_.store(true, memory_order_release);
+}
+
+LogRing *TrafficCapture::LocalRing_(void)
+{
+    if (!tlsRing.ring)
+    {
+        tlsRing.ring = make_shared<LogRing>(ringSize_);
+        lock_guard<mutex> locker(ringsMtx_);
+        rings_.push_back(tlsRing.ring);
+        ringsVersion_.fetch_add(1, memory_order_release);
+    }
+    return tlsRing.ring.get();
+}
+
+bool TrafficCapture::Put_(uint8_t type, uint64_t connId, uint64_t offset, const char *data, uint32_t len)
+{
+    LogRing *ring = LocalRing_();
+    LogRecord *slot = ring->Reserve(static_cast<uint32_t>(sizeof(CaptureRecord) + len));
+    if (slot == nullptr)
+    {
+        dropped_.fetch_add(1, memory_order_relaxed);
+        readable_.NotifyOne();
+        return false;
+    }
+    CaptureRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timeUs = CachedClock::PreciseUs();
+    record.connId = connId;
+    record.offset = offset;
+    record.len = len;
+    record.type = type;
+    memcpy(slot->Data(), &record, sizeof(record));
+    if (len > 0)
+    {
+        memcpy(slot->Data() + sizeof(CaptureRecord), data, len);
+    }
+    slot->timeUs = record.timeUs;
+    ring->Commit();
+    if (ring->HalfFull())
+    {
+        readable_.NotifyOne();
+    }
+    return true;
+}
+
+uint64_t TrafficCapture::Open(void)
+{
+    if (!IsOpen() || full_.load(memory_order_relaxed))
+    {
+        return 0;
+    }
+    // xorshift64，每个线程独立的随机数序列
+    thread_local uint64_t seed = reinterpret_cast<uintptr_t>(&seed) * 0x9E3779B97F4A7C15ull | 1;
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    if ((seed >> 32) >= threshold_)
+    {
+        return 0;
+    }
+    uint64_t id = nextId_.fetch_add(1, memory_order_relaxed);
+    if (!Put_(ENTRY_OPEN, id, 0, nullptr, 0))
+    {
+        return 0;
+    }
+    conns_.fetch_add(1, memory_order_relaxed);
+    return id;
+}
+
+bool TrafficCapture::Data(uint64_t connId, uint64_t &offset, const char *data, size_t len)
+{
+    if (full_.load(memory_order_relaxed))
+    {
+        return false;
+    }
+    while (len > 0)
+    {
+        uint32_t chunk = static_cast<uint32_t>(min(len, maxChunk_));
+        if (!Put_(ENTRY_DATA, connId, offset, data, chunk))
+        {
+            return false;
+        }
+        offset += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+void TrafficCapture::Close(uint64_t connId, uint64_t offset)
+{
+    if (!full_.load(memory_order_relaxed))
+    {
+        Put_(ENTRY_CLOSE, connId, offset, nullptr, 0);
+    }
+}
+
+/**
+ * @brief 取出各线程的记录写入文件，达到大小上限后丢弃其余记录
+ *
+ */
+void TrafficCapture::Drain_(const vector<shared_ptr<LogRing>> &rings)
+{
+    uint64_t bytes = 0;
+    for (const auto &ring : rings)
+    {
+        const LogRecord *slot;
+        while ((slot = ring->Front()) != nullptr)
+        {
+            if (maxBytes_ > 0 && sink_.Size() >= maxBytes_)
+            {
+                full_.store(true, memory_order_relaxed);
+            }
+            if (!full_.load(memory_order_relaxed))
+            {
+                char type = reinterpret_cast<const CaptureRecord *>(slot->Data())->type;
+                sink_.Append(&type, 1);
+                sink_.Append(slot->Data(), slot->len);
+                bytes += slot->len - sizeof(CaptureRecord);
+            }
+            ring->Pop();
+        }
+    }
+    bytes_.fetch_add(bytes, memory_order_relaxed);
+}
+
+void TrafficCapture::Run_(void)
+{
+    vector<shared_ptr<LogRing>> rings;
+    uint64_t version = 0;
+    while (true)
+    {
+        bool closing = closing_.load(memory_order_acquire);
+        if (ringsVersion_.load(memory_order_acquire) != version)
+        {
+            lock_guard<mutex> locker(ringsMtx_);
+            // 顺带移除所属线程已退出且已取空的缓冲区
+            for (auto it = rings_.begin(); it != rings_.end();)
+            {
+                if ((*it)->IsClosed() && (*it)->Empty())
+                {
+                    it = rings_.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            rings = rings_;
+            version = ringsVersion_.load(memory_order_relaxed);
+        }
+        Drain_(rings);
+        sink_.Flush();
+        if (closing)
+        {
+            break;
+        }
+
+        uint32_t key = readable_.PrepareWait();
+        if (closing_.load(memory_order_acquire))
+        {
+            readable_.CancelWait();
+            continue;
+        }
+        readable_.Wait(key, flushIntervalMs_);
+        // 所属线程已退出的缓冲区在下一轮取空后移除
+        for (size_t i = 0; i < rings.size(); i++)
+        {
+            if (rings[i]->IsClosed())
+            {
+                ringsVersion_.fetch_add(1, memory_order_release);
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,134 @@
+/**
+ * @file capture.h
+ * @brief 流量录制，按连接采样记录收到的原始请求字节和到达时间，供bench/replay回放
+ *
+ */
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include "logring.h"
+#include "logsink.h"
+#include "../pool/mpmcqueue.h"
+#include "../timer/cachedclock.h"
+
+/**
+ * @brief 录制文件中一条记录的头部，定长，本机字节序，ENTRY_DATA后面紧跟len字节的数据
+ *
+ */
+struct CaptureRecord
+{
+    // 单调时钟，单位us，回放时只用差值
+    int64_t timeUs;
+    // 连接编号，从1开始，同一个fd上先后的连接编号不同
+    uint64_t connId;
+    // 数据在连接中的偏移，回放工具据此发现被丢弃的数据
+    uint64_t offset;
+    uint32_t len;
+    uint8_t type;
+    uint8_t reserved[3];
+};
+
+/**
+ * @brief 流量录制
+ * 新连接按采样率决定是否录制，录制的连接每次读到数据都拷贝到本线程的环形缓冲区，不加锁；
+ * 缓冲区满时丢弃并计数，该连接之后不再录制，不阻塞请求
+ * 后台线程把各线程的记录写入一个文件，文件达到上限后停止录制
+ * 各线程的记录不按时间合并，同一连接的记录可能乱序，回放工具按偏移和时间重新排列
+ *
+ * 文件格式：以FILE_MAGIC开头，之后每条为一个字节的类型加CaptureRecord
+ *   ENTRY_OPEN：  新连接，len为0
+ *   ENTRY_DATA：  收到的数据，CaptureRecord后面是len字节的数据
+ *   ENTRY_CLOSE： 连接关闭，len为0，offset为收到的总字节数
+ *
+ * 录制文件包含请求的原始内容(如登录表单中的密码)，只应在测试环境中开启
+ *
+ */
+class TrafficCapture
+{
+public:
+    static const char FILE_MAGIC[8];
+
+    enum ENTRY_TYPE
+    {
+        ENTRY_OPEN = 'O',
+        ENTRY_DATA = 'D',
+        ENTRY_CLOSE = 'C',
+    };
+
+    static TrafficCapture *Instance(void);
+
+    /**
+     * @brief 创建录制文件并启动后台线程，只能调用一次
+     *
+     * @param dir 文件目录，文件名带启动时间，如capture_20220312_100000.cap
+     * @param ringSize 每个线程的缓冲区大小，单位字节
+     * @param sampleRate 录制的连接比例，1表示全部
+     * @param maxBytes 文件大小上限，达到后停止录制
+     * @param flushIntervalMs 后台线程取记录、刷新文件的周期
+     */
+    void Init(const char *dir, size_t ringSize, double sampleRate, uint64_t maxBytes, int flushIntervalMs = 1000);
+    bool IsOpen(void) const { return isOpen_.load(std::memory_order_relaxed); }
+    // 录制文件路径，打开失败时为尝试创建的路径
+    const std::string &Path(void) const { return path_; }
+
+    // 新连接，决定是否录制；录制时返回连接编号，否则返回0
+    uint64_t Open(void);
+    /**
+     * @brief 记录连接收到的数据，超过缓冲区允许的长度时拆成多条
+     *
+     * @param connId Open返回的编号
+     * @param offset 数据在连接中的偏移，成功后增加len
+     * @return false 缓冲区满被丢弃，调用者应停止录制该连接
+     */
+    bool Data(uint64_t connId, uint64_t &offset, const char *data, size_t len);
+    void Close(uint64_t connId, uint64_t offset);
+
+    uint64_t Connections(void) const { return conns_.load(std::memory_order_relaxed); }
+    uint64_t Bytes(void) const { return bytes_.load(std::memory_order_relaxed); }
+    uint64_t Dropped(void) const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    TrafficCapture();
+    ~TrafficCapture();
+
+    LogRing *LocalRing_(void);
+    bool Put_(uint8_t type, uint64_t connId, uint64_t offset, const char *data, uint32_t len);
+    void Run_(void);
+    void Drain_(const std::vector<std::shared_ptr<LogRing>> &rings);
+
+    std::string path_;
+    size_t ringSize_;
+    // 单条记录数据的上限，保证能放进缓冲区
+    size_t maxChunk_;
+    // 采样阈值，随机数的高32位小于它时录制
+    uint64_t threshold_;
+    uint64_t maxBytes_;
+    int flushIntervalMs_;
+    std::atomic<bool> isOpen_;
+    // 文件达到上限后置位，不再接受新连接
+    std::atomic<bool> full_;
+
+    std::mutex ringsMtx_;
+    std::vector<std::shared_ptr<LogRing>> rings_;
+    std::atomic<uint64_t> ringsVersion_;
+    EventCount readable_;
+    std::atomic<bool> closing_;
+    std::atomic<uint64_t> nextId_;
+    std::atomic<uint64_t> conns_;
+    std::atomic<uint64_t> bytes_;
+    std::atomic<uint64_t> dropped_;
+    std::unique_ptr<std::thread> writeThread_;
+
+    /* 以下只由后台线程访问 */
+    LogSink sink_;
+};
+
+#endif
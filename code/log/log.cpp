@@ -1,67 +1,133 @@
 #include "log.h"
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char **environ;
 
 using namespace std;
-Log::Log(/* args */)
+
+namespace
+{
+    // 线程退出时关闭自己的缓冲区，剩余日志由后台线程写完后释放
+    struct RingHolder
+    {
+        shared_ptr<LogRing> ring;
+        ~RingHolder()
+        {
+            if (ring)
+            {
+                ring->Close();
+            }
+        }
+    };
+    thread_local RingHolder tlsRing;
+
+    // 采样率换算成32位随机数的阈值
+    uint64_t SampleThreshold(double rate)
+    {
+        if (!(rate < 1.0))
+        {
+            return 1ull << 32;
+        }
+        return rate > 0 ? static_cast<uint64_t>(rate * (1ull << 32)) : 0;
+    }
+}
+
+Log::Log(/* args */) : mtx_("log"), ringsMtx_("log.rings")
 {
     lineCount_ = 0;
     isAsync_ = false;
     writeThread_ = 0;
-    deque_ = nullptr;
     toDay_ = 0;
-    fp_ = nullptr;
+    fileName_[0] = '\0';
+    ringSize_ = 0;
+    overflow_ = QUEUE_BLOCK;
+    deferred_ = false;
+    binary_ = false;
+    isOpen_ = false;
+    level_ = 1;
+    flushIntervalMs_ = 1000;
+    flushBytes_ = 256 * 1024;
+    flushLevel_ = 3;
+    lastFlushMs_ = 0;
+    preallocBytes_ = 0;
+    compress_ = false;
+    lines_ = 0;
+    bytes_ = 0;
+    rotations_ = 0;
+    linesPerSec_ = 0;
+    bytesPerSec_ = 0;
+    rateMs_ = 0;
+    rateLines_ = 0;
+    rateBytes_ = 0;
+    flushRequested_ = false;
+    ringsVersion_ = 0;
+    closing_ = false;
+    siteRateLimit_ = 0;
+    sampleThreshold_[0] = SAMPLE_ALL;
+    sampleThreshold_[1] = SAMPLE_ALL;
+    dropSummaryMs_ = 10000;
+    lastSummaryMs_ = 0;
+    reportedFull_ = 0;
+    reportedLimited_ = 0;
+    reportedSampled_ = 0;
 }
 
 Log::~Log()
 {
     if (writeThread_ && writeThread_->joinable())
     {
-        while (!deque_->empty())
-        {
-            // 双向队列不为空，先清空双向队列
-            deque_->flush();
-        }
-        // ?为什么要关闭双向队列，然后还调用线程的join方法?
-        deque_->Close();
+        // 后台线程把所有缓冲区中剩余的日志写完才会退出
+        closing_.store(true, memory_order_release);
+        readable_.NotifyAll();
         writeThread_->join();
     }
-    if (fp_)
+    // 上锁，防止其他线程占用、修改sink_
+    lock_guard<ProfiledMutex> locker(mtx_);
+    if (sink_.IsOpen())
     {
-        // 上锁，防止其他线程占用、修改fp_
-        lock_guard<mutex> locker(mtx_);
-        flush();
-        fclose(fp_);
+        bytes_.fetch_add(sink_.Flush(), memory_order_relaxed);
+        sink_.Close();
     }
-}
-
-int Log::GetLevel(void)
-{
-    lock_guard<mutex> locker(mtx_);
-    return level_;
-}
-void Log::SetLevel(int level)
-{
-    lock_guard<mutex> locker(mtx_);
-    level_ = level;
+    ReapCompressors_();
 }
 
 void Log::init(int level, const char *path,
-               const char *suffix, int maxQueueCapacity)
+               const char *suffix, int maxQueueCapacity, OVERFLOW_POLICY overflow,
+               const LogConfig &config)
 {
-    isOpen_ = true;
     level_ = level;
+    flushIntervalMs_ = config.flushIntervalMs > 0 ? config.flushIntervalMs : 1000;
+    flushBytes_ = config.flushBytes > 0 ? config.flushBytes : 0;
+    flushLevel_ = config.flushLevel;
+    preallocBytes_ = config.preallocBytes > 0 ? config.preallocBytes : 0;
+    compress_ = config.compress;
+    siteRateLimit_ = config.siteRateLimit > 0 ? config.siteRateLimit : 0;
+    if (siteRateLimit_ > 0 && !sites_)
+    {
+        sites_.reset(new SiteWindow[LogFormat::MAX_FORMATS]);
+        for (uint32_t i = 0; i < LogFormat::MAX_FORMATS; i++)
+        {
+            sites_[i].second.store(0, memory_order_relaxed);
+            sites_[i].count.store(0, memory_order_relaxed);
+        }
+    }
+    sampleThreshold_[0] = SampleThreshold(config.debugSample);
+    sampleThreshold_[1] = SampleThreshold(config.infoSample);
+    dropSummaryMs_ = config.dropSummaryMs;
 
     if (maxQueueCapacity > 0)
     {
         // 异步
         isAsync_ = true;
-        if (!deque_)
+        if (!writeThread_)
         {
-            // deque_ = unique_ptr<BlockDeque<string>>(new BlockDeque<string>);
-            // writeThread_ = unique_ptr<thread>(new thread(Log::FlushLogThread));
-
-            unique_ptr<BlockDeque<string>> newDeque(new BlockDeque<string>);
-            deque_ = move(newDeque);
-
+            // 按每行约256字节估算，至少能放下几行最长的日志
+            ringSize_ = max(static_cast<size_t>(maxQueueCapacity) * 256,
+                            static_cast<size_t>(4 * LINE_MAX_LEN));
+            overflow_ = overflow;
+            binary_ = config.binary;
+            deferred_ = config.deferred || config.binary;
             unique_ptr<thread> newThread(new thread(Log::FlushLogThread));
             writeThread_ = move(newThread);
         }
@@ -86,132 +152,570 @@ void Log::init(int level, const char *path,
     toDay_ = t.tm_mday;
 
     {
-        lock_guard<mutex> locker(mtx_);
-        // 将buff_变成readable空间
-        buff_.RetrieveAll();
-
-        if (fp_)
+        lock_guard<ProfiledMutex> locker(mtx_);
+        if (sink_.IsOpen())
         {
-            flush();
-            fclose(fp_);
+            bytes_.fetch_add(sink_.Flush(), memory_order_relaxed);
+            sink_.Close();
         }
+        mkdir(path_, 0777);
+        OpenFile_(fileName);
+        lastFlushMs_ = NowMs_();
+        rateMs_ = lastFlushMs_;
+        lastSummaryMs_ = lastFlushMs_;
+    }
+    // 文件打开后才允许写日志
+    isOpen_ = true;
+}
 
-        fp_ = fopen(fileName, "a");
-        if (fp_ == nullptr)
-        {
-            mkdir(path_, 0777);
-            fp_ = fopen(fileName, "a");
-        }
-        assert(fp_ != nullptr);
+int64_t Log::NowMs_(void)
+{
+    // 精度一个时钟节拍即可，COARSE时钟读取不进入内核
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 按刷新策略刷新文件缓冲区，调用时需持有mtx_
+ *
+ * @param urgent 刚写入了等级不低于flushLevel的日志，或被要求立即刷新
+ */
+void Log::FlushIfNeeded_(bool urgent)
+{
+    int64_t now = NowMs_();
+    ReportDropped_(now);
+    if (sink_.Buffered() > 0 &&
+        (urgent || sink_.Buffered() >= flushBytes_ || now - lastFlushMs_ >= flushIntervalMs_))
+    {
+        bytes_.fetch_add(sink_.Flush(), memory_order_relaxed);
+        lastFlushMs_ = now;
     }
+    UpdateRate_(now);
 }
 
-void Log::write(int level, const char *format, ...)
+// 每秒根据累计值计算一次速率，调用时需持有mtx_
+void Log::UpdateRate_(int64_t nowMs)
 {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, nullptr);
-    time_t tSec = now.tv_sec;
-    struct tm *sysTime = localtime(&tSec);
-    struct tm t = *sysTime;
-    va_list vaList;
+    int64_t elapsed = nowMs - rateMs_;
+    if (elapsed < 1000)
+    {
+        return;
+    }
+    uint64_t lines = lines_.load(memory_order_relaxed);
+    uint64_t bytes = bytes_.load(memory_order_relaxed);
+    linesPerSec_.store((lines - rateLines_) * 1000 / elapsed, memory_order_relaxed);
+    bytesPerSec_.store((bytes - rateBytes_) * 1000 / elapsed, memory_order_relaxed);
+    rateMs_ = nowMs;
+    rateLines_ = lines;
+    rateBytes_ = bytes;
+}
 
-    /* 日志日期 日志行数 */
-    if (toDay_ != t.tm_mday || (lineCount_ && (lineCount_ % MAX_LINES == 0)))
+Log::Stats Log::GetStats(void) const
+{
+    Stats stats;
+    stats.lines = lines_.load(memory_order_relaxed);
+    stats.bytes = bytes_.load(memory_order_relaxed);
+    stats.dropped = static_cast<uint64_t>(dropped_.Load());
+    stats.rateLimited = static_cast<uint64_t>(rateLimited_.Load());
+    stats.sampled = static_cast<uint64_t>(sampled_.Load());
+    stats.rotations = rotations_.load(memory_order_relaxed);
+    stats.linesPerSec = static_cast<double>(linesPerSec_.load(memory_order_relaxed));
+    stats.mbPerSec = static_cast<double>(bytesPerSec_.load(memory_order_relaxed)) / (1024 * 1024);
+    stats.queuedBytes = 0;
+    stats.queueCapacity = 0;
+    lock_guard<ProfiledMutex> locker(ringsMtx_);
+    stats.rings = rings_.size();
+    for (const auto &ring : rings_)
     {
-        unique_lock<mutex> locker(mtx_);
-        // 解锁
-        locker.unlock();
+        stats.queuedBytes += ring->Used();
+        stats.queueCapacity += ring->Capacity();
+    }
+    return stats;
+}
 
-        char newFile[LOG_NAME_LEN];
-        char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+/**
+ * @brief 用gzip压缩切换下来的旧文件，不等待压缩完成
+ * posix_spawn不复制父进程的地址空间，在多线程程序中调用也很快
+ *
+ */
+void Log::Compress_(const char *fileName)
+{
+    char *const argv[] = {const_cast<char *>("gzip"), const_cast<char *>("-f"),
+                          const_cast<char *>(fileName), nullptr};
+    pid_t pid;
+    if (posix_spawnp(&pid, "gzip", nullptr, nullptr, argv, environ) == 0)
+    {
+        compressors_.push_back(pid);
+    }
+}
 
-        if (toDay_ != t.tm_mday)
+// 回收已经结束的压缩进程，不等待还在运行的进程
+void Log::ReapCompressors_(void)
+{
+    for (auto it = compressors_.begin(); it != compressors_.end();)
+    {
+        if (waitpid(*it, nullptr, WNOHANG) != 0)
         {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
-            toDay_ = t.tm_mday;
-            lineCount_ = 0;
+            it = compressors_.erase(it);
         }
         else
         {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, (lineCount_ / MAX_LINES), suffix_);
+            ++it;
+        }
+    }
+}
+
+/**
+ * @brief 以追加方式打开日志文件，调用时需持有mtx_
+ * 二进制文件为空时先写入文件头，已写入定义的格式串在新文件中需要重新定义
+ *
+ */
+void Log::OpenFile_(const char *fileName)
+{
+    bool ok = sink_.Open(fileName, preallocBytes_);
+    assert(ok);
+    (void)ok;
+    snprintf(fileName_, sizeof(fileName_), "%s", fileName);
+    if (binary_)
+    {
+        if (sink_.Size() == 0)
+        {
+            sink_.Append(LogFormat::BINARY_MAGIC, sizeof(LogFormat::BINARY_MAGIC));
         }
+        defined_.assign(LogFormat::MAX_FORMATS, false);
+    }
+}
+
+/**
+ * @brief 日期变化或当前文件行数达到MAX_LINES时切换文件，调用时需持有mtx_
+ * 异步模式下只在后台线程中调用，切换文件和启动压缩都不占用请求线程
+ *
+ * @param t 将要写入的日志的本地时间
+ */
+void Log::RotateIfNeeded_(const struct tm &t)
+{
+    /* 日志日期 日志行数 */
+    if (toDay_ == t.tm_mday && !(lineCount_ && (lineCount_ % MAX_LINES == 0)))
+    {
+        return;
+    }
+    char newFile[LOG_NAME_LEN];
+    char tail[36] = {0};
+    snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
 
-        locker.lock();
-        flush();
-        fclose(fp_);
-        fp_ = fopen(newFile, "a");
-        assert(fp_ != nullptr);
+    if (toDay_ != t.tm_mday)
+    {
+        snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
+        toDay_ = t.tm_mday;
+        lineCount_ = 0;
+    }
+    else
+    {
+        snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, (lineCount_ / MAX_LINES), suffix_);
     }
 
+    bytes_.fetch_add(sink_.Flush(), memory_order_relaxed);
+    sink_.Close();
+    rotations_.fetch_add(1, memory_order_relaxed);
+    ReapCompressors_();
+    if (compress_)
     {
-        unique_lock<mutex> locker(mtx_);
+        Compress_(fileName_);
+    }
+    OpenFile_(newFile);
+}
+
+void Log::write(int level, const char *format, ...)
+{
+    // 使用缓存时钟，不再每行调用gettimeofday和localtime
+    const ClockSecond &second = CachedClock::Second();
+    int64_t wallUs = CachedClock::WallUs();
+    int64_t usec = wallUs - second.sec * 1000000;
+    usec = usec < 0 ? 0 : (usec > 999999 ? 999999 : usec);
+    va_list vaList;
+
+    // 每个线程一块格式化缓冲区，格式化不需要加锁
+    thread_local char line[LINE_MAX_LEN];
+    int n = snprintf(line, LINE_MAX_LEN, "%s.%06ld %s",
+                     second.logTime, static_cast<long>(usec), LogFormat::LevelTitle(level));
+    va_start(vaList, format);
+    int m = vsnprintf(line + n, LINE_MAX_LEN - n - 1, format, vaList);
+    va_end(vaList);
+    if (m < 0)
+    {
+        m = 0;
+    }
+    else if (n + m > LINE_MAX_LEN - 2)
+    {
+        m = LINE_MAX_LEN - 2 - n;
+    }
+    line[n + m] = '\n';
+    size_t len = n + m + 1;
+
+    if (!isAsync_ || !writeThread_)
+    {
+        lock_guard<ProfiledMutex> locker(mtx_);
+        RotateIfNeeded_(second.tm);
+        sink_.Append(line, len);
         lineCount_++;
+        lines_.fetch_add(1, memory_order_relaxed);
+        FlushIfNeeded_(level >= flushLevel_);
+        return;
+    }
+    Append_(level, wallUs, line, len);
+}
+
+LogRing *Log::LocalRing_(void)
+{
+    if (!tlsRing.ring)
+    {
+        tlsRing.ring = make_shared<LogRing>(ringSize_);
+        lock_guard<ProfiledMutex> locker(ringsMtx_);
+        rings_.push_back(tlsRing.ring);
+        ringsVersion_.fetch_add(1, memory_order_release);
+    }
+    return tlsRing.ring.get();
+}
+
+/**
+ * @brief 调用处在当前一秒内写入的行数是否还没有超过限制
+ * 超过后只读不写，同一调用处刷屏时不会在计数所在的缓存行上争用
+ *
+ */
+bool Log::RateLimit_(uint32_t siteId)
+{
+    SiteWindow &site = sites_[siteId];
+    int64_t second = CachedClock::NowMs() / 1000;
+    int64_t last = site.second.load(memory_order_relaxed);
+    if (last != second && site.second.compare_exchange_strong(last, second, memory_order_relaxed))
+    {
+        site.count.store(0, memory_order_relaxed);
+    }
+    if (site.count.load(memory_order_relaxed) >= siteRateLimit_)
+    {
+        return false;
+    }
+    return site.count.fetch_add(1, memory_order_relaxed) < siteRateLimit_;
+}
 
-        int n = snprintf(buff_.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ",
-                         t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-                         t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-        buff_.HasWritten(n);
-        AppendLogLevelTitle_(level);
+/**
+ * @brief 在当前线程的缓冲区中申请一条记录
+ * 缓冲区满时按overflow_处理：QUEUE_DROP丢弃并计数，否则等待后台线程腾出空间
+ * ERROR即使在QUEUE_DROP下也等待，不会被丢弃
+ *
+ * @return LogRecord* 被丢弃时返回nullptr
+ */
+LogRecord *Log::Reserve_(LogRing *ring, uint32_t len, int level)
+{
+    LogRecord *record = ring->Reserve(len);
+    if (record == nullptr && overflow_ == QUEUE_DROP && level < NEVER_DROP_LEVEL)
+    {
+        dropped_++;
+        readable_.NotifyOne();
+        return nullptr;
+    }
+    while (record == nullptr)
+    {
+        uint32_t key = space_.PrepareWait();
+        record = ring->Reserve(len);
+        if (record != nullptr)
+        {
+            space_.CancelWait();
+            break;
+        }
+        readable_.NotifyOne();
+        // 带超时等待，后台线程已经退出时也不会永远阻塞
+        space_.Wait(key, 10);
+        record = ring->Reserve(len);
+    }
+    return record;
+}
 
-        va_start(vaList, format);
-        int m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, vaList);
-        va_end(vaList);
+/**
+ * @brief 提交记录
+ * 只有需要立即刷新的日志或缓冲区已用过半时才唤醒后台线程，其余情况由后台线程定时取走，
+ * 写日志不会每行都进入内核
+ *
+ */
+void Log::Publish_(LogRing *ring, int level)
+{
+    ring->Commit();
+    if (level >= flushLevel_ || ring->HalfFull())
+    {
+        readable_.NotifyOne();
+    }
+}
 
-        buff_.HasWritten(m);
-        buff_.Append("\n\0", 2);
+// 把一行已经格式化的日志拷贝到当前线程的缓冲区
+void Log::Append_(int level, int64_t timeUs, const char *line, size_t len)
+{
+    LogRing *ring = LocalRing_();
+    LogRecord *record = Reserve_(ring, static_cast<uint32_t>(len), level);
+    if (record == nullptr)
+    {
+        return;
+    }
+    record->timeUs = timeUs;
+    record->level = static_cast<uint16_t>(level);
+    memcpy(record->Data(), line, len);
+    Publish_(ring, level);
+}
 
-        if (isAsync_ && deque_ && !deque_->full())
+// 写入一行已经格式化的日志，二进制文件中写成文本记录，调用时需持有mtx_
+void Log::AppendText_(int64_t timeUs, int level, const char *text, size_t len)
+{
+    if (binary_)
+    {
+        char type = LogFormat::ENTRY_TEXT;
+        uint16_t level16 = static_cast<uint16_t>(level);
+        uint32_t len32 = static_cast<uint32_t>(len);
+        sink_.Append(&type, 1);
+        sink_.Append(&timeUs, sizeof(timeUs));
+        sink_.Append(&level16, sizeof(level16));
+        sink_.Append(&len32, sizeof(len32));
+    }
+    sink_.Append(text, len);
+}
+
+/**
+ * @brief 距上次汇总超过dropSummaryMs_且期间有日志被丢弃时，写一行汇总，调用时需持有mtx_
+ * 汇总由写文件的线程直接写入，不经过可能已满的缓冲区
+ *
+ */
+void Log::ReportDropped_(int64_t nowMs)
+{
+    if (dropSummaryMs_ <= 0 || nowMs - lastSummaryMs_ < dropSummaryMs_)
+    {
+        return;
+    }
+    uint64_t full = static_cast<uint64_t>(dropped_.Load());
+    uint64_t limited = static_cast<uint64_t>(rateLimited_.Load());
+    uint64_t sampled = static_cast<uint64_t>(sampled_.Load());
+    uint64_t total = (full - reportedFull_) + (limited - reportedLimited_) + (sampled - reportedSampled_);
+    if (total > 0 && sink_.IsOpen())
+    {
+        const ClockSecond &second = CachedClock::Second();
+        int64_t wallUs = CachedClock::WallUs();
+        char line[256];
+        int n = snprintf(line, sizeof(line),
+                         "%s.%06ld %sLog dropped %llu lines in the last %.1fs "
+                         "(buffer full: %llu, rate limited: %llu, sampled: %llu)\n",
+                         second.logTime, static_cast<long>(wallUs % 1000000), LogFormat::LevelTitle(2),
+                         static_cast<unsigned long long>(total),
+                         (nowMs - lastSummaryMs_) / 1000.0,
+                         static_cast<unsigned long long>(full - reportedFull_),
+                         static_cast<unsigned long long>(limited - reportedLimited_),
+                         static_cast<unsigned long long>(sampled - reportedSampled_));
+        AppendText_(wallUs, 2, line, min(static_cast<size_t>(n), sizeof(line) - 1));
+        lines_.fetch_add(1, memory_order_relaxed);
+        lineCount_++;
+    }
+    reportedFull_ = full;
+    reportedLimited_ = limited;
+    reportedSampled_ = sampled;
+    lastSummaryMs_ = nowMs;
+}
+
+/**
+ * @brief 把一条记录写入文件，调用时需持有mtx_
+ * 文本文件中延迟格式化的记录在这里格式化；二进制文件中原样写入，格式串第一次用到时先写入定义
+ *
+ * @param record 缓冲区中的记录
+ * @param t 记录时间对应的本地时间
+ */
+void Log::WriteRecord_(const LogRecord &record, const struct tm &t)
+{
+    if (binary_)
+    {
+        uint32_t len = record.len;
+        if (record.kind == LogRecord::KIND_FORMAT)
         {
-            deque_->push_back(buff_.RetrieveAllToStr());
+            uint32_t id;
+            memcpy(&id, record.Data(), sizeof(id));
+            if (id < defined_.size() && !defined_[id])
+            {
+                const char *format = LogFormat::Format(id);
+                uint16_t level = static_cast<uint16_t>(LogFormat::Level(id));
+                uint32_t formatLen = static_cast<uint32_t>(strlen(format));
+                char type = LogFormat::ENTRY_FORMAT;
+                sink_.Append(&type, 1);
+                sink_.Append(&id, sizeof(id));
+                sink_.Append(&level, sizeof(level));
+                sink_.Append(&formatLen, sizeof(formatLen));
+                sink_.Append(format, formatLen);
+                defined_[id] = true;
+            }
+            len -= sizeof(id);
+            char type = LogFormat::ENTRY_RECORD;
+            sink_.Append(&type, 1);
+            sink_.Append(&record.timeUs, sizeof(record.timeUs));
+            sink_.Append(&id, sizeof(id));
+            sink_.Append(&len, sizeof(len));
+            sink_.Append(record.Data() + sizeof(id), len);
         }
         else
         {
-            fputs(buff_.Peek(), fp_);
+            AppendText_(record.timeUs, record.level, record.Data(), len);
         }
-        buff_.RetrieveAll();
+        return;
+    }
+    if (record.kind != LogRecord::KIND_FORMAT)
+    {
+        AppendText_(record.timeUs, record.level, record.Data(), record.len);
+        return;
     }
+    char line[LINE_MAX_LEN];
+    uint32_t id;
+    memcpy(&id, record.Data(), sizeof(id));
+    size_t n = strftime(line, sizeof(line), "%Y-%m-%d %H:%M:%S", &t);
+    n += snprintf(line + n, sizeof(line) - n, ".%06ld %s",
+                  static_cast<long>(record.timeUs % 1000000), LogFormat::LevelTitle(record.level));
+    n += LogFormat::Render(LogFormat::Format(id), record.Data() + sizeof(id), record.len - sizeof(id),
+                           line + n, sizeof(line) - n - 1);
+    line[n++] = '\n';
+    sink_.Append(line, n);
 }
 
-void Log::AppendLogLevelTitle_(int level)
+/**
+ * @brief 按时间戳合并各缓冲区中的记录写入文件，直到所有缓冲区为空，之后按刷新策略刷新
+ *
+ * @return size_t 写入的行数
+ */
+size_t Log::Drain_(const vector<shared_ptr<LogRing>> &rings)
 {
-    switch (level)
+    size_t written = 0;
+    // 同一秒内的日志共用一次localtime_r的结果
+    time_t lastSec = -1;
+    struct tm t;
+    bool urgent = flushRequested_.exchange(false, memory_order_acq_rel);
+    lock_guard<ProfiledMutex> locker(mtx_);
+    while (true)
     {
-    case 0:
-        buff_.Append("[debug]:", 9);
-        break;
-    case 1:
-        buff_.Append("[info]:", 9);
-        break;
-    case 2:
-        buff_.Append("[warn]:", 9);
-        break;
-    case 3:
-        buff_.Append("[error]:", 9);
-        break;
-
-    default:
-        buff_.Append("[info]:", 9);
-        break;
+        LogRing *next = nullptr;
+        const LogRecord *first = nullptr;
+        for (const auto &ring : rings)
+        {
+            const LogRecord *record = ring->Front();
+            if (record != nullptr && (first == nullptr || record->timeUs < first->timeUs))
+            {
+                first = record;
+                next = ring.get();
+            }
+        }
+        if (next == nullptr)
+        {
+            break;
+        }
+        time_t sec = static_cast<time_t>(first->timeUs / 1000000);
+        if (sec != lastSec)
+        {
+            localtime_r(&sec, &t);
+            lastSec = sec;
+        }
+        RotateIfNeeded_(t);
+        WriteRecord_(*first, t);
+        lines_.fetch_add(1, memory_order_relaxed);
+        urgent = urgent || first->level >= flushLevel_;
+        lineCount_++;
+        next->Pop();
+        written++;
     }
+    FlushIfNeeded_(urgent);
+    return written;
 }
 
 void Log::flush(void)
 {
-    if (isAsync_)
+    if (isAsync_ && writeThread_)
     {
-        deque_->flush();
+        // 由后台线程取空缓冲区后刷新
+        flushRequested_.store(true, memory_order_release);
+        readable_.NotifyOne();
+        return;
     }
-    fflush(fp_);
+    lock_guard<ProfiledMutex> locker(mtx_);
+    FlushIfNeeded_(true);
 }
 
 void Log::AsyncWrite_(void)
 {
-    string str = "";
-    while (deque_->pop(str))
+    vector<shared_ptr<LogRing>> rings;
+    uint64_t version = 0;
+    while (true)
     {
-        lock_guard<mutex> locker(mtx_);
-        fputs(str.c_str(), fp_);
+        // 先读取关闭标志再取空缓冲区，关闭前写入的日志不会丢失
+        bool closing = closing_.load(memory_order_acquire);
+        if (ringsVersion_.load(memory_order_acquire) != version)
+        {
+            lock_guard<ProfiledMutex> locker(ringsMtx_);
+            rings = rings_;
+            version = ringsVersion_.load(memory_order_relaxed);
+        }
+        if (Drain_(rings) > 0)
+        {
+            space_.NotifyAll();
+            continue;
+        }
+        if (closing)
+        {
+            lock_guard<ProfiledMutex> locker(mtx_);
+            FlushIfNeeded_(true);
+            break;
+        }
+        // 移除所属线程已退出且已取空的缓冲区
+        bool pruned = false;
+        {
+            lock_guard<ProfiledMutex> locker(ringsMtx_);
+            for (auto it = rings_.begin(); it != rings_.end();)
+            {
+                if ((*it)->IsClosed() && (*it)->Empty())
+                {
+                    it = rings_.erase(it);
+                    pruned = true;
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            if (pruned)
+            {
+                ringsVersion_.fetch_add(1, memory_order_release);
+            }
+        }
+        if (pruned)
+        {
+            continue;
+        }
+
+        // 普通日志不会唤醒后台线程，最多等待一个刷新周期就取一次
+        int timeoutMs = flushIntervalMs_;
+        if (sink_.Buffered() > 0)
+        {
+            timeoutMs = static_cast<int>(lastFlushMs_ + flushIntervalMs_ - NowMs_());
+            if (timeoutMs <= 0)
+            {
+                lock_guard<ProfiledMutex> locker(mtx_);
+                FlushIfNeeded_(false);
+                continue;
+            }
+        }
+        uint32_t key = readable_.PrepareWait();
+        // 登记等待之后再检查一次，避免错过刚写入的日志或新注册的缓冲区
+        bool empty = ringsVersion_.load(memory_order_acquire) == version &&
+                     !closing_.load(memory_order_acquire) &&
+                     !flushRequested_.load(memory_order_acquire);
+        for (size_t i = 0; empty && i < rings.size(); i++)
+        {
+            empty = rings[i]->Empty();
+        }
+        if (!empty)
+        {
+            readable_.CancelWait();
+            continue;
+        }
+        readable_.Wait(key, timeoutMs);
     }
 }
 
@@ -224,4 +728,4 @@ Log *Log::Instance(void)
 void Log::FlushLogThread(void)
 {
     Log::Instance()->AsyncWrite_();
-}
\ No newline at end of file
+}
@@ -4,25 +4,62 @@
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
 #include <sys/time.h>
 #include <stdarg.h>
+#include <string.h>
 #include <assert.h>
 #include <sys/stat.h>
-#include "blockqueue.h"
-#include "../buffer/buffer.h"
+#include "logring.h"
+#include "logformat.h"
+#include "logsink.h"
+#include "../pool/mpmcqueue.h"
+#include "../timer/cachedclock.h"
+#include "../metrics/shardedcounter.h"
+#include "../metrics/lockstats.h"
+#include "../config/config.h"
 
+/**
+ * @brief 日志系统
+ * 异步模式下每个写日志的线程有自己的SPSC环形缓冲区，写日志只格式化并拷贝到本线程的缓冲区，不加锁
+ * 唯一的后台线程按时间戳合并各缓冲区中的记录写入文件，文件的切换也只在后台线程中进行
+ * 开启延迟格式化后，调用处只把格式串编号和参数写入缓冲区，由后台线程格式化或直接写成二进制文件
+ *
+ */
 class Log
 {
 private:
     Log();
-    void AppendLogLevelTitle_(int level);
     virtual ~Log();
     void AsyncWrite_(void);
+    LogRing *LocalRing_(void);
+    bool Admit_(int level, uint32_t siteId);
+    bool RateLimit_(uint32_t siteId);
+    LogRecord *Reserve_(LogRing *ring, uint32_t len, int level);
+    void Publish_(LogRing *ring, int level);
+    void Append_(int level, int64_t timeUs, const char *line, size_t len);
+    size_t Drain_(const std::vector<std::shared_ptr<LogRing>> &rings);
+    void WriteRecord_(const LogRecord &record, const struct tm &t);
+    void AppendText_(int64_t timeUs, int level, const char *text, size_t len);
+    void ReportDropped_(int64_t nowMs);
+    void FlushIfNeeded_(bool urgent);
+    void UpdateRate_(int64_t nowMs);
+    void Compress_(const char *fileName);
+    void ReapCompressors_(void);
+    static int64_t NowMs_(void);
+    void RotateIfNeeded_(const struct tm &t);
+    void OpenFile_(const char *fileName);
 
 private:
     static const int LOG_PATH_LEN = 256;
     static const int LOG_NAME_LEN = 256;
     static const int MAX_LINES = 50000;
+    // 单行日志的最大长度，超出部分截断
+    static const int LINE_MAX_LEN = 4096;
+    // 不低于该等级的日志不会被丢弃、限速或采样
+    static const int NEVER_DROP_LEVEL = 3;
 
     // path_为目录路径，suffix_为文件后缀
     const char *path_;
@@ -31,45 +68,215 @@ private:
     int MAX_LINES_;
     int lineCount_;
     int toDay_;
-    bool isOpen_;
+    std::atomic<bool> isOpen_;
 
-    Buffer buff_;
-    int level_;
+    // 每次写日志都要读取，使用原子变量不加锁
+    std::atomic<int> level_;
     bool isAsync_;
 
-    FILE *fp_;
-    std::unique_ptr<BlockDeque<std::string>> deque_;
+    // 当前日志文件，写入先进入缓冲，按刷新策略批量写入
+    LogSink sink_;
+    char fileName_[LOG_NAME_LEN];
+    // 保护sink_、文件切换和刷新状态
+    ProfiledMutex mtx_;
+
+    // 刷新策略，见LogConfig
+    int flushIntervalMs_;
+    size_t flushBytes_;
+    int flushLevel_;
+    // 上次刷新的时间
+    int64_t lastFlushMs_;
+    // 新文件预分配的大小
+    size_t preallocBytes_;
+    // 切换文件后压缩旧文件，压缩进程由写文件的线程启动和回收
+    bool compress_;
+    std::vector<pid_t> compressors_;
+
+    // 吞吐统计，累计值和最近一个统计周期的速率
+    std::atomic<uint64_t> lines_;
+    std::atomic<uint64_t> bytes_;
+    std::atomic<uint64_t> rotations_;
+    std::atomic<uint64_t> linesPerSec_;
+    std::atomic<uint64_t> bytesPerSec_;
+    int64_t rateMs_;
+    uint64_t rateLines_;
+    uint64_t rateBytes_;
+    // flush()请求后台线程立即刷新
+    std::atomic<bool> flushRequested_;
+
+    // 每个线程的缓冲区大小，单位字节
+    size_t ringSize_;
+    // 缓冲区满时的处理方式，QUEUE_SPILL按QUEUE_BLOCK处理
+    OVERFLOW_POLICY overflow_;
+    // 延迟格式化和二进制文件只在异步模式下生效
+    bool deferred_;
+    bool binary_;
+    // 当前二进制文件中已经写入定义的格式串编号，切换文件后清空
+    std::vector<bool> defined_;
+    // 所有线程的缓冲区，线程退出后由后台线程取空并移除
+    mutable ProfiledMutex ringsMtx_;
+    std::vector<std::shared_ptr<LogRing>> rings_;
+    std::atomic<uint64_t> ringsVersion_;
+    // 后台线程在readable_上等待新日志，写日志的线程在space_上等待缓冲区空间
+    EventCount readable_;
+    EventCount space_;
+    std::atomic<bool> closing_;
     std::unique_ptr<std::thread> writeThread_;
-    std::mutex mtx_;
+
+    /* 过载保护，见LogConfig */
+    // 每个调用处当前一秒的窗口，下标为格式串编号，开启限速时才分配
+    struct SiteWindow
+    {
+        std::atomic<int64_t> second;
+        std::atomic<uint32_t> count;
+    };
+    std::unique_ptr<SiteWindow[]> sites_;
+    uint32_t siteRateLimit_;
+    // DEBUG、INFO的采样阈值，随机数小于阈值时写入，SAMPLE_ALL表示不采样
+    static const uint64_t SAMPLE_ALL = 1ull << 32;
+    uint64_t sampleThreshold_[2];
+    // 被丢弃的行数，过载时每个线程都会写，按线程分片计数
+    ShardedCounter dropped_;
+    ShardedCounter rateLimited_;
+    ShardedCounter sampled_;
+    // 上次写汇总时的时间和已汇总的丢弃行数，调用时需持有mtx_
+    int dropSummaryMs_;
+    int64_t lastSummaryMs_;
+    uint64_t reportedFull_;
+    uint64_t reportedLimited_;
+    uint64_t reportedSampled_;
 
 public:
+    // 日志吞吐统计
+    struct Stats
+    {
+        // 累计写入文件的行数和字节数
+        uint64_t lines;
+        uint64_t bytes;
+        // 缓冲区满、超过调用处限速和被采样丢弃的行数
+        uint64_t dropped;
+        uint64_t rateLimited;
+        uint64_t sampled;
+        uint64_t rotations;
+        // 最近约一秒内的速率
+        double linesPerSec;
+        double mbPerSec;
+        // 各线程缓冲区中等待后台线程写入的字节数和缓冲区总容量，同步模式下都为0
+        size_t rings;
+        size_t queuedBytes;
+        size_t queueCapacity;
+    };
+
     // 这里没用到构造函数，而是使用自定义初始化函数
+    // maxQueueCapacity>0时为异步模式，每个线程的缓冲区约可容纳maxQueueCapacity行日志
+    // overflow为缓冲区满时的处理方式，默认阻塞等待写线程
+    // config为延迟格式化、二进制文件和刷新策略等可选设置
     void init(int level, const char *path = "./log",
-              const char *suffix = "./log", int maxQueueCapacity = 1024);
+              const char *suffix = "./log", int maxQueueCapacity = 1024,
+              OVERFLOW_POLICY overflow = QUEUE_BLOCK, const LogConfig &config = LogConfig());
 
     static Log *Instance(void);
     static void FlushLogThread(void);
 
     void write(int level, const char *format, ...);
+    // 延迟格式化时只记录格式串编号和参数，否则同write
+    template <class... Args>
+    void Write(int level, uint32_t formatId, const char *format, Args... args);
+    // 立即把已写入的日志刷新到文件，平时按刷新策略刷新，不需要调用
     void flush(void);
 
-    int GetLevel(void);
-    void SetLevel(int level);
-    bool IsOpen(void) { return isOpen_; }
+    int GetLevel(void) const { return level_.load(std::memory_order_relaxed); }
+    void SetLevel(int level) { level_.store(level, std::memory_order_relaxed); }
+    bool IsOpen(void) const { return isOpen_.load(std::memory_order_relaxed); }
+    // 缓冲区满时按QUEUE_DROP策略丢弃的日志行数
+    uint64_t Dropped(void) const { return static_cast<uint64_t>(dropped_.Load()); }
+    Stats GetStats(void) const;
 };
 
+template <class... Args>
+void Log::Write(int level, uint32_t formatId, const char *format, Args... args)
+{
+    if (!Admit_(level, formatId))
+    {
+        return;
+    }
+    size_t len = sizeof(uint32_t) + LogFormat::ArgsSize(args...);
+    // 参数过长时退回到立即格式化，按单行最大长度截断
+    if (!deferred_ || formatId == LogFormat::INVALID_ID || len > LINE_MAX_LEN)
+    {
+        write(level, format, args...);
+        return;
+    }
+    LogRing *ring = LocalRing_();
+    LogRecord *record = Reserve_(ring, static_cast<uint32_t>(len), level);
+    if (record == nullptr)
+    {
+        return;
+    }
+    record->timeUs = CachedClock::WallUs();
+    record->level = static_cast<uint16_t>(level);
+    record->kind = LogRecord::KIND_FORMAT;
+    memcpy(record->Data(), &formatId, sizeof(formatId));
+    LogFormat::Encode(record->Data() + sizeof(formatId), args...);
+    Publish_(ring, level);
+}
+
+/**
+ * @brief 按采样率和调用处限速决定是否写入这一行，ERROR总是写入
+ * 不采样、不限速时只有两次比较
+ *
+ * @param siteId 调用处的格式串编号，不是由LOG_BASE调用时为INVALID_ID，不参与限速
+ */
+inline bool Log::Admit_(int level, uint32_t siteId)
+{
+    if (level >= NEVER_DROP_LEVEL)
+    {
+        return true;
+    }
+    if (level <= 1 && sampleThreshold_[level] < SAMPLE_ALL)
+    {
+        // xorshift64，每个线程独立的随机数序列
+        thread_local uint64_t seed = reinterpret_cast<uintptr_t>(&seed) * 0x9E3779B97F4A7C15ull | 1;
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        if ((seed >> 32) >= sampleThreshold_[level])
+        {
+            sampled_++;
+            return false;
+        }
+    }
+    if (siteRateLimit_ > 0 && siteId < LogFormat::MAX_FORMATS && !RateLimit_(siteId))
+    {
+        rateLimited_++;
+        return false;
+    }
+    return true;
+}
+
 // ##__VA_ARGS__是一个可变参数的宏
 // 其含义就是参数列表中的最后一个省略号参数
 /* 以下宏定义相当于debug时输出的信息 */
-#define LOG_BASE(level, format, ...)                   \
-    do                                                 \
-    {                                                  \
-        Log *log = Log::Instance();                    \
-        if (log->IsOpen() && log->GetLevel() <= level) \
-        {                                              \
-            log->write(level, format, ##__VA_ARGS__);  \
-            log->flush();                              \
-        }                                              \
+// 编译期最低日志等级，低于该等级的调用连同参数求值一起被编译器去掉
+// 如make LOG_MIN_LEVEL=1去掉所有LOG_DEBUG
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+// 每个调用处第一次执行时登记格式串，format必须是字符串常量
+// 运行时等级只是一次原子读，写入后不再逐行刷新文件
+#define LOG_BASE(level, format, ...)                                                    \
+    do                                                                                  \
+    {                                                                                   \
+        if ((level) >= LOG_MIN_LEVEL)                                                   \
+        {                                                                               \
+            Log *log = Log::Instance();                                                 \
+            if (log->GetLevel() <= level && log->IsOpen())                              \
+            {                                                                           \
+                static const uint32_t logFormatId = LogFormat::Register(level, format); \
+                log->Write(level, logFormatId, format, ##__VA_ARGS__);                  \
+            }                                                                           \
+        }                                                                               \
     } while (0);
 
 #define LOG_DEBUG(format, ...)             \
@@ -0,0 +1,272 @@
+#include "logformat.h"
+#include <stdio.h>
+#include <algorithm>
+
+using namespace std;
+
+const char LogFormat::BINARY_MAGIC[8] = {'W', 'S', 'B', 'L', 'O', 'G', '1', '\0'};
+LogFormat::Entry LogFormat::entries_[LogFormat::MAX_FORMATS];
+atomic<uint32_t> LogFormat::count_(0);
+mutex LogFormat::mtx_;
+
+uint32_t LogFormat::Register(int level, const char *format)
+{
+    lock_guard<mutex> locker(mtx_);
+    uint32_t id = count_.load(memory_order_relaxed);
+    if (id >= MAX_FORMATS)
+    {
+        return INVALID_ID;
+    }
+    entries_[id].format = format;
+    entries_[id].level = level;
+    // 先写好条目再发布数量，读取方看到编号时条目一定已经写入
+    count_.store(id + 1, memory_order_release);
+    return id;
+}
+
+const char *LogFormat::Format(uint32_t id)
+{
+    return id < count_.load(memory_order_acquire) ? entries_[id].format : nullptr;
+}
+
+int LogFormat::Level(uint32_t id)
+{
+    return id < count_.load(memory_order_acquire) ? entries_[id].level : 1;
+}
+
+const char *LogFormat::LevelTitle(int level)
+{
+    switch (level)
+    {
+    case 0:
+        return "[debug]: ";
+    case 1:
+        return "[info] : ";
+    case 2:
+        return "[warn] : ";
+    case 3:
+        return "[error]: ";
+    default:
+        return "[info] : ";
+    }
+}
+
+namespace
+{
+    // 编码后的一个参数
+    struct Arg
+    {
+        char type;
+        uint64_t bits;
+        const char *str;
+    };
+
+    bool NextArg(const char *&p, const char *end, Arg &arg)
+    {
+        if (p >= end)
+        {
+            return false;
+        }
+        arg.type = *p++;
+        if (arg.type == LogFormat::ARG_STR)
+        {
+            uint32_t len;
+            if (end - p < static_cast<ptrdiff_t>(sizeof(len)))
+            {
+                return false;
+            }
+            memcpy(&len, p, sizeof(len));
+            p += sizeof(len);
+            if (static_cast<size_t>(end - p) < static_cast<size_t>(len) + 1)
+            {
+                return false;
+            }
+            arg.str = p;
+            p += len + 1;
+            return true;
+        }
+        if (end - p < static_cast<ptrdiff_t>(sizeof(arg.bits)))
+        {
+            return false;
+        }
+        memcpy(&arg.bits, p, sizeof(arg.bits));
+        p += sizeof(arg.bits);
+        return true;
+    }
+
+    double AsDouble(const Arg &arg)
+    {
+        if (arg.type == LogFormat::ARG_DOUBLE)
+        {
+            double d;
+            memcpy(&d, &arg.bits, sizeof(d));
+            return d;
+        }
+        if (arg.type == LogFormat::ARG_INT)
+        {
+            return static_cast<double>(static_cast<int64_t>(arg.bits));
+        }
+        return static_cast<double>(arg.bits);
+    }
+
+    /**
+     * @brief 读取长度修饰，返回它表示的整数宽度，单位字节
+     * 没有修饰时为int的宽度，与printf的解释一致
+     *
+     */
+    size_t IntWidth(const char *&p)
+    {
+        size_t width = sizeof(int);
+        if (p[0] == 'h' && p[1] == 'h')
+        {
+            width = sizeof(char);
+        }
+        else if (p[0] == 'h')
+        {
+            width = sizeof(short);
+        }
+        else if (p[0] == 'l' && p[1] == 'l')
+        {
+            width = sizeof(long long);
+        }
+        else if (p[0] == 'l')
+        {
+            width = sizeof(long);
+        }
+        else if (p[0] == 'j')
+        {
+            width = sizeof(intmax_t);
+        }
+        else if (p[0] == 'z')
+        {
+            width = sizeof(size_t);
+        }
+        else if (p[0] == 't')
+        {
+            width = sizeof(ptrdiff_t);
+        }
+        else if (p[0] == 'L' || p[0] == 'q')
+        {
+            width = sizeof(long long);
+        }
+        while (*p && strchr("hljztLq", *p))
+        {
+            p++;
+        }
+        return width;
+    }
+
+    // 参数都按64位编码，按转换说明的宽度截断，有符号的转换同时做符号扩展
+    uint64_t Narrow(uint64_t bits, size_t width, bool isSigned)
+    {
+        switch (width)
+        {
+        case 1:
+            return isSigned ? static_cast<uint64_t>(static_cast<int8_t>(bits)) : static_cast<uint8_t>(bits);
+        case 2:
+            return isSigned ? static_cast<uint64_t>(static_cast<int16_t>(bits)) : static_cast<uint16_t>(bits);
+        case 4:
+            return isSigned ? static_cast<uint64_t>(static_cast<int32_t>(bits)) : static_cast<uint32_t>(bits);
+        default:
+            return bits;
+        }
+    }
+}
+
+size_t LogFormat::Render(const char *format, const char *args, size_t len, char *out, size_t size)
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+    const char *end = args + len;
+    const char *p = format ? format : "";
+    size_t n = 0;
+    // 单个转换说明，重新拼成snprintf能直接使用的形式
+    char spec[32];
+    while (*p && n + 1 < size)
+    {
+        if (*p != '%')
+        {
+            out[n++] = *p++;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            out[n++] = '%';
+            p += 2;
+            continue;
+        }
+        size_t s = 0;
+        spec[s++] = *p++;
+        // 标志、宽度和精度原样保留，*从参数中取值
+        while (*p && strchr("-+ #0123456789.*", *p) && s + 24 < sizeof(spec))
+        {
+            if (*p == '*')
+            {
+                Arg arg;
+                long long value = NextArg(args, end, arg) ? static_cast<long long>(arg.bits) : 0;
+                s += snprintf(spec + s, sizeof(spec) - s, "%lld", value);
+                p++;
+                continue;
+            }
+            spec[s++] = *p++;
+        }
+        // 整数按长度修饰表示的宽度输出，如%x输出-1为ffffffff，和立即格式化的结果相同
+        size_t width = IntWidth(p);
+        char conv = *p;
+        if (conv == '\0')
+        {
+            break;
+        }
+        p++;
+
+        Arg arg;
+        bool ok = NextArg(args, end, arg);
+        int written = -1;
+        if (ok && strchr("diuoxXc", conv) && arg.type != ARG_STR)
+        {
+            uint64_t bits = arg.type == ARG_DOUBLE ? static_cast<uint64_t>(AsDouble(arg)) : arg.bits;
+            if (conv == 'c')
+            {
+                spec[s++] = 'c';
+                spec[s] = '\0';
+                written = snprintf(out + n, size - n, spec, static_cast<int>(bits));
+            }
+            else
+            {
+                spec[s++] = 'l';
+                spec[s++] = 'l';
+                spec[s++] = conv;
+                spec[s] = '\0';
+                bits = Narrow(bits, width, conv == 'd' || conv == 'i');
+                written = snprintf(out + n, size - n, spec, static_cast<long long>(bits));
+            }
+        }
+        else if (ok && strchr("eEfFgGaA", conv) && arg.type != ARG_STR)
+        {
+            spec[s++] = conv;
+            spec[s] = '\0';
+            written = snprintf(out + n, size - n, spec, AsDouble(arg));
+        }
+        else if (ok && conv == 's' && arg.type == ARG_STR)
+        {
+            spec[s++] = 's';
+            spec[s] = '\0';
+            written = snprintf(out + n, size - n, spec, arg.str);
+        }
+        else if (ok && conv == 'p' && arg.type != ARG_STR)
+        {
+            spec[s++] = 'p';
+            spec[s] = '\0';
+            written = snprintf(out + n, size - n, spec, reinterpret_cast<void *>(static_cast<uintptr_t>(arg.bits)));
+        }
+        if (written < 0)
+        {
+            written = snprintf(out + n, size - n, "<?>");
+        }
+        n += min(static_cast<size_t>(written), size - n - 1);
+    }
+    out[n] = '\0';
+    return n;
+}
@@ -0,0 +1,174 @@
+/**
+ * @file logformat.h
+ * @brief 延迟格式化日志：格式串登记、参数编码、按格式串还原文本，以及二进制日志文件的格式
+ *
+ */
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <mutex>
+#include <atomic>
+#include <type_traits>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * @brief 调用处的格式串在第一次执行时登记，得到一个编号
+ * 之后每次写日志只记录编号和按类型编码的参数，格式化推迟到后台线程或离线的logdecode中进行
+ *
+ * 参数编码：每个参数一个字节的类型，后面是数据
+ *   ARG_INT/ARG_UINT/ARG_DOUBLE/ARG_PTR：8字节，本机字节序
+ *   ARG_STR：4字节长度，之后是字符串内容和结尾的'\0'
+ *
+ * 二进制日志文件：以BINARY_MAGIC开头，之后每条记录以一个字节的类型开始，数值均为本机字节序
+ *   ENTRY_FORMAT：u32编号, u16等级, u32长度, 格式串      第一次用到某个编号前写入
+ *   ENTRY_RECORD：i64时间us, u32编号, u32长度, 编码的参数
+ *   ENTRY_TEXT：  i64时间us, u16等级, u32长度, 已格式化的一行文本(含换行)
+ *
+ */
+class LogFormat
+{
+public:
+    // 最多登记的格式串数量，超出后的调用处退回到立即格式化
+    static const uint32_t MAX_FORMATS = 4096;
+    static const uint32_t INVALID_ID = UINT32_MAX;
+
+    enum ARG_TYPE
+    {
+        ARG_INT = 'i',
+        ARG_UINT = 'u',
+        ARG_DOUBLE = 'f',
+        ARG_STR = 's',
+        ARG_PTR = 'p',
+    };
+
+    enum ENTRY_TYPE
+    {
+        ENTRY_FORMAT = 'F',
+        ENTRY_RECORD = 'R',
+        ENTRY_TEXT = 'T',
+    };
+
+    static const char BINARY_MAGIC[8];
+
+    /**
+     * @brief 登记一个格式串，同一调用处只登记一次
+     *
+     * @param level 日志等级
+     * @param format 格式串，必须是字符串常量
+     * @return uint32_t 格式串编号，登记已满返回INVALID_ID
+     */
+    static uint32_t Register(int level, const char *format);
+    // 编号对应的格式串，未登记返回nullptr
+    static const char *Format(uint32_t id);
+    static int Level(uint32_t id);
+
+    // 日志等级的标题，如"[info] : "
+    static const char *LevelTitle(int level);
+
+    /**
+     * @brief 按格式串和编码后的参数生成文本
+     * 整数按转换说明符和长度修饰重新解释为对应宽度，参数不足或类型不符时输出<?>
+     *
+     * @return size_t 写入out的长度，不含结尾的'\0'，超出size时截断
+     */
+    static size_t Render(const char *format, const char *args, size_t len, char *out, size_t size);
+
+    // 编码全部参数需要的字节数
+    template <class... Args>
+    static size_t ArgsSize(const Args &...args)
+    {
+        size_t sizes[] = {0, ArgSize_(args)...};
+        size_t total = 0;
+        for (size_t size : sizes)
+        {
+            total += size;
+        }
+        return total;
+    }
+
+    // 把参数依次编码到buf，buf至少有ArgsSize字节
+    template <class... Args>
+    static char *Encode(char *buf, const Args &...args)
+    {
+        int order[] = {0, (buf = Put_(buf, args), 0)...};
+        (void)order;
+        return buf;
+    }
+
+private:
+    struct Entry
+    {
+        const char *format;
+        int level;
+    };
+
+    static Entry entries_[MAX_FORMATS];
+    static std::atomic<uint32_t> count_;
+    static std::mutex mtx_;
+
+    static const char *Str_(const char *str) { return str ? str : "(null)"; }
+
+    // 整数、枚举、浮点数和指针都编码为一个类型字节加8字节数据
+    template <class T>
+    static size_t ArgSize_(const T &)
+    {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+                      "deferred log arguments must be arithmetic, enum, pointer or C string");
+        return 1 + sizeof(uint64_t);
+    }
+    static size_t ArgSize_(const char *str) { return 1 + sizeof(uint32_t) + strlen(Str_(str)) + 1; }
+    static size_t ArgSize_(char *str) { return ArgSize_(static_cast<const char *>(str)); }
+
+    static char *PutRaw_(char *buf, char type, uint64_t bits)
+    {
+        *buf = type;
+        memcpy(buf + 1, &bits, sizeof(bits));
+        return buf + 1 + sizeof(bits);
+    }
+    template <class T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, char *>::type
+    Put_(char *buf, const T &value)
+    {
+        return PutRaw_(buf, ARG_INT, static_cast<uint64_t>(static_cast<int64_t>(value)));
+    }
+    template <class T>
+    static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, char *>::type
+    Put_(char *buf, const T &value)
+    {
+        return PutRaw_(buf, ARG_UINT, static_cast<uint64_t>(value));
+    }
+    template <class T>
+    static typename std::enable_if<std::is_enum<T>::value, char *>::type
+    Put_(char *buf, const T &value)
+    {
+        return PutRaw_(buf, ARG_INT, static_cast<uint64_t>(static_cast<int64_t>(value)));
+    }
+    template <class T>
+    static typename std::enable_if<std::is_floating_point<T>::value, char *>::type
+    Put_(char *buf, const T &value)
+    {
+        double d = static_cast<double>(value);
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        return PutRaw_(buf, ARG_DOUBLE, bits);
+    }
+    template <class T>
+    static char *Put_(char *buf, T *const &ptr)
+    {
+        return PutRaw_(buf, ARG_PTR, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ptr)));
+    }
+    static char *Put_(char *buf, const char *str)
+    {
+        str = Str_(str);
+        uint32_t len = static_cast<uint32_t>(strlen(str));
+        *buf = ARG_STR;
+        memcpy(buf + 1, &len, sizeof(len));
+        memcpy(buf + 1 + sizeof(len), str, len + 1);
+        return buf + 1 + sizeof(len) + len + 1;
+    }
+    static char *Put_(char *buf, char *str) { return Put_(buf, static_cast<const char *>(str)); }
+};
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * @file logring.h
+ * @brief 单生产者单消费者的日志环形缓冲区，每个写日志的线程独占一个
+ *
+ */
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+/**
+ * @brief 环形缓冲区中的一条日志记录，后面紧跟len字节的内容，整条记录按8字节对齐
+ *
+ */
+struct LogRecord
+{
+    // 墙上时间，单位us，后台线程按它合并各线程的日志
+    int64_t timeUs;
+    uint32_t len;
+    uint16_t level;
+    uint16_t kind;
+
+    // 记录类型，KIND_WRAP表示缓冲区尾部剩余空间放不下记录，跳到开头继续
+    // KIND_FORMAT的内容为4字节格式串编号加编码后的参数，见LogFormat
+    enum RECORD_KIND
+    {
+        KIND_TEXT = 0,
+        KIND_WRAP,
+        KIND_FORMAT,
+    };
+
+    char *Data(void) { return reinterpret_cast<char *>(this + 1); }
+    const char *Data(void) const { return reinterpret_cast<const char *>(this + 1); }
+};
+
+/**
+ * @brief 变长记录的SPSC环形缓冲区
+ * 生产者Reserve得到连续空间，写完后Commit；消费者Front取队首记录，处理完后Pop
+ * 头尾位置只增不减，各自只由一方写入，双方都缓存对方的位置，减少跨核读取
+ *
+ */
+class LogRing
+{
+public:
+    // capacity向上取整为2的幂
+    explicit LogRing(size_t capacity)
+        : head_(0), tailCache_(0), tail_(0), headCache_(0), pendingTail_(0), closed_(false)
+    {
+        size_t cap = 1024;
+        while (cap < capacity)
+        {
+            cap <<= 1;
+        }
+        cap_ = cap;
+        mask_ = cap - 1;
+        buf_.reset(new uint64_t[cap / sizeof(uint64_t)]);
+    }
+
+    /**
+     * @brief 生产者申请一条记录的空间
+     *
+     * @param len 记录内容长度
+     * @return LogRecord* 空间不足返回nullptr
+     */
+    LogRecord *Reserve(uint32_t len)
+    {
+        size_t total = Align_(sizeof(LogRecord) + len);
+        if (total > cap_ / 2)
+        {
+            return nullptr;
+        }
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t offset = tail & mask_;
+        // 尾部放不下整条记录时跳过剩余空间，记录总是连续的
+        size_t skip = offset + total > cap_ ? cap_ - offset : 0;
+        if (tail + skip + total - headCache_ > cap_)
+        {
+            headCache_ = head_.load(std::memory_order_acquire);
+            if (tail + skip + total - headCache_ > cap_)
+            {
+                return nullptr;
+            }
+        }
+        if (skip >= sizeof(LogRecord))
+        {
+            At_(offset)->kind = LogRecord::KIND_WRAP;
+        }
+        LogRecord *record = At_((tail + skip) & mask_);
+        record->len = len;
+        record->kind = LogRecord::KIND_TEXT;
+        pendingTail_ = tail + skip + total;
+        return record;
+    }
+
+    // 发布Reserve得到的记录，之后消费者才能看到
+    void Commit(void)
+    {
+        tail_.store(pendingTail_, std::memory_order_release);
+    }
+
+    // 消费者取队首记录，没有返回nullptr
+    const LogRecord *Front(void)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tailCache_)
+        {
+            tailCache_ = tail_.load(std::memory_order_acquire);
+            if (head == tailCache_)
+            {
+                return nullptr;
+            }
+        }
+        size_t offset = head & mask_;
+        if (cap_ - offset < sizeof(LogRecord) || At_(offset)->kind == LogRecord::KIND_WRAP)
+        {
+            // 跳过尾部的空白，跳过之后一定还有记录
+            head += cap_ - offset;
+            head_.store(head, std::memory_order_release);
+            offset = 0;
+        }
+        return At_(offset);
+    }
+
+    // 消费者丢弃Front返回的记录
+    void Pop(void)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        const LogRecord *record = At_(head & mask_);
+        head_.store(head + Align_(sizeof(LogRecord) + record->len), std::memory_order_release);
+    }
+
+    bool Empty(void) const
+    {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    // 已用的字节数，任何线程都可以读取，结果是近似值
+    size_t Used(void) const
+    {
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    // 生产者判断缓冲区是否已用过半，按生产者缓存的消费者位置估算，只会偏大
+    bool HalfFull(void) const
+    {
+        return tail_.load(std::memory_order_relaxed) - headCache_ > cap_ / 2;
+    }
+
+    // 所属线程退出时关闭，后台线程取空后释放
+    void Close(void) { closed_.store(true, std::memory_order_release); }
+    bool IsClosed(void) const { return closed_.load(std::memory_order_acquire); }
+    size_t Capacity(void) const { return cap_; }
+
+private:
+    static size_t Align_(size_t n) { return (n + 7) & ~static_cast<size_t>(7); }
+    LogRecord *At_(size_t offset) const
+    {
+        return reinterpret_cast<LogRecord *>(reinterpret_cast<char *>(buf_.get()) + offset);
+    }
+
+    // 消费者写的数据和生产者写的数据分别在不同的缓存行
+    std::atomic<size_t> head_;
+    size_t tailCache_;
+    char pad0_[64];
+    std::atomic<size_t> tail_;
+    size_t headCache_;
+    size_t pendingTail_;
+    char pad1_[64];
+    std::atomic<bool> closed_;
+
+    std::unique_ptr<uint64_t[]> buf_;
+    size_t cap_;
+    size_t mask_;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "logsink.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+LogSink::LogSink()
+    : fd_(-1), size_(0), allocated_(0), prealloc_(0), current_(0), buffered_(0)
+{
+    for (int i = 0; i < MAX_CHUNKS; i++)
+    {
+        used_[i] = 0;
+    }
+}
+
+LogSink::~LogSink()
+{
+    Close();
+}
+
+bool LogSink::Open(const char *path, size_t preallocBytes, int flags, mode_t mode)
+{
+    Close();
+    fd_ = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | flags, mode);
+    if (fd_ < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    size_ = fstat(fd_, &st) == 0 ? st.st_size : 0;
+    allocated_ = size_;
+    prealloc_ = preallocBytes;
+    return true;
+}
+
+void LogSink::Close(void)
+{
+    if (fd_ < 0)
+    {
+        return;
+    }
+    Flush();
+    if (allocated_ > size_)
+    {
+        // KEEP_SIZE预分配的空间在文件末尾之后，截断到实际大小把它释放掉
+        int ret = ftruncate(fd_, size_);
+        (void)ret;
+    }
+    close(fd_);
+    fd_ = -1;
+    size_ = 0;
+    allocated_ = 0;
+}
+
+/**
+ * @brief 写入前确保文件末尾之后还有len字节的预分配空间
+ * 文件系统不支持fallocate时关闭预分配
+ *
+ */
+void LogSink::Reserve_(size_t len)
+{
+    if (prealloc_ == 0 || size_ + static_cast<off_t>(len) <= allocated_)
+    {
+        return;
+    }
+    off_t want = static_cast<off_t>(len > prealloc_ ? len : prealloc_);
+    if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, allocated_, want) == 0)
+    {
+        allocated_ += want;
+    }
+    else
+    {
+        prealloc_ = 0;
+    }
+}
+
+void LogSink::Append(const void *data, size_t len)
+{
+    const char *src = static_cast<const char *>(data);
+    while (len > 0)
+    {
+        if (used_[current_] == CHUNK_SIZE)
+        {
+            if (current_ + 1 == MAX_CHUNKS)
+            {
+                Flush();
+            }
+            else
+            {
+                current_++;
+            }
+        }
+        if (!chunks_[current_])
+        {
+            chunks_[current_].reset(new char[CHUNK_SIZE]);
+        }
+        size_t n = CHUNK_SIZE - used_[current_];
+        n = n < len ? n : len;
+        memcpy(chunks_[current_].get() + used_[current_], src, n);
+        used_[current_] += n;
+        buffered_ += n;
+        src += n;
+        len -= n;
+    }
+}
+
+size_t LogSink::Flush(void)
+{
+    if (buffered_ == 0)
+    {
+        return 0;
+    }
+    size_t total = buffered_;
+    if (fd_ >= 0)
+    {
+        Reserve_(total);
+        struct iovec iov[MAX_CHUNKS];
+        int count = 0;
+        for (int i = 0; i <= current_; i++)
+        {
+            if (used_[i] > 0)
+            {
+                iov[count].iov_base = chunks_[i].get();
+                iov[count].iov_len = used_[i];
+                count++;
+            }
+        }
+        struct iovec *next = iov;
+        size_t left = total;
+        while (left > 0)
+        {
+            ssize_t n = writev(fd_, next, count);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                // 磁盘满等错误，丢弃这一批数据
+                break;
+            }
+            size_ += n;
+            left -= n;
+            // 跳过已经写完的块，部分写入的块调整起始位置
+            while (count > 0 && static_cast<size_t>(n) >= next->iov_len)
+            {
+                n -= next->iov_len;
+                next++;
+                count--;
+            }
+            if (count > 0)
+            {
+                next->iov_base = static_cast<char *>(next->iov_base) + n;
+                next->iov_len -= n;
+            }
+        }
+        total -= left;
+    }
+    for (int i = 0; i <= current_; i++)
+    {
+        used_[i] = 0;
+    }
+    current_ = 0;
+    buffered_ = 0;
+    return total;
+}
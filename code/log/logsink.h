@@ -0,0 +1,74 @@
+/**
+ * @file logsink.h
+ * @brief 日志文件的写入端，合并多行日志后用一次writev写入，并预分配文件空间
+ *
+ */
+#ifndef LOG_SINK_H
+#define LOG_SINK_H
+
+#include <memory>
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+/**
+ * @brief 带缓冲的日志文件
+ * 写入的数据先拷贝到若干固定大小的块中，Flush时所有块用一次writev写入文件
+ * 文件按preallocBytes提前用fallocate分配空间，追加写入时不再逐次分配磁盘块
+ * 不是线程安全的，由Log的mtx_保护
+ *
+ */
+class LogSink
+{
+public:
+    LogSink();
+    ~LogSink();
+    LogSink(const LogSink &) = delete;
+    LogSink &operator=(const LogSink &) = delete;
+
+    /**
+     * @brief 以追加方式打开文件，已打开的文件先关闭
+     *
+     * @param path 文件路径
+     * @param preallocBytes 每次预分配的大小，0表示不预分配
+     * @param flags 附加的open标志，如O_EXCL要求文件必须是新创建的
+     * @param mode 新建文件的权限，创建时即生效，不存在权限过宽的窗口
+     * @return false 打开失败
+     */
+    bool Open(const char *path, size_t preallocBytes, int flags = 0, mode_t mode = 0644);
+    // 写入剩余数据，释放未用完的预分配空间后关闭
+    void Close(void);
+    bool IsOpen(void) const { return fd_ >= 0; }
+
+    // 缓冲区写满时先Flush
+    void Append(const void *data, size_t len);
+    // 把缓冲的数据写入文件，返回写入的字节数
+    size_t Flush(void);
+
+    // 缓冲中还未写入文件的字节数
+    size_t Buffered(void) const { return buffered_; }
+    // 文件大小，包括还在缓冲中的数据
+    uint64_t Size(void) const { return static_cast<uint64_t>(size_) + buffered_; }
+
+private:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+    static const int MAX_CHUNKS = 8;
+
+    void Reserve_(size_t len);
+
+    int fd_;
+    // 已写入文件的大小和已分配空间的末尾
+    off_t size_;
+    off_t allocated_;
+    size_t prealloc_;
+
+    // 块在第一次用到时分配，之后一直复用
+    std::unique_ptr<char[]> chunks_[MAX_CHUNKS];
+    size_t used_[MAX_CHUNKS];
+    int current_;
+    size_t buffered_;
+};
+
+#endif
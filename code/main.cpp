@@ -1,14 +1,38 @@
 #include <unistd.h>
+#include <stdlib.h>
 #include "server/webserver.h"
 
-int main()
+int main(int argc, char *argv[])
 {
+    // ˿ڡETģʽ̳߳иǣѹʱȽϲͬ
+    // ÷server [-p ˿] [-m ģʽ0~3] [-t ߳]
+    int port = 1316;
+    int trigMode = 3;
+    int threadNum = 6;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:m:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'm':
+            trigMode = atoi(optarg);
+            break;
+        case 't':
+            threadNum = atoi(optarg);
+            break;
+        default:
+            return 1;
+        }
+    }
     WebServer server(
         // ˿ڡETģʽtimeoutMs˳?
-        1316, 3, 60000, false,
+        port, trigMode, 60000, false,
         // MySql
         3306, "root", "root", "webserver",
         // ӳ̳߳־ء־ȼ־첽
-        12, 6, true, 1, 1024);
+        12, threadNum, true, 1, 1024);
     server.Start();
 }
\ No newline at end of file
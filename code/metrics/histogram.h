@@ -0,0 +1,170 @@
+/**
+ * @file histogram.h
+ * @brief 对数-线性分桶的直方图，用于统计延迟分布
+ *
+ */
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include "shardedcounter.h"
+
+/**
+ * @brief HDR风格的直方图，每个2的幂区间再均分为SUB_COUNT个桶，相对误差不超过1/SUB_COUNT
+ * 记录只是一次原子加，不分配内存；计数只增不减，需要按时间窗口统计时由读取方对两次快照求差
+ *
+ */
+class Histogram
+{
+public:
+    static const int SUB_BITS = 3;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+
+    Histogram()
+    {
+        for (auto &count : counts_)
+        {
+            count.store(0, std::memory_order_relaxed);
+        }
+        total_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+    }
+
+    void Record(uint64_t value)
+    {
+        counts_[Index(value)].fetch_add(1, std::memory_order_relaxed);
+        total_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint64_t Count(void) const { return total_.load(std::memory_order_relaxed); }
+    uint64_t Sum(void) const { return sum_.load(std::memory_order_relaxed); }
+
+    // 把各桶的累计计数加到counts上，counts的大小需要为BUCKETS
+    void AddTo(std::vector<uint64_t> &counts) const
+    {
+        for (int i = 0; i < BUCKETS; i++)
+        {
+            counts[i] += counts_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    static int Index(uint64_t value)
+    {
+        if (value < 2 * SUB_COUNT)
+        {
+            return static_cast<int>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - SUB_BITS;
+        return ((shift + 1) << SUB_BITS) + static_cast<int>((value >> shift) & (SUB_COUNT - 1));
+    }
+
+    // 第index个桶的下界(包含)
+    static uint64_t LowerBound(int index)
+    {
+        if (index < 2 * SUB_COUNT)
+        {
+            return index;
+        }
+        int shift = (index >> SUB_BITS) - 1;
+        return static_cast<uint64_t>(SUB_COUNT + (index & (SUB_COUNT - 1))) << shift;
+    }
+
+    // 第index个桶的上界(包含)
+    static uint64_t UpperBound(int index)
+    {
+        return index + 1 < BUCKETS ? LowerBound(index + 1) - 1 : UINT64_MAX;
+    }
+
+    /**
+     * @brief 按分桶计数求分位数
+     *
+     * @param counts 各桶计数，大小为BUCKETS
+     * @param quantile 0~1之间的分位
+     * @return uint64_t 分位数所在桶的上界，没有数据返回0
+     */
+    static uint64_t Percentile(const std::vector<uint64_t> &counts, double quantile)
+    {
+        uint64_t total = 0;
+        for (uint64_t count : counts)
+        {
+            total += count;
+        }
+        if (total == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(quantile * total);
+        if (rank >= total)
+        {
+            rank = total - 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++)
+        {
+            seen += counts[i];
+            if (seen > rank)
+            {
+                return UpperBound(i);
+            }
+        }
+        return UpperBound(BUCKETS - 1);
+    }
+
+private:
+    std::atomic<uint64_t> counts_[BUCKETS];
+    std::atomic<uint64_t> total_;
+    std::atomic<uint64_t> sum_;
+};
+
+/**
+ * @brief 按线程分片的直方图，多个线程同时记录时不争用同一组计数
+ * 每个分片约4KB，相邻分片只在边界处可能共用一个缓存行
+ *
+ */
+class ShardedHistogram
+{
+public:
+    static const size_t SHARDS = 8;
+
+    void Record(uint64_t value)
+    {
+        shards_[ShardedCounter::ShardIndex() % SHARDS].Record(value);
+    }
+
+    uint64_t Count(void) const
+    {
+        uint64_t count = 0;
+        for (const auto &shard : shards_)
+        {
+            count += shard.Count();
+        }
+        return count;
+    }
+    uint64_t Sum(void) const
+    {
+        uint64_t sum = 0;
+        for (const auto &shard : shards_)
+        {
+            sum += shard.Sum();
+        }
+        return sum;
+    }
+    void AddTo(std::vector<uint64_t> &counts) const
+    {
+        for (const auto &shard : shards_)
+        {
+            shard.AddTo(counts);
+        }
+    }
+
+private:
+    Histogram shards_[SHARDS];
+};
+
+#endif
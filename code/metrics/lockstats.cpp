@@ -0,0 +1,124 @@
+#include "lockstats.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <new>
+#include "metrics.h"
+
+using namespace std;
+
+bool LockStats::enabled = false;
+
+namespace
+{
+    // 注册表本身用普通互斥锁，只在创建锁和输出报告时访问
+    struct Registry
+    {
+        mutex mtx;
+        vector<LockStats *> all;
+    };
+
+    Registry &GetRegistry(void)
+    {
+        // 不析构，进程退出时其他静态对象中的锁可能还在使用统计
+        static Registry *registry = new Registry;
+        return *registry;
+    }
+
+    struct Summary
+    {
+        LockStats *stats;
+        uint64_t acquired;
+        uint64_t contended;
+        uint64_t waitTotalNs;
+        vector<uint64_t> wait;
+        vector<uint64_t> hold;
+    };
+}
+
+LockStats *LockStats::Get(const char *name)
+{
+    Registry &registry = GetRegistry();
+    lock_guard<mutex> locker(registry.mtx);
+    for (LockStats *stats : registry.all)
+    {
+        if (strcmp(stats->name, name) == 0)
+        {
+            return stats;
+        }
+    }
+    // 分片计数器按缓存行对齐，C++14的new不保证超过默认的对齐
+    void *mem = nullptr;
+    if (posix_memalign(&mem, alignof(LockStats), sizeof(LockStats)) != 0)
+    {
+        throw bad_alloc();
+    }
+    LockStats *stats = new (mem) LockStats(name);
+    registry.all.push_back(stats);
+    return stats;
+}
+
+vector<LockStats *> LockStats::All(void)
+{
+    Registry &registry = GetRegistry();
+    lock_guard<mutex> locker(registry.mtx);
+    return registry.all;
+}
+
+string LockStats::Report(void)
+{
+    vector<Summary> rows;
+    for (LockStats *stats : All())
+    {
+        Summary row{stats, static_cast<uint64_t>(stats->acquired.Load()),
+                    static_cast<uint64_t>(stats->contended.Load()), stats->waitNs.Sum(),
+                    vector<uint64_t>(Histogram::BUCKETS, 0), vector<uint64_t>(Histogram::BUCKETS, 0)};
+        stats->waitNs.AddTo(row.wait);
+        stats->holdNs.AddTo(row.hold);
+        rows.push_back(move(row));
+    }
+    sort(rows.begin(), rows.end(), [](const Summary &a, const Summary &b)
+         { return a.waitTotalNs > b.waitTotalNs; });
+
+    string out;
+    char line[256];
+    snprintf(line, sizeof(line), "%-20s %12s %12s %9s %14s %12s %12s %12s %12s\n",
+             "lock", "acquired", "contended", "contend%", "wait_total_ms",
+             "wait_p50_us", "wait_p99_us", "hold_p50_us", "hold_p99_us");
+    out += line;
+    for (const Summary &row : rows)
+    {
+        snprintf(line, sizeof(line), "%-20s %12llu %12llu %8.2f%% %14.3f %12.3f %12.3f %12.3f %12.3f\n",
+                 row.stats->name, static_cast<unsigned long long>(row.acquired),
+                 static_cast<unsigned long long>(row.contended),
+                 row.acquired ? 100.0 * row.contended / row.acquired : 0.0, row.waitTotalNs / 1e6,
+                 Histogram::Percentile(row.wait, 0.5) / 1e3, Histogram::Percentile(row.wait, 0.99) / 1e3,
+                 Histogram::Percentile(row.hold, 0.5) / 1e3, Histogram::Percentile(row.hold, 0.99) / 1e3);
+        out += line;
+    }
+    if (!enabled)
+    {
+        out += "lock profiling is disabled\n";
+    }
+    return out;
+}
+
+void LockStats::Register(void)
+{
+    static const vector<uint64_t> bounds = {
+        100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+        100000, 250000, 1000000, 10000000, 100000000, 1000000000};
+    Metrics *metrics = Metrics::Instance();
+    for (LockStats *stats : All())
+    {
+        string labels = string("lock=\"") + stats->name + "\"";
+        metrics->AddCounter("webserver_lock_acquired_total", "Lock acquisitions.", labels, &stats->acquired);
+        metrics->AddCounter("webserver_lock_contended_total",
+                            "Lock acquisitions that had to wait.", labels, &stats->contended);
+        metrics->AddHistogram("webserver_lock_wait_seconds", "Time spent waiting for a contended lock.",
+                              labels, &stats->waitNs, 1e-9, bounds);
+        metrics->AddHistogram("webserver_lock_hold_seconds", "Time a lock was held.",
+                              labels, &stats->holdNs, 1e-9, bounds);
+    }
+}
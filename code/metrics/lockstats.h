@@ -0,0 +1,173 @@
+/**
+ * @file lockstats.h
+ * @brief 可统计争用情况的互斥锁和信号量，按锁的名字汇总获取次数、争用次数、等待和持有时间
+ *
+ */
+#ifndef LOCK_STATS_H
+#define LOCK_STATS_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <errno.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include "shardedcounter.h"
+#include "histogram.h"
+
+/**
+ * @brief 一个名字下所有锁的统计，同名的锁(如多个BlockDeque)共用一份
+ * 对象创建后不释放，进程退出时静态对象析构的顺序不会影响仍在使用锁的线程
+ *
+ */
+struct LockStats
+{
+    // 是否统计，关闭时加锁、解锁只多一次判断；由WebServer在创建各模块之前设置
+    static bool enabled;
+
+    const char *name;
+    ShardedCounter acquired;
+    // 第一次尝试没有拿到锁、需要等待的次数
+    ShardedCounter contended;
+    // 以下单位都是ns，等待时间只记录发生争用的获取
+    ShardedHistogram waitNs;
+    ShardedHistogram holdNs;
+
+    explicit LockStats(const char *lockName) : name(lockName) {}
+
+    // 取得名字对应的统计，不存在时创建；name必须是字符串常量
+    static LockStats *Get(const char *name);
+    // 当前所有统计，按创建顺序
+    static std::vector<LockStats *> All(void);
+    // 文本报告，每个锁一行，按总等待时间从大到小排列
+    static std::string Report(void);
+    // 把所有已创建的锁登记到Metrics中，由WebServer在启动时调用一次
+    static void Register(void);
+
+    static int64_t NowNs(void)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+};
+
+/**
+ * @brief 可统计的互斥锁，满足Lockable，可用于lock_guard、unique_lock和condition_variable_any
+ * 先try_lock，成功即为无争用的获取，失败时计时等待
+ * 持有时间从拿到锁到解锁，开启统计后每次获取、释放各读一次时钟
+ *
+ */
+class ProfiledMutex
+{
+public:
+    explicit ProfiledMutex(const char *name) : stats_(LockStats::Get(name)), holdStart_(0) {}
+    ProfiledMutex(const ProfiledMutex &) = delete;
+    ProfiledMutex &operator=(const ProfiledMutex &) = delete;
+
+    void lock(void)
+    {
+        if (!LockStats::enabled)
+        {
+            mtx_.lock();
+            return;
+        }
+        if (!mtx_.try_lock())
+        {
+            int64_t start = LockStats::NowNs();
+            mtx_.lock();
+            holdStart_ = LockStats::NowNs();
+            stats_->contended++;
+            stats_->waitNs.Record(holdStart_ - start);
+        }
+        else
+        {
+            holdStart_ = LockStats::NowNs();
+        }
+        stats_->acquired++;
+    }
+
+    bool try_lock(void)
+    {
+        if (!mtx_.try_lock())
+        {
+            return false;
+        }
+        if (LockStats::enabled)
+        {
+            holdStart_ = LockStats::NowNs();
+            stats_->acquired++;
+        }
+        return true;
+    }
+
+    void unlock(void)
+    {
+        // 开启统计之前拿到的锁没有开始时间
+        if (holdStart_ != 0)
+        {
+            stats_->holdNs.Record(LockStats::NowNs() - holdStart_);
+            holdStart_ = 0;
+        }
+        mtx_.unlock();
+    }
+
+private:
+    std::mutex mtx_;
+    LockStats *stats_;
+    // 只由持有锁的线程读写
+    int64_t holdStart_;
+};
+
+/**
+ * @brief 可统计的计数信号量，只统计等待，信号量没有持有者，不统计持有时间
+ *
+ */
+class ProfiledSemaphore
+{
+public:
+    ProfiledSemaphore(const char *name, unsigned int value) : stats_(LockStats::Get(name))
+    {
+        sem_init(&sem_, 0, value);
+    }
+    ~ProfiledSemaphore() { sem_destroy(&sem_); }
+    ProfiledSemaphore(const ProfiledSemaphore &) = delete;
+    ProfiledSemaphore &operator=(const ProfiledSemaphore &) = delete;
+
+    // 重新设置初始值，只能在没有线程使用时调用
+    void Reset(unsigned int value)
+    {
+        sem_destroy(&sem_);
+        sem_init(&sem_, 0, value);
+    }
+
+    void Wait(void)
+    {
+        if (!LockStats::enabled)
+        {
+            while (sem_wait(&sem_) != 0 && errno == EINTR)
+            {
+            }
+            return;
+        }
+        if (sem_trywait(&sem_) != 0)
+        {
+            int64_t start = LockStats::NowNs();
+            while (sem_wait(&sem_) != 0 && errno == EINTR)
+            {
+            }
+            stats_->contended++;
+            stats_->waitNs.Record(LockStats::NowNs() - start);
+        }
+        stats_->acquired++;
+    }
+
+    void Post(void) { sem_post(&sem_); }
+
+private:
+    sem_t sem_;
+    LockStats *stats_;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <unordered_set>
+
+using namespace std;
+
+namespace
+{
+    void AppendValue(string &out, double value)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.10g", value);
+        out += buf;
+    }
+
+    // 输出指标名和标签，extra为额外的标签，如直方图的le
+    void AppendSeries(string &out, const string &name, const char *suffix,
+                      const string &labels, const string &extra)
+    {
+        out += name;
+        out += suffix;
+        if (!labels.empty() || !extra.empty())
+        {
+            out += '{';
+            out += labels;
+            if (!labels.empty() && !extra.empty())
+            {
+                out += ',';
+            }
+            out += extra;
+            out += '}';
+        }
+        out += ' ';
+    }
+}
+
+Metrics *Metrics::Instance(void)
+{
+    static Metrics inst;
+    return &inst;
+}
+
+const vector<uint64_t> &Metrics::LatencyBoundsUs(void)
+{
+    static const vector<uint64_t> bounds = {
+        50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+        100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000};
+    return bounds;
+}
+
+void Metrics::Add_(Entry &&entry)
+{
+    lock_guard<mutex> locker(mtx_);
+    entries_.push_back(move(entry));
+}
+
+void Metrics::AddCounter(const string &name, const string &help, const string &labels,
+                         const ShardedCounter *counter)
+{
+    Entry entry{name, help, labels, TYPE_COUNTER, counter, nullptr, nullptr, 1.0, {}};
+    Add_(move(entry));
+}
+
+void Metrics::AddGauge(const string &name, const string &help, const string &labels,
+                       function<double()> read)
+{
+    Entry entry{name, help, labels, TYPE_GAUGE, nullptr, move(read), nullptr, 1.0, {}};
+    Add_(move(entry));
+}
+
+void Metrics::AddGaugeSet(const string &name, const string &help, function<void(Samples &)> collect)
+{
+    Entry entry{name, help, "", TYPE_GAUGE, nullptr, nullptr, nullptr, 1.0, {}, move(collect)};
+    Add_(move(entry));
+}
+
+void Metrics::AddCounterFunc(const string &name, const string &help, const string &labels,
+                             function<double()> read)
+{
+    Entry entry{name, help, labels, TYPE_COUNTER, nullptr, move(read), nullptr, 1.0, {}};
+    Add_(move(entry));
+}
+
+void Metrics::AddHistogram(const string &name, const string &help, const string &labels,
+                           const ShardedHistogram *histogram, double unit, const vector<uint64_t> &bounds)
+{
+    Entry entry{name, help, labels, TYPE_HISTOGRAM, nullptr, nullptr, histogram, unit, bounds};
+    Add_(move(entry));
+}
+
+/**
+ * @brief 输出直方图，le为累计计数
+ * 内部的对数-线性桶比输出的桶细，上界不超过le的内部桶都计入该le，误差不超过一个内部桶的宽度
+ *
+ */
+void Metrics::RenderHistogram_(const Entry &entry, string &out)
+{
+    vector<uint64_t> counts(Histogram::BUCKETS, 0);
+    entry.histogram->AddTo(counts);
+    uint64_t total = 0;
+    for (uint64_t count : counts)
+    {
+        total += count;
+    }
+    uint64_t cumulative = 0;
+    int index = 0;
+    for (uint64_t bound : entry.bounds)
+    {
+        while (index < Histogram::BUCKETS && Histogram::UpperBound(index) <= bound)
+        {
+            cumulative += counts[index++];
+        }
+        char le[48];
+        snprintf(le, sizeof(le), "le=\"%.10g\"", bound * entry.unit);
+        AppendSeries(out, entry.name, "_bucket", entry.labels, le);
+        AppendValue(out, static_cast<double>(cumulative));
+        out += '\n';
+    }
+    AppendSeries(out, entry.name, "_bucket", entry.labels, "le=\"+Inf\"");
+    AppendValue(out, static_cast<double>(total));
+    out += '\n';
+    AppendSeries(out, entry.name, "_sum", entry.labels, "");
+    AppendValue(out, entry.histogram->Sum() * entry.unit);
+    out += '\n';
+    AppendSeries(out, entry.name, "_count", entry.labels, "");
+    AppendValue(out, static_cast<double>(total));
+    out += '\n';
+}
+
+string Metrics::Render(void) const
+{
+    static const char *const TYPE_NAMES[] = {"counter", "gauge", "histogram"};
+    string out;
+    lock_guard<mutex> locker(mtx_);
+    unordered_set<string> rendered;
+    for (size_t i = 0; i < entries_.size(); i++)
+    {
+        const string &name = entries_[i].name;
+        if (!rendered.insert(name).second)
+        {
+            continue;
+        }
+        out += "# HELP " + name + " " + entries_[i].help + "\n";
+        out += "# TYPE " + name + " " + TYPE_NAMES[entries_[i].type] + "\n";
+        // 同名的指标连续输出
+        for (size_t j = i; j < entries_.size(); j++)
+        {
+            const Entry &entry = entries_[j];
+            if (entry.name != name)
+            {
+                continue;
+            }
+            if (entry.type == TYPE_HISTOGRAM)
+            {
+                RenderHistogram_(entry, out);
+                continue;
+            }
+            if (entry.collect)
+            {
+                Samples samples;
+                entry.collect(samples);
+                for (const auto &sample : samples)
+                {
+                    AppendSeries(out, entry.name, "", sample.first, "");
+                    AppendValue(out, sample.second);
+                    out += '\n';
+                }
+                continue;
+            }
+            AppendSeries(out, entry.name, "", entry.labels, "");
+            AppendValue(out, entry.counter ? static_cast<double>(entry.counter->Load()) : entry.read());
+            out += '\n';
+        }
+    }
+    return out;
+}
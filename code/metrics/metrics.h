@@ -0,0 +1,94 @@
+/**
+ * @file metrics.h
+ * @brief 指标注册表，抓取时汇总各分片并输出Prometheus文本格式
+ *
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+#include <utility>
+#include <stdint.h>
+#include "shardedcounter.h"
+#include "histogram.h"
+
+/**
+ * @brief 指标注册表
+ * 计数器和直方图由使用方以静态对象持有，记录时不经过注册表，只有抓取时才读取；
+ * 仪表在抓取时调用注册的函数取值
+ * 同名的指标按标签区分，输出时HELP、TYPE只写一次
+ *
+ */
+class Metrics
+{
+public:
+    static Metrics *Instance(void);
+
+    /**
+     * @brief 注册计数器
+     *
+     * @param name 指标名，如http_requests_total
+     * @param help 说明
+     * @param labels 标签，如code="200"，可以为空
+     * @param counter 计数器，需在进程内一直有效
+     */
+    void AddCounter(const std::string &name, const std::string &help, const std::string &labels,
+                    const ShardedCounter *counter);
+    // 仪表，抓取时调用read取值
+    void AddGauge(const std::string &name, const std::string &help, const std::string &labels,
+                  std::function<double()> read);
+    // 一组标签在抓取时才确定的仪表，如热点路径，collect输出(标签, 值)，标签如path="/index.html"
+    typedef std::vector<std::pair<std::string, double>> Samples;
+    void AddGaugeSet(const std::string &name, const std::string &help, std::function<void(Samples &)> collect);
+    // 按函数取值的计数器，用于已有的累计统计
+    void AddCounterFunc(const std::string &name, const std::string &help, const std::string &labels,
+                        std::function<double()> read);
+    /**
+     * @brief 注册直方图
+     *
+     * @param unit 记录值换算成输出单位的系数，如记录us、输出秒时为1e-6
+     * @param bounds 输出的桶上界，单位和记录值相同，按升序排列
+     */
+    void AddHistogram(const std::string &name, const std::string &help, const std::string &labels,
+                      const ShardedHistogram *histogram, double unit, const std::vector<uint64_t> &bounds);
+
+    // 输出所有指标
+    std::string Render(void) const;
+
+    // 延迟直方图默认的桶上界，单位us，50us~10s
+    static const std::vector<uint64_t> &LatencyBoundsUs(void);
+
+private:
+    enum METRIC_TYPE
+    {
+        TYPE_COUNTER,
+        TYPE_GAUGE,
+        TYPE_HISTOGRAM,
+    };
+
+    struct Entry
+    {
+        std::string name;
+        std::string help;
+        std::string labels;
+        METRIC_TYPE type;
+        const ShardedCounter *counter;
+        std::function<double()> read;
+        const ShardedHistogram *histogram;
+        double unit;
+        std::vector<uint64_t> bounds;
+        std::function<void(Samples &)> collect;
+    };
+
+    Metrics() = default;
+    void Add_(Entry &&entry);
+    static void RenderHistogram_(const Entry &entry, std::string &out);
+
+    mutable std::mutex mtx_;
+    std::vector<Entry> entries_;
+};
+
+#endif
@@ -0,0 +1,70 @@
+/**
+ * @file probes.h
+ * @brief USDT静态探针，供perf、bpftrace在不重新编译的情况下挂载
+ *
+ * 探针的提供者为webserver，如bpftrace中的usdt:./bin/server:webserver:parse_done
+ * 有sys/sdt.h(systemtap-sdt-dev)时编译为一条nop指令和ELF notes中的探针描述，没有挂载时只有这条nop；
+ * 没有sys/sdt.h或定义了NO_USDT时探针为空，参数不会求值，所以参数不能有副作用
+ * 参数只用整数和指针(字符串用c_str())，最多4个
+ *
+ * 探针列表：
+ *   loop_wakeup(int events)                       epoll_wait返回
+ *   event_dispatch(int fd, uint32_t events)        分发一个事件
+ *   conn_open(int fd, uint32_t ip, int port)       新连接，ip为网络字节序
+ *   conn_close(int fd)                             关闭连接
+ *   parse_start(size_t bytes)                      开始解析请求，bytes为缓冲区中的字节数
+ *   parse_done(int ok, const char *method, const char *path)
+ *   verify_start(const char *user, int isLogin)    登录、注册访问数据库
+ *   verify_done(int isLogin, int ok)
+ *   write_start(int fd, size_t bytes)              HttpConn::write，bytes为待发送字节数
+ *   write_done(int fd, ssize_t len, int err)
+ *   timer_tick(int expired, size_t remaining)      定时器处理到期节点
+ *   pool_enqueue(void *pool, size_t queue, int ok) 线程池提交任务
+ *   task_start(void *pool, size_t worker, int64_t waitUs)  开始执行任务，未统计排队时间时waitUs为-1
+ *   task_done(void *pool, size_t worker)
+ */
+#ifndef PROBES_H
+#define PROBES_H
+
+#if !defined(NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define HAVE_USDT 1
+#endif
+#endif
+
+#ifdef HAVE_USDT
+#include <sys/sdt.h>
+#define USDT_PROBE0(name) DTRACE_PROBE(webserver, name)
+#define USDT_PROBE1(name, a) DTRACE_PROBE1(webserver, name, a)
+#define USDT_PROBE2(name, a, b) DTRACE_PROBE2(webserver, name, a, b)
+#define USDT_PROBE3(name, a, b, c) DTRACE_PROBE3(webserver, name, a, b, c)
+#define USDT_PROBE4(name, a, b, c, d) DTRACE_PROBE4(webserver, name, a, b, c, d)
+#else
+// sizeof不对参数求值，只是让只给探针用的变量不产生未使用的警告
+#define USDT_PROBE0(name) \
+    do                    \
+    {                     \
+    } while (0)
+#define USDT_PROBE1(name, a) \
+    do                       \
+    {                        \
+        (void)sizeof(a);     \
+    } while (0)
+#define USDT_PROBE2(name, a, b)           \
+    do                                    \
+    {                                     \
+        (void)sizeof(a), (void)sizeof(b); \
+    } while (0)
+#define USDT_PROBE3(name, a, b, c)                         \
+    do                                                     \
+    {                                                      \
+        (void)sizeof(a), (void)sizeof(b), (void)sizeof(c); \
+    } while (0)
+#define USDT_PROBE4(name, a, b, c, d)                                       \
+    do                                                                      \
+    {                                                                       \
+        (void)sizeof(a), (void)sizeof(b), (void)sizeof(c), (void)sizeof(d); \
+    } while (0)
+#endif
+
+#endif
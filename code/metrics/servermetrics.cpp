@@ -0,0 +1,46 @@
+#include "servermetrics.h"
+
+using namespace std;
+
+const int ServerMetrics::STATUS_CODES[ServerMetrics::STATUS_COUNT] = {200, 400, 403, 404, 503, 0};
+
+bool ServerMetrics::enabled = false;
+ShardedCounter ServerMetrics::accepted;
+ShardedCounter ServerMetrics::rejected;
+ShardedCounter ServerMetrics::bytesOut;
+ShardedCounter ServerMetrics::responses[ServerMetrics::STATUS_COUNT];
+ShardedHistogram ServerMetrics::parseUs;
+ShardedHistogram ServerMetrics::dbUs;
+ShardedHistogram ServerMetrics::requestUs;
+ShardedHistogram ServerMetrics::stageUs[ServerMetrics::STAGE_COUNT];
+
+void ServerMetrics::Register(void)
+{
+    static const char *const STAGE_NAMES[STAGE_COUNT] = {"recv", "queue", "handle", "send"};
+    Metrics *metrics = Metrics::Instance();
+    const vector<uint64_t> &bounds = Metrics::LatencyBoundsUs();
+
+    metrics->AddCounter("webserver_accepted_connections_total", "Accepted TCP connections.", "", &accepted);
+    metrics->AddCounter("webserver_rejected_connections_total",
+                        "Connections rejected because the connection table is full.", "", &rejected);
+    metrics->AddCounter("webserver_sent_bytes_total", "Bytes written to clients.", "", &bytesOut);
+    for (int i = 0; i < STATUS_COUNT; i++)
+    {
+        string labels = STATUS_CODES[i] ? "code=\"" + to_string(STATUS_CODES[i]) + "\"" : "code=\"other\"";
+        metrics->AddCounter("webserver_http_responses_total", "Completed HTTP responses by status code.",
+                            labels, &responses[i]);
+    }
+    metrics->AddHistogram("webserver_http_request_duration_seconds",
+                          "Time from the first request byte to the last response byte.", "",
+                          &requestUs, 1e-6, bounds);
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        metrics->AddHistogram("webserver_http_request_stage_seconds",
+                              "Time spent in each request stage.",
+                              string("stage=\"") + STAGE_NAMES[i] + "\"", &stageUs[i], 1e-6, bounds);
+    }
+    metrics->AddHistogram("webserver_http_parse_seconds", "Time spent parsing request messages.", "",
+                          &parseUs, 1e-6, bounds);
+    metrics->AddHistogram("webserver_db_verify_seconds", "Time spent verifying login and register forms.", "",
+                          &dbUs, 1e-6, bounds);
+}
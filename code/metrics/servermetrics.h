@@ -0,0 +1,63 @@
+/**
+ * @file servermetrics.h
+ * @brief 服务器各模块记录的指标
+ *
+ */
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+#include <stdint.h>
+#include "shardedcounter.h"
+#include "histogram.h"
+#include "metrics.h"
+
+/**
+ * @brief 服务器指标，都是静态对象，记录时不查表、不加锁
+ * 关闭时不读取时钟也不记录，开启后每次记录是一次分片上的原子加
+ *
+ */
+struct ServerMetrics
+{
+    // 请求各阶段，和访问日志中的阶段相同
+    enum REQUEST_STAGE
+    {
+        STAGE_RECV,
+        STAGE_QUEUE,
+        STAGE_HANDLE,
+        STAGE_SEND,
+        STAGE_COUNT,
+    };
+
+    // 单独计数的状态码，其余计入最后一项
+    static const int STATUS_CODES[];
+    static const int STATUS_COUNT = 6;
+
+    static bool enabled;
+
+    static ShardedCounter accepted;
+    // 连接表已满被拒绝的连接
+    static ShardedCounter rejected;
+    static ShardedCounter bytesOut;
+    static ShardedCounter responses[STATUS_COUNT];
+
+    // 以下单位都是us
+    static ShardedHistogram parseUs;
+    static ShardedHistogram dbUs;
+    static ShardedHistogram requestUs;
+    static ShardedHistogram stageUs[STAGE_COUNT];
+
+    static void RecordStatus(int code)
+    {
+        int i = 0;
+        while (i < STATUS_COUNT - 1 && STATUS_CODES[i] != code)
+        {
+            i++;
+        }
+        responses[i]++;
+    }
+
+    // 把以上指标登记到Metrics中，由WebServer在启动时调用一次
+    static void Register(void);
+};
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * @file shardedcounter.h
+ * @brief 按线程分片的计数器
+ *
+ */
+#ifndef SHARDED_COUNTER_H
+#define SHARDED_COUNTER_H
+
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * @brief 每个线程固定写自己的分片，分片按缓存行对齐，写操作之间没有伪共享
+ * 读取时把所有分片相加，适合写多读少的统计量
+ *
+ */
+class ShardedCounter
+{
+public:
+    static const size_t SHARDS = 32;
+
+    ShardedCounter() { Reset(); }
+
+    void Add(long n)
+    {
+        shards_[ShardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    ShardedCounter &operator++(int)
+    {
+        Add(1);
+        return *this;
+    }
+    ShardedCounter &operator--(int)
+    {
+        Add(-1);
+        return *this;
+    }
+
+    // 各分片之和，并发写入时只是近似的瞬时值
+    long Load(void) const
+    {
+        long sum = 0;
+        for (size_t i = 0; i < SHARDS; i++)
+        {
+            sum += shards_[i].value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    // 只能在没有并发写入时调用
+    void Reset(void)
+    {
+        for (size_t i = 0; i < SHARDS; i++)
+        {
+            shards_[i].value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 当前线程的分片下标，线程第一次调用时按顺序分配
+     *
+     */
+    static size_t ShardIndex(void)
+    {
+        static std::atomic<size_t> next(0);
+        thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+        return index;
+    }
+
+private:
+    struct alignas(64) Shard
+    {
+        std::atomic<long> value;
+    };
+    Shard shards_[SHARDS];
+};
+
+#endif
@@ -0,0 +1,328 @@
+#include "topk.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <arpa/inet.h>
+#include "metrics.h"
+
+using namespace std;
+
+const size_t HotSpots::MAX_PATH;
+bool HotSpots::enabled = false;
+TopK *HotSpots::paths = nullptr;
+TopK *HotSpots::peers = nullptr;
+int64_t HotSpots::decayMs_ = 0;
+std::atomic<int64_t> HotSpots::nextDecayMs_(0);
+
+namespace
+{
+    // FNV-1a
+    uint64_t Hash(const char *key, size_t len)
+    {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < len; i++)
+        {
+            h ^= static_cast<unsigned char>(key[i]);
+            h *= 0x100000001b3ull;
+        }
+        return h;
+    }
+
+    string PeerName(const string &key)
+    {
+        char ip[INET_ADDRSTRLEN] = "-";
+        if (key.size() == 4)
+        {
+            inet_ntop(AF_INET, key.data(), ip, sizeof(ip));
+        }
+        return ip;
+    }
+
+    // Prometheus标签值中的\、"和换行需要转义
+    string LabelValue(const string &value)
+    {
+        string out;
+        for (char c : value)
+        {
+            if (c == '\\' || c == '"')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (c == '\n')
+            {
+                out += "\\n";
+            }
+            else
+            {
+                out += c;
+            }
+        }
+        return out;
+    }
+}
+
+TopK::TopK(const char *lockName, size_t k, size_t width, size_t depth)
+    : k_(k > 0 ? k : 1), depth_(depth > 0 ? depth : 1), total_(0), floor_(0), mtx_(lockName)
+{
+    size_t cap = 64;
+    while (cap < width)
+    {
+        cap <<= 1;
+    }
+    mask_ = cap - 1;
+    counters_.reset(new atomic<uint32_t>[cap * depth_]);
+    for (size_t i = 0; i < cap * depth_; i++)
+    {
+        counters_[i].store(0, memory_order_relaxed);
+    }
+    heap_.reserve(k_);
+}
+
+size_t TopK::Index_(uint64_t hash, size_t row) const
+{
+    uint32_t h1 = static_cast<uint32_t>(hash);
+    uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+    return row * (mask_ + 1) + ((h1 + row * h2) & mask_);
+}
+
+void TopK::Add(const char *key, size_t len)
+{
+    uint64_t hash = Hash(key, len);
+    uint32_t estimate = UINT32_MAX;
+    for (size_t row = 0; row < depth_; row++)
+    {
+        estimate = min(estimate, counters_[Index_(hash, row)].fetch_add(1, memory_order_relaxed) + 1);
+    }
+    total_.fetch_add(1, memory_order_relaxed);
+    // 堆满后只有不低于堆顶的键才可能进入或留在堆中；
+    // 次数较多的键每8次才更新一次堆，热点不会每次都去抢锁，堆中的次数在Top时重新估计
+    if (estimate >= floor_.load(memory_order_relaxed) && (estimate < 64 || (estimate & 7) == 0))
+    {
+        Offer_(key, len, estimate);
+    }
+}
+
+uint32_t TopK::Estimate_(const std::string &key) const
+{
+    uint64_t hash = Hash(key.data(), key.size());
+    uint32_t estimate = UINT32_MAX;
+    for (size_t row = 0; row < depth_; row++)
+    {
+        estimate = min(estimate, counters_[Index_(hash, row)].load(memory_order_relaxed));
+    }
+    return estimate;
+}
+
+void TopK::Offer_(const char *key, size_t len, uint32_t estimate)
+{
+    unique_lock<ProfiledMutex> locker(mtx_, try_to_lock);
+    if (!locker.owns_lock())
+    {
+        return;
+    }
+    string name(key, len);
+    auto it = ref_.find(name);
+    if (it != ref_.end())
+    {
+        // 次数变大，在小顶堆中下移
+        if (estimate > heap_[it->second].count)
+        {
+            heap_[it->second].count = estimate;
+            Siftdown_(it->second);
+        }
+    }
+    else if (heap_.size() < k_)
+    {
+        ref_[name] = heap_.size();
+        heap_.push_back({move(name), estimate});
+        Siftup_(heap_.size() - 1);
+    }
+    else if (estimate > heap_[0].count)
+    {
+        // 替换堆顶
+        ref_.erase(heap_[0].key);
+        ref_[name] = 0;
+        heap_[0] = {move(name), estimate};
+        Siftdown_(0);
+    }
+    if (heap_.size() >= k_)
+    {
+        floor_.store(static_cast<uint32_t>(heap_[0].count), memory_order_relaxed);
+    }
+}
+
+vector<TopK::Item> TopK::Top(void) const
+{
+    vector<Item> items;
+    {
+        lock_guard<ProfiledMutex> locker(mtx_);
+        items = heap_;
+    }
+    for (Item &item : items)
+    {
+        item.count = Estimate_(item.key);
+    }
+    sort(items.begin(), items.end(), [](const Item &a, const Item &b)
+         { return a.count > b.count; });
+    return items;
+}
+
+void TopK::Decay(void)
+{
+    for (size_t i = 0; i < (mask_ + 1) * depth_; i++)
+    {
+        counters_[i].store(counters_[i].load(memory_order_relaxed) >> 1, memory_order_relaxed);
+    }
+    total_.store(total_.load(memory_order_relaxed) >> 1, memory_order_relaxed);
+    lock_guard<ProfiledMutex> locker(mtx_);
+    // 所有次数同时减半，堆的顺序不变
+    for (Item &item : heap_)
+    {
+        item.count >>= 1;
+    }
+    floor_.store(heap_.size() >= k_ ? static_cast<uint32_t>(heap_[0].count) : 0, memory_order_relaxed);
+}
+
+void TopK::Siftup_(size_t i)
+{
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (heap_[parent].count <= heap_[i].count)
+        {
+            break;
+        }
+        Swap_(i, parent);
+        i = parent;
+    }
+}
+
+void TopK::Siftdown_(size_t i)
+{
+    size_t n = heap_.size();
+    while (true)
+    {
+        size_t child = i * 2 + 1;
+        if (child >= n)
+        {
+            break;
+        }
+        if (child + 1 < n && heap_[child + 1].count < heap_[child].count)
+        {
+            child++;
+        }
+        if (heap_[i].count <= heap_[child].count)
+        {
+            break;
+        }
+        Swap_(i, child);
+        i = child;
+    }
+}
+
+void TopK::Swap_(size_t i, size_t j)
+{
+    swap(heap_[i], heap_[j]);
+    ref_[heap_[i].key] = i;
+    ref_[heap_[j].key] = j;
+}
+
+void HotSpots::Init(const HotSpotConfig &config)
+{
+    enabled = config.enabled;
+    if (!enabled)
+    {
+        return;
+    }
+    // 和LockStats一样不释放，进程退出时仍在记录的线程不会访问已析构的对象
+    paths = new TopK("hotspots.paths", config.k, config.width, config.depth);
+    peers = new TopK("hotspots.peers", config.k, config.width, config.depth);
+    decayMs_ = config.decaySec > 0 ? static_cast<int64_t>(config.decaySec) * 1000 : 0;
+    nextDecayMs_ = 0;
+}
+
+void HotSpots::Record(const string &path, uint32_t ip, int64_t nowMs)
+{
+    if (decayMs_ > 0)
+    {
+        int64_t next = nextDecayMs_.load(memory_order_relaxed);
+        if (next == 0)
+        {
+            nextDecayMs_.compare_exchange_strong(next, nowMs + decayMs_, memory_order_relaxed);
+        }
+        else if (nowMs >= next && nextDecayMs_.compare_exchange_strong(next, nowMs + decayMs_, memory_order_relaxed))
+        {
+            paths->Decay();
+            peers->Decay();
+        }
+    }
+    if (!path.empty())
+    {
+        size_t len = min(path.find('?'), min(path.size(), MAX_PATH));
+        paths->Add(path.data(), len);
+    }
+    peers->Add(reinterpret_cast<const char *>(&ip), sizeof(ip));
+}
+
+string HotSpots::Report(size_t limit, bool withPeers)
+{
+    string out;
+    if (!enabled)
+    {
+        return "hot spots disabled\n";
+    }
+    char line[256];
+    const TopK *tables[] = {paths, peers};
+    const char *names[] = {"paths", "peers"};
+    for (int t = 0; t < (withPeers ? 2 : 1); t++)
+    {
+        uint64_t total = tables[t]->Total();
+        snprintf(line, sizeof(line), "%s: total %llu\n", names[t], static_cast<unsigned long long>(total));
+        out += line;
+        vector<TopK::Item> items = tables[t]->Top();
+        for (size_t i = 0; i < items.size() && i < limit; i++)
+        {
+            string key = t == 0 ? items[i].key : PeerName(items[i].key);
+            snprintf(line, sizeof(line), "%12llu %6.2f%%  %s\n", static_cast<unsigned long long>(items[i].count),
+                     total > 0 ? 100.0 * items[i].count / total : 0.0, key.c_str());
+            out += line;
+        }
+    }
+    return out;
+}
+
+void HotSpots::Register(void)
+{
+    if (!enabled)
+    {
+        return;
+    }
+    Metrics *metrics = Metrics::Instance();
+    metrics->AddGaugeSet("webserver_hot_path_requests", "Estimated recent requests of the hottest paths.",
+                         [](Metrics::Samples &samples)
+                         {
+                             for (const TopK::Item &item : paths->Top())
+                             {
+                                 samples.emplace_back("path=\"" + LabelValue(item.key) + "\"",
+                                                      static_cast<double>(item.count));
+                             }
+                         });
+}
+
+void HotSpots::RegisterPeers(void)
+{
+    if (!enabled)
+    {
+        return;
+    }
+    Metrics::Instance()->AddGaugeSet("webserver_hot_peer_requests", "Estimated recent requests of the busiest clients.",
+                         [](Metrics::Samples &samples)
+                         {
+                             for (const TopK::Item &item : peers->Top())
+                             {
+                                 samples.emplace_back("peer=\"" + PeerName(item.key) + "\"",
+                                                      static_cast<double>(item.count));
+                             }
+                         });
+}
@@ -0,0 +1,120 @@
+/**
+ * @file topk.h
+ * @brief 用count-min sketch加小顶堆流式统计出现次数最多的K个键，如请求路径、客户端地址
+ *
+ */
+#ifndef TOP_K_H
+#define TOP_K_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "lockstats.h"
+#include "../config/config.h"
+
+/**
+ * @brief 流式top-K
+ * 每次记录先在sketch的每一行各做一次原子加，取各行中的最小值作为估计次数，不加锁；
+ * 只有估计次数超过堆中最小值(或堆未满)时才尝试加锁更新堆，锁被占用时直接跳过，
+ * 该键下次记录时会再次尝试，所以记录处永远不会等待
+ * 估计值只会偏大，偏大的幅度约为总次数的e/width，超出这个幅度的概率约为e^-depth
+ *
+ */
+class TopK
+{
+public:
+    struct Item
+    {
+        std::string key;
+        uint64_t count;
+    };
+
+    /**
+     * @brief 创建统计
+     *
+     * @param lockName 堆的锁在锁统计中的名字，必须是字符串常量
+     * @param k 保留的键的数量
+     * @param width sketch每行的计数器数量，向上取整为2的幂
+     * @param depth sketch的行数
+     */
+    TopK(const char *lockName, size_t k, size_t width, size_t depth);
+    TopK(const TopK &) = delete;
+    TopK &operator=(const TopK &) = delete;
+
+    // 记录一次，key可以包含任意字节
+    void Add(const char *key, size_t len);
+    // 堆中的键，按次数从大到小排列
+    std::vector<Item> Top(void) const;
+    // 记录的总次数，衰减时同样减半
+    uint64_t Total(void) const { return total_.load(std::memory_order_relaxed); }
+    // 所有计数减半，统计结果偏向最近的流量；和Add并发时少数记录可能丢失
+    void Decay(void);
+
+private:
+    // 第row行中键对应的计数器下标，各行的下标由哈希的高低32位按双重哈希生成
+    size_t Index_(uint64_t hash, size_t row) const;
+    uint32_t Estimate_(const std::string &key) const;
+    void Offer_(const char *key, size_t len, uint32_t estimate);
+    void Siftup_(size_t i);
+    void Siftdown_(size_t i);
+    void Swap_(size_t i, size_t j);
+
+    size_t k_;
+    size_t depth_;
+    size_t mask_;
+    std::unique_ptr<std::atomic<uint32_t>[]> counters_;
+    std::atomic<uint64_t> total_;
+    // 堆满时堆顶的次数，记录处不加锁读取，判断是否需要更新堆
+    std::atomic<uint32_t> floor_;
+
+    mutable ProfiledMutex mtx_;
+    // 按次数的小顶堆，ref_为键在堆中的下标
+    std::vector<Item> heap_;
+    std::unordered_map<std::string, size_t> ref_;
+};
+
+/**
+ * @brief 服务器的热点统计：请求最多的路径和客户端地址
+ * 由HttpConn在开始生成响应时记录，关闭时记录处只有一次判断
+ *
+ */
+struct HotSpots
+{
+    // 超过该长度的路径截断后统计
+    static const size_t MAX_PATH = 128;
+
+    static bool enabled;
+    static TopK *paths;
+    // 键为网络字节序的4字节IPv4地址
+    static TopK *peers;
+
+    // 按配置创建统计，由WebServer在启动时调用一次
+    static void Init(const HotSpotConfig &config);
+    /**
+     * @brief 记录一个请求
+     *
+     * @param path 请求路径，查询参数不计入，为空时只记录地址
+     * @param ip 客户端地址，网络字节序
+     * @param nowMs 单调时钟ms，到了衰减时间的记录者负责衰减
+     */
+    static void Record(const std::string &path, uint32_t ip, int64_t nowMs);
+    /**
+     * @brief 文本报告，每类最多列出limit个
+     *
+     * @param withPeers 是否列出客户端地址，管理接口经过主端口提供时不应列出
+     */
+    static std::string Report(size_t limit, bool withPeers);
+    // 登记webserver_hot_path_requests指标，由WebServer在启动时调用一次
+    static void Register(void);
+    // 登记webserver_hot_peer_requests指标，只在管理接口单独监听时调用一次
+    static void RegisterPeers(void);
+
+private:
+    static int64_t decayMs_;
+    static std::atomic<int64_t> nextDecayMs_;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "tracer.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+bool RequestTracer::enabled = false;
+
+namespace
+{
+    // 以结束阶段命名的时间段，STAGE_BEGIN没有对应的时间段
+    const char *const SPAN_NAMES[RequestTracer::STAGE_COUNT] = {
+        "", "wait", "queue", "recv", "dispatch", "handle", "send_wait", "send"};
+
+    void AppendEscaped(string &out, const char *str)
+    {
+        for (const char *p = str; *p; p++)
+        {
+            unsigned char c = static_cast<unsigned char>(*p);
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += static_cast<char>(c);
+            }
+            else if (c < 0x20)
+            {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            }
+            else
+            {
+                out += static_cast<char>(c);
+            }
+        }
+    }
+
+    void AppendEvent(string &out, const char *name, int64_t begin, int64_t end, int tid)
+    {
+        char buf[160];
+        snprintf(buf, sizeof(buf), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld}",
+                 name, tid, static_cast<long long>(begin), static_cast<long long>(end - begin));
+        out += buf;
+    }
+}
+
+RequestTracer::RequestTracer() : threshold_(0), nextId_(0), head_(0), count_(0)
+{
+}
+
+RequestTracer *RequestTracer::Instance(void)
+{
+    static RequestTracer inst;
+    return &inst;
+}
+
+void RequestTracer::Init(double sampleRate, size_t capacity)
+{
+    lock_guard<mutex> locker(mtx_);
+    threshold_ = sampleRate >= 1.0 ? (1ull << 32) : (sampleRate > 0 ? static_cast<uint64_t>(sampleRate * (1ull << 32)) : 0);
+    ring_.assign(capacity > 0 ? capacity : 1, Record());
+    head_ = 0;
+    count_ = 0;
+    enabled = threshold_ > 0;
+}
+
+bool RequestTracer::Sample(void) const
+{
+    // xorshift64，每个线程独立的随机数序列
+    thread_local uint64_t seed = reinterpret_cast<uintptr_t>(&seed) * 0x9E3779B97F4A7C15ull | 1;
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return (seed >> 32) < threshold_;
+}
+
+void RequestTracer::Submit(Record &record)
+{
+    record.id = nextId_.fetch_add(1, memory_order_relaxed);
+    lock_guard<mutex> locker(mtx_);
+    ring_[head_] = record;
+    head_ = (head_ + 1) % ring_.size();
+    if (count_ < ring_.size())
+    {
+        count_++;
+    }
+}
+
+string RequestTracer::ExportChromeJson(bool clear)
+{
+    vector<Record> records;
+    {
+        lock_guard<mutex> locker(mtx_);
+        records.reserve(count_);
+        // 从最旧的记录开始
+        size_t start = (head_ + ring_.size() - count_) % ring_.size();
+        for (size_t i = 0; i < count_; i++)
+        {
+            records.push_back(ring_[(start + i) % ring_.size()]);
+        }
+        if (clear)
+        {
+            count_ = 0;
+        }
+    }
+
+    string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"webserver\"}}";
+    for (const Record &record : records)
+    {
+        int64_t begin = record.us[STAGE_BEGIN];
+        int64_t end = record.us[STAGE_COMPLETED];
+        if (begin == 0 || end < begin)
+        {
+            continue;
+        }
+        // 整个请求是外层事件，各阶段嵌套在其中，同一连接的请求显示在同一行
+        char buf[160];
+        snprintf(buf, sizeof(buf),
+                 ",\n{\"name\":\"request\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld,"
+                 "\"args\":{\"id\":%llu,\"status\":%d,\"path\":\"",
+                 record.fd, static_cast<long long>(begin), static_cast<long long>(end - begin),
+                 static_cast<unsigned long long>(record.id), record.status);
+        out += buf;
+        AppendEscaped(out, record.path);
+        out += "\"}}";
+        int64_t prev = begin;
+        for (int stage = STAGE_BEGIN + 1; stage < STAGE_COUNT; stage++)
+        {
+            int64_t now = record.us[stage];
+            if (now == 0 || now < prev)
+            {
+                continue;
+            }
+            AppendEvent(out, SPAN_NAMES[stage], prev, now, record.fd);
+            prev = now;
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
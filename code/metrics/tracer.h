@@ -0,0 +1,97 @@
+/**
+ * @file tracer.h
+ * @brief 按采样率记录请求各阶段的时间点，保存在环形缓冲区中，可导出为Chrome trace JSON
+ *
+ */
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief 请求追踪
+ * 每个请求开始时决定是否采样，只有被采样的请求才读取时钟；请求完成时把记录放入环形缓冲区，
+ * 缓冲区满后覆盖最旧的记录。导出的JSON可以直接在chrome://tracing或Perfetto中打开
+ *
+ */
+class RequestTracer
+{
+public:
+    // 请求经过的阶段，按时间先后排列
+    enum TRACE_STAGE
+    {
+        // 新连接建立，或keep-alive连接开始下一个请求
+        STAGE_BEGIN = 0,
+        // 主线程收到读事件
+        STAGE_READABLE,
+        // 工作线程取出读任务
+        STAGE_DEQUEUED,
+        // 解析出完整请求
+        STAGE_PARSED,
+        // 开始生成响应，转交其他通道时为该通道取出任务的时间
+        STAGE_HANDLE_START,
+        // 响应生成完毕
+        STAGE_HANDLED,
+        // 第一次写出数据
+        STAGE_FIRST_WRITE,
+        // 响应发送完毕
+        STAGE_COMPLETED,
+        STAGE_COUNT,
+    };
+
+    static const size_t PATH_LEN = 64;
+
+    // 一个请求的追踪记录，未经过的阶段为0
+    struct Record
+    {
+        uint64_t id;
+        int fd;
+        int status;
+        char path[PATH_LEN];
+        int64_t us[STAGE_COUNT];
+    };
+
+    // 是否开启追踪，关闭时记录处只有这一次判断
+    static bool enabled;
+
+    static RequestTracer *Instance(void);
+
+    /**
+     * @brief 开启追踪
+     *
+     * @param sampleRate 采样率，0~1
+     * @param capacity 环形缓冲区能保存的请求数
+     */
+    void Init(double sampleRate, size_t capacity);
+    // 当前请求是否采样
+    bool Sample(void) const;
+    // 保存一个已完成请求的记录
+    void Submit(Record &record);
+
+    /**
+     * @brief 把缓冲区中的记录导出为Chrome trace JSON，每个阶段是一个完整事件，同一连接的请求在同一行
+     *
+     * @param clear 导出后清空缓冲区
+     */
+    std::string ExportChromeJson(bool clear);
+
+    uint64_t Submitted(void) const { return nextId_.load(std::memory_order_relaxed); }
+
+private:
+    RequestTracer();
+
+    // 采样阈值，32位随机数小于阈值时采样
+    uint64_t threshold_;
+    std::atomic<uint64_t> nextId_;
+    // 只保存被采样的请求，用互斥锁即可
+    std::mutex mtx_;
+    std::vector<Record> ring_;
+    size_t head_;
+    size_t count_;
+};
+
+#endif
@@ -0,0 +1,127 @@
+/**
+ * @file inlinetask.h
+ * @brief 定长、只能移动的任务类型，可调用对象直接存放在对象内部
+ *
+ */
+#ifndef INLINE_TASK_H
+#define INLINE_TASK_H
+
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+#include <assert.h>
+
+/**
+ * @brief 代替std::function<void()>作为线程池的任务类型
+ * std::function捕获的对象超过内部缓冲区(libstdc++为16字节)时会在堆上分配，
+ * InlineTask固定使用CAPACITY字节的内部存储，放不下的可调用对象在编译期报错，
+ * 构造、移动、销毁都不会分配内存，放进预先分配好的环形队列后提交任务不会访问堆
+ *
+ */
+class InlineTask
+{
+public:
+    // 加上函数表指针共48字节，线程池队列槽再加上入队时间和序号正好占一个缓存行
+    static const size_t CAPACITY = 40;
+
+    InlineTask() noexcept : ops_(nullptr) {}
+    InlineTask(std::nullptr_t) noexcept : ops_(nullptr) {}
+
+    template <class F, class Fn = typename std::decay<F>::type,
+              class = typename std::enable_if<!std::is_same<Fn, InlineTask>::value>::type>
+    InlineTask(F &&func) : ops_(nullptr)
+    {
+        static_assert(sizeof(Fn) <= CAPACITY, "task is too large for InlineTask");
+        static_assert(alignof(Fn) <= alignof(Storage), "task alignment is too large for InlineTask");
+        static_assert(std::is_nothrow_move_constructible<Fn>::value,
+                      "task must be nothrow move constructible");
+        new (&storage_) Fn(std::forward<F>(func));
+        ops_ = OpsFor<Fn>();
+    }
+
+    InlineTask(InlineTask &&other) noexcept : ops_(other.ops_)
+    {
+        if (ops_)
+        {
+            ops_->move(&storage_, &other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    InlineTask &operator=(InlineTask &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            if (other.ops_)
+            {
+                other.ops_->move(&storage_, &other.storage_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    InlineTask &operator=(std::nullptr_t) noexcept
+    {
+        Reset();
+        return *this;
+    }
+
+    InlineTask(const InlineTask &) = delete;
+    InlineTask &operator=(const InlineTask &) = delete;
+
+    ~InlineTask() { Reset(); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void operator()()
+    {
+        assert(ops_);
+        ops_->invoke(&storage_);
+    }
+
+private:
+    typedef typename std::aligned_storage<CAPACITY, alignof(std::max_align_t)>::type Storage;
+
+    // 按可调用对象的类型生成的函数表，代替虚函数
+    struct Ops
+    {
+        void (*invoke)(void *);
+        // 把src处的对象移动构造到dst，并销毁src处的对象
+        void (*move)(void *dst, void *src);
+        void (*destroy)(void *);
+    };
+
+    template <class Fn>
+    static const Ops *OpsFor(void)
+    {
+        static const Ops ops = {
+            [](void *p)
+            { (*static_cast<Fn *>(p))(); },
+            [](void *dst, void *src)
+            {
+                new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+                static_cast<Fn *>(src)->~Fn();
+            },
+            [](void *p)
+            { static_cast<Fn *>(p)->~Fn(); }};
+        return &ops;
+    }
+
+    void Reset(void)
+    {
+        if (ops_)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    Storage storage_;
+    const Ops *ops_;
+};
+
+#endif
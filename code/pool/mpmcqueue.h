@@ -0,0 +1,396 @@
+/**
+ * @file mpmcqueue.h
+ * @brief 有界无锁多生产者多消费者队列，只在队列空或满时才通过futex睡眠
+ *
+ */
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <climits>
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "../metrics/lockstats.h"
+
+/**
+ * @brief 基于futex的事件计数器，用于在条件不满足时睡眠
+ * 等待方：key = PrepareWait()，再检查一次条件，满足则CancelWait()，否则Wait(key)
+ * 通知方：先让条件成立，再Notify，两边各有一次全屏障，不会丢失唤醒
+ * 没有等待者时Notify只是一次读操作，不进入内核
+ *
+ */
+class EventCount
+{
+public:
+    EventCount() : epoch_(0), waiters_(0) {}
+
+    uint32_t PrepareWait(void)
+    {
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return epoch_.load(std::memory_order_acquire);
+    }
+
+    void CancelWait(void)
+    {
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 在PrepareWait之后睡眠，直到被通知或超时
+     *
+     * @param key PrepareWait的返回值
+     * @param timeoutMs 超时时间，单位ms，<0表示一直等待
+     * @return false 等待超时
+     */
+    bool Wait(uint32_t key, int timeoutMs = -1)
+    {
+        struct timespec ts;
+        struct timespec *pts = nullptr;
+        if (timeoutMs >= 0)
+        {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+            pts = &ts;
+        }
+        bool timeout = false;
+        if (epoch_.load(std::memory_order_acquire) == key)
+        {
+            long ret = syscall(SYS_futex, reinterpret_cast<uint32_t *>(&epoch_),
+                               FUTEX_WAIT_PRIVATE, key, pts, nullptr, 0);
+            timeout = (ret == -1 && errno == ETIMEDOUT);
+        }
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return !timeout;
+    }
+
+    // 正在等待或准备等待的线程数
+    int Waiters(void) const { return waiters_.load(std::memory_order_relaxed); }
+
+    void NotifyOne(void) { Notify_(1); }
+    void NotifyAll(void) { Notify_(INT_MAX); }
+
+private:
+    void Notify_(int count)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+        epoch_.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&epoch_),
+                FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                  "futex word must be a plain 32-bit integer");
+    std::atomic<uint32_t> epoch_;
+    std::atomic<int> waiters_;
+};
+
+/**
+ * @brief 队列满时Push的处理方式
+ *
+ */
+enum OVERFLOW_POLICY
+{
+    // 阻塞生产者直到有空位
+    QUEUE_BLOCK = 0,
+    // 丢弃新元素并计数
+    QUEUE_DROP,
+    // 放到加锁的溢出链表中，不阻塞也不丢失，但溢出部分不保证先进先出
+    QUEUE_SPILL,
+};
+
+/**
+ * @brief 有界MPMC环形队列(Vyukov)
+ * 每个槽带一个序号，生产者和消费者通过CAS抢占位置，入队出队都不需要锁
+ * 槽在构造时一次性分配，队列满时按OVERFLOW_POLICY处理
+ *
+ * @tparam T 元素类型，需要能默认构造和移动
+ */
+template <class T>
+class MpmcQueue
+{
+public:
+    /**
+     * @brief 创建队列
+     *
+     * @param capacity 容量，会向上取整为2的幂
+     * @param policy 队列满时Push的处理方式
+     */
+    explicit MpmcQueue(size_t capacity = 1024, OVERFLOW_POLICY policy = QUEUE_BLOCK);
+    ~MpmcQueue() = default;
+
+    // 只尝试放入环形队列，满了返回false，此时item不会被移走
+    bool TryPush(T &item);
+    // 按溢出策略放入，被丢弃或队列已关闭返回false
+    bool Push(T &&item);
+    // 先取环形队列，再取溢出链表，都没有返回false
+    bool TryPop(T &item);
+    // 队列为空时睡眠，队列关闭且已取空返回false
+    bool Pop(T &item);
+    // 最多等待timeoutMs毫秒，超时返回false
+    bool Pop(T &item, int timeoutMs);
+
+    // 关闭后不再接收新元素，剩余元素仍可取出，唤醒所有等待的线程
+    void Close(void);
+    bool IsClosed(void) const { return closed_.load(std::memory_order_acquire); }
+
+    // 近似判断，生产者占位后、写入前也认为非空
+    bool Empty(void) const
+    {
+        return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_relaxed) &&
+               spillSize_.load(std::memory_order_relaxed) == 0;
+    }
+    size_t Size(void) const
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_relaxed);
+        return (tail > head ? tail - head : 0) + spillSize_.load(std::memory_order_relaxed);
+    }
+    size_t Capacity(void) const { return mask_ + 1; }
+    OVERFLOW_POLICY Policy(void) const { return policy_; }
+    // 累计丢弃、溢出的元素个数
+    size_t Dropped(void) const { return dropped_.load(std::memory_order_relaxed); }
+    size_t Spilled(void) const { return spilled_.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T item;
+    };
+
+    bool PopRing_(T &item);
+    bool PopSpill_(T &item);
+
+    // 头尾之间填充一个缓存行，生产者和消费者之间没有伪共享
+    std::atomic<size_t> head_;
+    char pad_[64];
+    std::atomic<size_t> tail_;
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    OVERFLOW_POLICY policy_;
+    std::atomic<bool> closed_;
+
+    // 消费者等待非空，生产者等待非满
+    EventCount notEmpty_;
+    EventCount notFull_;
+
+    ProfiledMutex spillMtx_;
+    std::deque<T> spill_;
+    std::atomic<size_t> spillSize_;
+
+    std::atomic<size_t> dropped_;
+    std::atomic<size_t> spilled_;
+};
+
+template <class T>
+MpmcQueue<T>::MpmcQueue(size_t capacity, OVERFLOW_POLICY policy)
+    : policy_(policy), closed_(false), spillMtx_("mpmcqueue.spill"), spillSize_(0), dropped_(0), spilled_(0)
+{
+    assert(capacity > 0);
+    size_t cap = 2;
+    while (cap < capacity)
+    {
+        cap <<= 1;
+    }
+    mask_ = cap - 1;
+    cells_.reset(new Cell[cap]);
+    for (size_t i = 0; i < cap; i++)
+    {
+        cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+}
+
+template <class T>
+bool MpmcQueue<T>::TryPush(T &item)
+{
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    while (true)
+    {
+        Cell &cell = cells_[pos & mask_];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0)
+        {
+            // 槽空闲，抢占该位置
+            if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                cell.item = std::move(item);
+                cell.seq.store(pos + 1, std::memory_order_release);
+                notEmpty_.NotifyOne();
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            // 槽中的元素还没被取走，队列已满
+            return false;
+        }
+        else
+        {
+            pos = tail_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <class T>
+bool MpmcQueue<T>::Push(T &&item)
+{
+    if (IsClosed())
+    {
+        return false;
+    }
+    if (TryPush(item))
+    {
+        return true;
+    }
+    switch (policy_)
+    {
+    case QUEUE_DROP:
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    case QUEUE_SPILL:
+    {
+        {
+            std::lock_guard<ProfiledMutex> locker(spillMtx_);
+            spill_.push_back(std::move(item));
+            spillSize_.fetch_add(1, std::memory_order_relaxed);
+        }
+        spilled_.fetch_add(1, std::memory_order_relaxed);
+        notEmpty_.NotifyOne();
+        return true;
+    }
+    default:
+        while (true)
+        {
+            uint32_t key = notFull_.PrepareWait();
+            if (IsClosed())
+            {
+                notFull_.CancelWait();
+                return false;
+            }
+            if (TryPush(item))
+            {
+                notFull_.CancelWait();
+                return true;
+            }
+            notFull_.Wait(key);
+        }
+    }
+}
+
+template <class T>
+bool MpmcQueue<T>::PopRing_(T &item)
+{
+    size_t pos = head_.load(std::memory_order_relaxed);
+    while (true)
+    {
+        Cell &cell = cells_[pos & mask_];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0)
+        {
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                item = std::move(cell.item);
+                // 释放槽中元素持有的资源
+                cell.item = T();
+                cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+                notFull_.NotifyOne();
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            // 槽中还没有写入元素，队列为空
+            return false;
+        }
+        else
+        {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <class T>
+bool MpmcQueue<T>::PopSpill_(T &item)
+{
+    if (spillSize_.load(std::memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+    std::lock_guard<ProfiledMutex> locker(spillMtx_);
+    if (spill_.empty())
+    {
+        return false;
+    }
+    item = std::move(spill_.front());
+    spill_.pop_front();
+    spillSize_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+template <class T>
+bool MpmcQueue<T>::TryPop(T &item)
+{
+    return PopRing_(item) || PopSpill_(item);
+}
+
+template <class T>
+bool MpmcQueue<T>::Pop(T &item)
+{
+    return Pop(item, -1);
+}
+
+template <class T>
+bool MpmcQueue<T>::Pop(T &item, int timeoutMs)
+{
+    while (true)
+    {
+        if (TryPop(item))
+        {
+            return true;
+        }
+        uint32_t key = notEmpty_.PrepareWait();
+        // 登记等待之后再检查一次，避免错过刚放入的元素
+        if (TryPop(item))
+        {
+            notEmpty_.CancelWait();
+            return true;
+        }
+        if (IsClosed())
+        {
+            notEmpty_.CancelWait();
+            return false;
+        }
+        if (!notEmpty_.Wait(key, timeoutMs))
+        {
+            return TryPop(item);
+        }
+    }
+}
+
+template <class T>
+void MpmcQueue<T>::Close(void)
+{
+    closed_.store(true, std::memory_order_release);
+    notEmpty_.NotifyAll();
+    notFull_.NotifyAll();
+}
+
+#endif
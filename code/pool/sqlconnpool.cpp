@@ -2,7 +2,7 @@
 
 using namespace std;
 
-SqlConnPool::SqlConnPool(/* args */)
+SqlConnPool::SqlConnPool(/* args */) : mtx_("sqlconnpool"), semId_("sqlconnpool.sem", 0)
 {
     useCount_ = 0;
     freeCount_ = 0;
@@ -50,7 +50,7 @@ void SqlConnPool::Init(const char *host, int port, const char *user, const char
     // 信号量，数量等于MySQL的最大连接数
     // 使用信号量实现多线程争夺连接的同步机制
     // 信号量的数量等于MySQL的最大连接数，每用一个MySQL连接，信号量数量-1
-    sem_init(&semId_, 0, MAX_CONN_);
+    semId_.Reset(MAX_CONN_);
 }
 
 /**
@@ -67,9 +67,9 @@ MYSQL *SqlConnPool::GetConn(void)
         return nullptr;
     }
     // 等待信号量。信号量>0，信号量数量-1，若信号量<=0，则阻塞等待
-    sem_wait(&semId_);
+    semId_.Wait();
     {
-        lock_guard<mutex> locker(mtx_);
+        lock_guard<ProfiledMutex> locker(mtx_);
         sql = connQue_.front();
         connQue_.pop();
     }
@@ -85,15 +85,15 @@ void SqlConnPool::FreeConn(MYSQL *conn)
 {
     // 断言检查
     assert(conn);
-    lock_guard<mutex> locker(mtx_);
+    lock_guard<ProfiledMutex> locker(mtx_);
     connQue_.push(conn);
     // 释放信号量
-    sem_post(&semId_);
+    semId_.Post();
 }
 
 void SqlConnPool::ClosePool(void)
 {
-    lock_guard<mutex> locker(mtx_);
+    lock_guard<ProfiledMutex> locker(mtx_);
     while (!connQue_.empty())
     {
         auto item = connQue_.front();
@@ -110,6 +110,6 @@ void SqlConnPool::ClosePool(void)
  */
 int SqlConnPool::GetFreeConnCount(void)
 {
-    lock_guard<mutex> locker(mtx_);
+    lock_guard<ProfiledMutex> locker(mtx_);
     return connQue_.size();
 }
\ No newline at end of file
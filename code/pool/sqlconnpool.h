@@ -10,9 +10,9 @@
 #include <assert.h>
 // 互斥锁、信号量、线程
 #include <mutex>
-#include <semaphore.h>
 #include <thread>
 #include "../log/log.h"
+#include "../metrics/lockstats.h"
 
 /**
  * @brief 这个类有点像线程池在这个池里面的sql句柄都已经连接上sql但还没使用
@@ -31,8 +31,8 @@ private:
 
     // 空闲sql连接队列
     std::queue<MYSQL *> connQue_;
-    std::mutex mtx_;
-    sem_t semId_;
+    ProfiledMutex mtx_;
+    ProfiledSemaphore semId_;
 
 public:
     // 返回静态SqlConnPool对象
@@ -0,0 +1,306 @@
+#include "threadpool.h"
+#include "../log/log.h"
+#include "../metrics/probes.h"
+
+using namespace std;
+
+namespace
+{
+    // 当前线程所属的线程池和队列下标，工作线程内再提交的任务直接放进自己的队列
+    thread_local const void *tlsPool = nullptr;
+    thread_local size_t tlsIndex = 0;
+}
+
+ThreadPool::ThreadPool(size_t threadCount, size_t queueSize, OVERFLOW_POLICY policy,
+                       const ElasticConfig &elastic)
+    : pool_(make_shared<Pool>()), elastic_(elastic), ctrlMtx_("threadpool.ctrl"), ctrlStop_(false)
+{
+    assert(threadCount > 0 && queueSize > 0);
+    size_t slots = threadCount;
+    if (elastic_.enabled)
+    {
+        assert(elastic_.minThreads > 0 && elastic_.maxThreads >= elastic_.minThreads);
+        assert(elastic_.intervalMs > 0);
+        // 初始线程数限制在[minThreads, maxThreads]之间，槽位按最大线程数一次性分配
+        threadCount = max(threadCount, static_cast<size_t>(elastic_.minThreads));
+        threadCount = min(threadCount, static_cast<size_t>(elastic_.maxThreads));
+        slots = elastic_.maxThreads;
+    }
+    pool_->isClosed = false;
+    pool_->active = 0;
+    pool_->next = 0;
+    pool_->measureWait = elastic_.enabled;
+    pool_->grows = 0;
+    pool_->shrinks = 0;
+    pool_->lastWaitP99Us = 0;
+    for (size_t i = 0; i < slots; i++)
+    {
+        unique_ptr<Worker> worker(new Worker());
+        worker->queue.reset(new MpmcQueue<Job>(queueSize, policy));
+        worker->tasks = 0;
+        pool_->workers.push_back(std::move(worker));
+    }
+    // 槽位全部创建好之后再启动线程，工作线程窃取时会遍历所有队列
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        StartWorker_(i);
+    }
+    if (elastic_.enabled)
+    {
+        controller_ = thread(&ThreadPool::Control_, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    // 先停止控制线程，之后线程数不再变化
+    if (controller_.joinable())
+    {
+        {
+            lock_guard<ProfiledMutex> locker(ctrlMtx_);
+            ctrlStop_ = true;
+        }
+        ctrlCond_.notify_all();
+        controller_.join();
+    }
+    if (static_cast<bool>(pool_))
+    {
+        pool_->isClosed = true;
+        // 唤醒全部等待线程，剩余的任务处理完后线程退出
+        pool_->idle.NotifyAll();
+        for (auto &worker : pool_->workers)
+        {
+            if (worker->thread.joinable())
+            {
+                worker->thread.join();
+            }
+        }
+    }
+}
+
+int64_t ThreadPool::NowUs_(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief 在index槽位上启动工作线程，并把线程数设为index+1
+ * 槽位上被缩减的旧线程可能还没退出，先等它结束，避免同一个槽位上有两个线程
+ *
+ * @param index 槽位下标，等于当前线程数
+ */
+void ThreadPool::StartWorker_(size_t index)
+{
+    Worker &worker = *pool_->workers[index];
+    if (worker.thread.joinable())
+    {
+        worker.thread.join();
+    }
+    pool_->active.store(index + 1, memory_order_release);
+    worker.thread = thread(Run_, pool_, index);
+}
+
+bool ThreadPool::Submit_(Task &&task)
+{
+    Pool &pool = *pool_;
+    if (pool.isClosed)
+    {
+        return false;
+    }
+    Job job;
+    job.task = std::move(task);
+    job.enqueueUs = pool.measureWait ? NowUs_() : 0;
+    size_t n = pool.active.load(memory_order_acquire);
+    size_t start = (tlsPool == &pool && tlsIndex < n) ? tlsIndex
+                                                      : pool.next.fetch_add(1, memory_order_relaxed) % n;
+    bool pushed = false;
+    for (size_t i = 0; i < n && !pushed; i++)
+    {
+        pushed = pool.workers[(start + i) % n]->queue->TryPush(job);
+    }
+    if (!pushed)
+    {
+        // 所有队列都满了，由起始队列按溢出策略处理
+        pushed = pool.workers[start]->queue->Push(std::move(job));
+    }
+    if (pushed)
+    {
+        pool.idle.NotifyOne();
+    }
+    USDT_PROBE3(pool_enqueue, &pool, start, pushed);
+    return pushed;
+}
+
+/**
+ * @brief 取一个任务，先取自己的队列，再从其他线程的队列窃取
+ * 被缩减的线程队列中剩下的任务也会被窃取
+ *
+ * @param pool 线程池
+ * @param index 当前工作线程的队列下标
+ * @param job 输出取到的任务
+ * @return true 取到了任务
+ */
+bool ThreadPool::Take_(Pool &pool, size_t index, Job &job)
+{
+    size_t n = pool.workers.size();
+    for (size_t i = 0; i < n; i++)
+    {
+        if (pool.workers[(index + i) % n]->queue->TryPop(job))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::HasWork_(const Pool &pool)
+{
+    for (const auto &worker : pool.workers)
+    {
+        if (!worker->queue->Empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::Run_(shared_ptr<Pool> pool, size_t index)
+{
+    tlsPool = pool.get();
+    tlsIndex = index;
+    Worker &self = *pool->workers[index];
+    Job job;
+    int spin = 0;
+    while (true)
+    {
+        // 线程被缩减，把自己队列中的任务处理完后退出
+        if (index >= pool->active.load(memory_order_acquire) && self.queue->Empty())
+        {
+            break;
+        }
+        if (Take_(*pool, index, job))
+        {
+            int64_t wait = -1;
+            if (pool->measureWait)
+            {
+                wait = NowUs_() - job.enqueueUs;
+                self.wait.Record(wait > 0 ? wait : 0);
+            }
+            USDT_PROBE3(task_start, pool.get(), index, wait);
+            job.task();
+            job.task = nullptr;
+            USDT_PROBE2(task_done, pool.get(), index);
+            self.tasks.fetch_add(1, memory_order_relaxed);
+            spin = 0;
+            continue;
+        }
+        if (spin++ < SPIN_COUNT)
+        {
+            this_thread::yield();
+            continue;
+        }
+        spin = 0;
+        uint32_t key = pool->idle.PrepareWait();
+        // 登记睡眠之后再检查一次，避免错过刚提交的任务
+        if (HasWork_(*pool))
+        {
+            pool->idle.CancelWait();
+            continue;
+        }
+        if (pool->isClosed)
+        {
+            pool->idle.CancelWait();
+            break;
+        }
+        if (index >= pool->active.load(memory_order_acquire))
+        {
+            pool->idle.CancelWait();
+            continue;
+        }
+        pool->idle.Wait(key);
+    }
+}
+
+/**
+ * @brief 控制线程，每个采样周期计算一次排队时间p99
+ * p99超过目标时增加一个线程；p99达标且有线程在睡眠的状态持续idleShrinkMs后减少一个线程
+ *
+ */
+void ThreadPool::Control_(void)
+{
+    Pool &pool = *pool_;
+    vector<uint64_t> prev(Histogram::BUCKETS, 0);
+    vector<uint64_t> cur(Histogram::BUCKETS, 0);
+    vector<uint64_t> window(Histogram::BUCKETS, 0);
+    int idleMs = 0;
+    unique_lock<ProfiledMutex> locker(ctrlMtx_);
+    while (!ctrlStop_)
+    {
+        ctrlCond_.wait_for(locker, chrono::milliseconds(elastic_.intervalMs));
+        if (ctrlStop_)
+        {
+            break;
+        }
+        // 直方图计数只增不减，两次快照之差就是这个周期内的分布
+        fill(cur.begin(), cur.end(), 0);
+        for (const auto &worker : pool.workers)
+        {
+            worker->wait.AddTo(cur);
+        }
+        for (int i = 0; i < Histogram::BUCKETS; i++)
+        {
+            window[i] = cur[i] - prev[i];
+        }
+        prev.swap(cur);
+        int64_t p99 = static_cast<int64_t>(Histogram::Percentile(window, 0.99));
+        pool.lastWaitP99Us.store(p99, memory_order_relaxed);
+
+        size_t active = pool.active.load(memory_order_acquire);
+        if (p99 > elastic_.targetP99Us && active < static_cast<size_t>(elastic_.maxThreads))
+        {
+            StartWorker_(active);
+            pool.grows.fetch_add(1, memory_order_relaxed);
+            idleMs = 0;
+            LOG_INFO("Elastic pool grow to %zu threads, wait p99: %lldus > target: %dus", active + 1,
+                     static_cast<long long>(p99), elastic_.targetP99Us);
+        }
+        else if (p99 <= elastic_.targetP99Us && pool.idle.Waiters() > 0)
+        {
+            idleMs += elastic_.intervalMs;
+            if (idleMs >= elastic_.idleShrinkMs && active > static_cast<size_t>(elastic_.minThreads))
+            {
+                // 下标最大的线程处理完自己的任务后退出
+                pool.active.store(active - 1, memory_order_release);
+                pool.idle.NotifyAll();
+                pool.shrinks.fetch_add(1, memory_order_relaxed);
+                idleMs = 0;
+                LOG_INFO("Elastic pool shrink to %zu threads, wait p99: %lldus, idle: %dms", active - 1,
+                         static_cast<long long>(p99), elastic_.idleShrinkMs);
+            }
+        }
+        else
+        {
+            idleMs = 0;
+        }
+    }
+}
+
+ThreadPool::Stats ThreadPool::GetStats(void) const
+{
+    Stats stats;
+    stats.threads = pool_->active.load(memory_order_relaxed);
+    stats.tasks = 0;
+    stats.queued = 0;
+    for (const auto &worker : pool_->workers)
+    {
+        stats.tasks += worker->tasks.load(memory_order_relaxed);
+        stats.queued += worker->queue->Size();
+    }
+    stats.grows = pool_->grows.load(memory_order_relaxed);
+    stats.shrinks = pool_->shrinks.load(memory_order_relaxed);
+    stats.lastWaitP99Us = pool_->lastWaitP99Us.load(memory_order_relaxed);
+    return stats;
+}
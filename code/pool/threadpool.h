@@ -11,98 +11,133 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
-#include <thread>
-// functional提供了函数类模板
-#include <functional>
 #include <assert.h>
+#include <stdint.h>
+#include "inlinetask.h"
+#include "mpmcqueue.h"
+#include "../metrics/histogram.h"
+#include "../metrics/lockstats.h"
+#include "../config/config.h"
 
+/**
+ * @brief 工作窃取线程池
+ * 每个工作线程有自己的有界无锁任务队列，epoll线程按轮询把任务放进各个队列，不需要加锁
+ * 工作线程优先处理自己的队列，空了再去其他线程的队列里窃取，都没有任务时才睡眠
+ * 所有队列都满时按溢出策略处理：阻塞提交者、丢弃任务或放入溢出链表
+ * 开启弹性伸缩后，控制线程根据任务排队时间在[minThreads, maxThreads]之间调整线程数
+ *
+ */
 class ThreadPool
 {
+public:
+    // 任务固定大小、内联存储，提交任务不分配内存
+    typedef InlineTask Task;
+
+    // 线程池运行统计，线程数调整的决策也记录在这里
+    struct Stats
+    {
+        size_t threads;
+        // 累计执行的任务数
+        uint64_t tasks;
+        // 各队列中等待执行的任务数之和，包括溢出链表
+        size_t queued;
+        // 弹性伸缩累计增加、减少线程的次数
+        uint64_t grows;
+        uint64_t shrinks;
+        // 最近一个采样周期的排队时间p99，单位us
+        int64_t lastWaitP99Us;
+    };
+
 private:
+    // 队列中的任务，附带入队时间用于统计排队时间
+    struct Job
+    {
+        Task task;
+        int64_t enqueueUs;
+    };
+
+    // 每个工作线程的槽位，槽位数为最大线程数，线程可以在槽位上退出后重新启动
+    struct Worker
+    {
+        std::unique_ptr<MpmcQueue<Job>> queue;
+        std::thread thread;
+        // 排队时间分布，单位us
+        Histogram wait;
+        std::atomic<uint64_t> tasks;
+    };
+
     struct Pool
     {
-        // 互斥锁，使用线程时上锁
-        std::mutex mtx;
-        // 并发，条件变量
-        std::condition_variable cond;
-        bool isClosed;
-        // std::function是函数包装器，也是一个模板类
-        // tasks是一个任务队列
-        std::queue<std::function<void()>> tasks;
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<bool> isClosed;
+        // 当前线程数，下标不小于active的线程处理完自己队列中的任务后退出
+        std::atomic<size_t> active;
+        // 没有任务时工作线程在这里睡眠，没有线程睡眠时提交任务不进入内核
+        EventCount idle;
+        // 下一个接收外部任务的队列，轮询分配
+        std::atomic<size_t> next;
+        // 是否记录排队时间，只在开启弹性伸缩时记录
+        bool measureWait;
+        std::atomic<uint64_t> grows;
+        std::atomic<uint64_t> shrinks;
+        std::atomic<int64_t> lastWaitP99Us;
     };
     // 创建结构体Pool指针
     std::shared_ptr<Pool> pool_;
 
+    ElasticConfig elastic_;
+    std::thread controller_;
+    ProfiledMutex ctrlMtx_;
+    std::condition_variable_any ctrlCond_;
+    bool ctrlStop_;
+
+    // 睡眠前空转尝试取任务的次数，任务密集时避免频繁睡眠、唤醒
+    static const int SPIN_COUNT = 64;
+
+    static void Run_(std::shared_ptr<Pool> pool, size_t index);
+    static bool Take_(Pool &pool, size_t index, Job &job);
+    static bool HasWork_(const Pool &pool);
+    static int64_t NowUs_(void);
+    bool Submit_(Task &&task);
+    void StartWorker_(size_t index);
+    void Control_(void);
+
 public:
-    // explicit关键字表示显示构造函数
-    // 这个类负责初始化线程池
-    explicit ThreadPool(size_t threadCount = 8) : pool_(std::make_shared<Pool>())
-    {
-        assert(threadCount > 0);
-        for (size_t i = 0; i < threadCount; i++)
-        {
-            /*
-            [pool]是里面lambda函数的参数，std::thread是以函数指针为参数，{}里面就是lambda函数
-            最后调用detach的原因是，工作线程创建后会自动join到主线程中，但此时程序还不需要工作线程
-             */
-            std::thread([pool = pool_]
-                        { 
-                            // 上锁，防止线程之间的资源竞争，创建locker对象后即上锁
-                            std::unique_lock<std::mutex> locker(pool->mtx);
-                        while(true)
-                        {
-                            if(!pool->tasks.empty())
-                            {
-                                // 取出任务队列头
-                                auto task = std::move(pool->tasks.front());
-                                pool->tasks.pop();
-                                locker.unlock();
-                                task();
-                                locker.lock();
-                            }
-                            else if(pool->isClosed)
-                            {
-                                break;
-                            }
-                            else
-                            {
-                                // 线程池为空，等待其他socket完成释放资源
-                                // wait会主动调用unlock释放锁
-                                pool->cond.wait(locker);
-                            }
-                                                } })
-                .detach();
-        }
-    }
-    ThreadPool() = default;
-    ThreadPool(ThreadPool &&) = default;
-    ~ThreadPool()
-    {
-        if (static_cast<bool>(pool_))
-        {
-            std::lock_guard<std::mutex> locker(pool_->mtx);
-            pool_->isClosed = true;
-        }
-        // notify_all唤醒全部等待线程
-        pool_->cond.notify_all();
-    }
+    /**
+     * @brief 创建线程池
+     *
+     * @param threadCount 工作线程数，开启弹性伸缩时为初始线程数
+     * @param queueSize 每个工作线程的任务队列长度
+     * @param policy 所有队列都满时的处理方式，默认放入溢出链表，任务不会丢失
+     * @param elastic 弹性伸缩设置，默认关闭
+     */
+    explicit ThreadPool(size_t threadCount = 8, size_t queueSize = 1024,
+                        OVERFLOW_POLICY policy = QUEUE_SPILL,
+                        const ElasticConfig &elastic = ElasticConfig());
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    // 关闭线程池，等待剩余任务执行完、所有线程退出
+    ~ThreadPool();
 
     // 这里并不是引用的引用，而是一个引用折叠(C++没有引用的引用)
     // 引用折叠后依然是一个普通的引用或右值引用，不存在所谓的“引用的引用”
     // 引用折叠只是为了std::move、std::forward等函数服务
+    // 返回false表示任务按QUEUE_DROP策略被丢弃，或线程池已关闭
     template <class F>
-    void AddTask(F &&task)
+    bool AddTask(F &&task)
     {
-        {
-            // 把任务添加到队列中
-            std::lock_guard<std::mutex> locker(pool_->mtx);
-            pool_->tasks.emplace(std::forward<F>(task));
-        }
-        pool_->cond.notify_one();
+        return Submit_(Task(std::forward<F>(task)));
     }
+
+    Stats GetStats(void) const;
+    // 是否开启了弹性伸缩，只有开启时才有调整次数和排队时间
+    bool IsElastic(void) const { return elastic_.enabled; }
 };
 
-#endif
\ No newline at end of file
+#endif
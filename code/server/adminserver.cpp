@@ -0,0 +1,293 @@
+#include "adminserver.h"
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+namespace
+{
+    // 单个管理请求的最大长度
+    const size_t MAX_REQUEST = 64 * 1024;
+    // 管理线程检查停止标志的周期
+    const int POLL_MS = 200;
+    // 读取请求、写出响应的超时
+    const int IO_TIMEOUT_MS = 2000;
+
+    const char *StatusText(int code)
+    {
+        switch (code)
+        {
+        case 200:
+            return "OK";
+        case 400:
+            return "Bad Request";
+        case 403:
+            return "Forbidden";
+        case 404:
+            return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        case 413:
+            return "Payload Too Large";
+        case 431:
+            return "Request Header Fields Too Large";
+        case 503:
+            return "Service Unavailable";
+        default:
+            return "Internal Server Error";
+        }
+    }
+
+    bool WriteAll(int fd, const char *data, size_t len)
+    {
+        while (len > 0)
+        {
+            ssize_t n = write(fd, data, len);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return false;
+            }
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+}
+
+AdminServer::AdminServer() : listenFd_(-1), unixFd_(-1), stop_(false)
+{
+}
+
+AdminServer::~AdminServer()
+{
+    Stop();
+}
+
+void AdminServer::Handle(const string &path, AdminHandler handler)
+{
+    handlers_[path] = move(handler);
+}
+
+void AdminServer::Remove(const string &path)
+{
+    handlers_.erase(path);
+}
+
+string AdminServer::PathOf(const string &target)
+{
+    return target.substr(0, target.find('?'));
+}
+
+string AdminServer::QueryOf(const string &target, const string &key)
+{
+    size_t pos = target.find('?');
+    while (pos != string::npos)
+    {
+        size_t begin = pos + 1;
+        size_t end = target.find('&', begin);
+        string item = target.substr(begin, end == string::npos ? string::npos : end - begin);
+        if (item.compare(0, key.size(), key) == 0 && item.size() > key.size() && item[key.size()] == '=')
+        {
+            return item.substr(key.size() + 1);
+        }
+        pos = end;
+    }
+    return "";
+}
+
+bool AdminServer::Has(const string &path) const
+{
+    return !handlers_.empty() && handlers_.count(PathOf(path)) > 0;
+}
+
+bool AdminServer::Dispatch(const HttpRequest &request, AdminReply &reply) const
+{
+    auto it = handlers_.find(PathOf(request.path()));
+    if (it == handlers_.end())
+    {
+        return false;
+    }
+    it->second(request, reply);
+    return true;
+}
+
+bool AdminServer::Listen(int port)
+{
+    if (listenFd_ >= 0 || port <= 0 || port > 65535)
+    {
+        return false;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    int optval = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    // 只监听本机地址，管理接口不对外暴露
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 || listen(fd, 16) < 0)
+    {
+        close(fd);
+        return false;
+    }
+    listenFd_ = fd;
+    Start_();
+    return true;
+}
+
+bool AdminServer::ListenUnix(const char *path)
+{
+    struct sockaddr_un addr = {};
+    if (unixFd_ >= 0 || !path || !*path || strlen(path) >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+    // 只替换上次运行留下的socket文件，不删除同名的普通文件
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    // 创建socket文件时就去掉其他用户的权限，bind之后再chmod会有一段时间窗口
+    mode_t oldMask = umask(0177);
+    int ret = bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    umask(oldMask);
+    if (ret < 0 || listen(fd, 16) < 0)
+    {
+        close(fd);
+        return false;
+    }
+    unixFd_ = fd;
+    unixPath_ = path;
+    Start_();
+    return true;
+}
+
+void AdminServer::Start_(void)
+{
+    if (thread_.joinable())
+    {
+        stop_ = true;
+        thread_.join();
+    }
+    stop_ = false;
+    thread_ = thread([this]
+                     { Run_(); });
+}
+
+void AdminServer::Stop(void)
+{
+    stop_ = true;
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+    if (listenFd_ >= 0)
+    {
+        close(listenFd_);
+        listenFd_ = -1;
+    }
+    if (unixFd_ >= 0)
+    {
+        close(unixFd_);
+        unixFd_ = -1;
+        unlink(unixPath_.c_str());
+    }
+}
+
+void AdminServer::Run_(void)
+{
+    // fd为-1的项被poll忽略
+    struct pollfd pfds[2] = {{listenFd_, POLLIN, 0}, {unixFd_, POLLIN, 0}};
+    while (!stop_.load(memory_order_relaxed))
+    {
+        if (poll(pfds, 2, POLL_MS) <= 0)
+        {
+            continue;
+        }
+        for (struct pollfd &pfd : pfds)
+        {
+            if (!(pfd.revents & POLLIN))
+            {
+                continue;
+            }
+            int fd = accept4(pfd.fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                continue;
+            }
+            Serve_(fd);
+            close(fd);
+        }
+    }
+}
+
+/**
+ * @brief 读取一个请求，调用处理函数并写出响应，之后关闭连接
+ * 阻塞读写，带超时，客户端不发数据时最多占用管理线程IO_TIMEOUT_MS
+ *
+ */
+void AdminServer::Serve_(int fd)
+{
+    struct timeval tv = {IO_TIMEOUT_MS / 1000, (IO_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    Buffer buff;
+    int code = 0;
+    while (HttpRequest::Probe(buff, code) != HttpRequest::FINISH)
+    {
+        int err = 0;
+        if (buff.ReadableBytes() > MAX_REQUEST || buff.ReadFd(fd, &err) <= 0)
+        {
+            return;
+        }
+    }
+    HttpRequest request;
+    request.Init();
+    AdminReply reply;
+    if (code != 0)
+    {
+        reply.code = code;
+        reply.body = string(StatusText(code)) + "\n";
+    }
+    else if (!request.parse(buff))
+    {
+        reply.code = 400;
+        reply.body = "bad request\n";
+    }
+    else if (!Dispatch(request, reply))
+    {
+        reply.code = 404;
+        reply.body = "not found\n";
+    }
+    string head = "HTTP/1.1 " + to_string(reply.code) + " " + StatusText(reply.code) + "\r\n" +
+                  "Content-Type: " + reply.type + "\r\n" +
+                  "Content-Length: " + to_string(reply.body.size()) + "\r\n" +
+                  "Connection: close\r\n\r\n";
+    if (WriteAll(fd, head.data(), head.size()))
+    {
+        WriteAll(fd, reply.body.data(), reply.body.size());
+    }
+}
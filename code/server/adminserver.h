@@ -0,0 +1,86 @@
+/**
+ * @file adminserver.h
+ * @brief 管理接口，按路径注册处理函数，可以经过主端口提供，也可以单独监听本机端口或unix socket
+ *
+ */
+#ifndef ADMIN_SERVER_H
+#define ADMIN_SERVER_H
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+
+#include "../http/httprequest.h"
+
+// 处理函数生成的响应
+struct AdminReply
+{
+    int code = 200;
+    std::string type = "text/plain; charset=utf-8";
+    std::string body;
+};
+
+typedef std::function<void(const HttpRequest &request, AdminReply &reply)> AdminHandler;
+
+/**
+ * @brief 管理接口
+ * 处理函数在启动前注册，之后只读，主端口的工作线程和管理线程可以同时查找
+ * 单独监听时由一个线程逐个处理连接，每个连接只处理一个请求，负载很重时也不和主端口争用工作线程
+ *
+ */
+class AdminServer
+{
+public:
+    AdminServer();
+    ~AdminServer();
+    AdminServer(const AdminServer &) = delete;
+    AdminServer &operator=(const AdminServer &) = delete;
+
+    // 注册处理函数，path不含查询参数
+    void Handle(const std::string &path, AdminHandler handler);
+    // 删除处理函数，同样只能在启动前调用
+    void Remove(const std::string &path);
+    // 请求路径(忽略查询参数)是否有处理函数
+    bool Has(const std::string &path) const;
+    // 调用处理函数，没有对应的处理函数时返回false
+    bool Dispatch(const HttpRequest &request, AdminReply &reply) const;
+
+    /**
+     * @brief 在127.0.0.1:port上单独监听，并启动管理线程
+     *
+     * @return false 监听失败
+     */
+    bool Listen(int port);
+    /**
+     * @brief 在unix socket上单独监听，可以和本机端口同时使用
+     * 路径上已有的socket文件会被替换，权限设为0600，只有运行服务器的用户可以连接
+     *
+     * @return false 监听失败
+     */
+    bool ListenUnix(const char *path);
+    bool IsListening(void) const { return listenFd_ >= 0 || unixFd_ >= 0; }
+    // 停止管理线程，析构时自动调用
+    void Stop(void);
+
+    // 去掉查询参数后的路径
+    static std::string PathOf(const std::string &target);
+    // 查询参数中key的值，不存在时返回空串
+    static std::string QueryOf(const std::string &target, const std::string &key);
+
+private:
+    // (重新)启动管理线程，线程运行期间不修改监听的文件描述符
+    void Start_(void);
+    void Run_(void);
+    void Serve_(int fd);
+
+    std::unordered_map<std::string, AdminHandler> handlers_;
+    int listenFd_;
+    int unixFd_;
+    std::string unixPath_;
+    std::atomic<bool> stop_;
+    std::thread thread_;
+};
+
+#endif
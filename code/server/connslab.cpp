@@ -0,0 +1,56 @@
+#include "connslab.h"
+
+ConnSlab::ConnSlab(int maxFd)
+{
+    assert(maxFd > 0);
+    size_t cap = maxFd;
+    // 进程能打开的文件描述符上限，超过上限的槽永远用不到
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+        rl.rlim_cur < cap)
+    {
+        cap = rl.rlim_cur;
+    }
+    // 只分配槽位本身，HttpConn按需创建
+    slots_.reset(new ConnSlot[cap]);
+    capacity_ = cap;
+    for (size_t i = 0; i < capacity_; i++)
+    {
+        slots_[i].gen = 0;
+        slots_[i].timer.id = static_cast<int>(i);
+        slots_[i].conn.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ConnSlab::~ConnSlab()
+{
+    for (size_t i = 0; i < capacity_; i++)
+    {
+        delete slots_[i].conn.load(std::memory_order_relaxed);
+    }
+}
+
+HttpConn *ConnSlab::Acquire(int fd, uint32_t *gen)
+{
+    assert(gen);
+    if (fd < 0 || static_cast<size_t>(fd) >= capacity_)
+    {
+        return nullptr;
+    }
+    ConnSlot &slot = slots_[fd];
+    // 只有事件循环分配，这里读自己写入的值不需要acquire
+    HttpConn *conn = slot.conn.load(std::memory_order_relaxed);
+    if (!conn)
+    {
+        conn = new HttpConn();
+        // 构造完成后再发布，管理线程读到指针时对象已经初始化
+        slot.conn.store(conn, std::memory_order_release);
+    }
+    // 代数0保留给监听描述符，回绕时跳过
+    if (++slot.gen == 0)
+    {
+        slot.gen = 1;
+    }
+    *gen = slot.gen;
+    return conn;
+}
@@ -0,0 +1,111 @@
+#ifndef CONN_SLAB_H
+#define CONN_SLAB_H
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <assert.h>
+#include <sys/resource.h>
+
+#include "../http/httpconn.h"
+#include "../timer/timewheel.h"
+
+/**
+ * @brief 连接槽，下标即为文件描述符
+ * gen为槽的代数，每有一个新连接占用该槽，代数+1，用于识别fd被复用后的过期事件
+ *
+ */
+struct ConnSlot
+{
+    uint32_t gen;
+    // 连接的定时器节点，随槽复用，新连接占用槽时重新设置
+    WheelNode timer;
+    // HttpConn在第一次使用该槽时由事件循环分配，之后随槽一直复用，由ConnSlab释放
+    // 管理线程会遍历连接表，指针按release发布、acquire读取
+    std::atomic<HttpConn *> conn;
+};
+
+/**
+ * @brief 以fd为下标的连接表，构造时按MAX_FD和RLIMIT_NOFILE一次性分配好槽位
+ * 查找只需要数组下标，不再需要哈希表
+ *
+ */
+class ConnSlab
+{
+private:
+    // 定时器节点互相链接、槽中有原子字段，槽位分配后不再移动
+    std::unique_ptr<ConnSlot[]> slots_;
+    size_t capacity_;
+
+public:
+    /**
+     * @brief 创建连接表
+     *
+     * @param maxFd 最大连接数，实际容量取maxFd和进程文件描述符上限中的较小值
+     */
+    explicit ConnSlab(int maxFd);
+    ~ConnSlab();
+    ConnSlab(const ConnSlab &) = delete;
+    ConnSlab &operator=(const ConnSlab &) = delete;
+
+    /**
+     * @brief 新连接占用fd对应的槽，槽的代数+1
+     *
+     * @param fd 文件描述符
+     * @param gen 输出该槽新的代数
+     * @return HttpConn* 该槽的连接对象，fd超出容量返回nullptr
+     */
+    HttpConn *Acquire(int fd, uint32_t *gen);
+
+    /**
+     * @brief 根据(fd, gen)查找连接，代数不匹配或连接已关闭说明事件已过期
+     *
+     * @param fd 文件描述符
+     * @param gen 事件或定时器登记时的代数
+     * @return HttpConn* 过期返回nullptr
+     */
+    HttpConn *Find(int fd, uint32_t gen) const
+    {
+        if (fd < 0 || static_cast<size_t>(fd) >= capacity_)
+        {
+            return nullptr;
+        }
+        const ConnSlot &slot = slots_[fd];
+        HttpConn *conn = slot.conn.load(std::memory_order_acquire);
+        if (slot.gen != gen || !conn || conn->IsClose())
+        {
+            return nullptr;
+        }
+        return conn;
+    }
+
+    /**
+     * @brief 取出fd对应槽中仍然打开的连接，可以在事件循环以外的线程调用
+     *
+     * @param fd 文件描述符
+     * @return HttpConn* 槽未使用或连接已关闭返回nullptr
+     */
+    HttpConn *Get(int fd) const
+    {
+        if (fd < 0 || static_cast<size_t>(fd) >= capacity_)
+        {
+            return nullptr;
+        }
+        HttpConn *conn = slots_[fd].conn.load(std::memory_order_acquire);
+        if (!conn || conn->IsClose())
+        {
+            return nullptr;
+        }
+        return conn;
+    }
+
+    WheelNode *Timer(int fd)
+    {
+        assert(fd >= 0 && static_cast<size_t>(fd) < capacity_);
+        return &slots_[fd].timer;
+    }
+
+    size_t Capacity(void) const { return capacity_; }
+};
+
+#endif
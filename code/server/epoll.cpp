@@ -13,7 +13,13 @@ Epoller::~Epoller()
     close(epollFd_);
 }
 
-bool Epoller::AddFd(int fd, uint32_t events)
+// 低32位为fd，高32位为代数
+static inline uint64_t PackData(int fd, uint32_t gen)
+{
+    return (static_cast<uint64_t>(gen) << 32) | static_cast<uint32_t>(fd);
+}
+
+bool Epoller::AddFd(int fd, uint32_t events, uint32_t gen)
 {
     if (fd < 0)
     {
@@ -21,7 +27,7 @@ bool Epoller::AddFd(int fd, uint32_t events)
     }
     // epoll事件结构体
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = PackData(fd, gen);
     ev.events = events;
     // epoll_ctl是一个事件注册函数
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
@@ -32,17 +38,18 @@ bool Epoller::AddFd(int fd, uint32_t events)
  *
  * @param fd 文件描述符
  * @param events epoll事件
+ * @param gen 连接槽代数
  * @return true
  * @return false
  */
-bool Epoller::ModFd(int fd, uint32_t events)
+bool Epoller::ModFd(int fd, uint32_t events, uint32_t gen)
 {
     if (fd < 0)
     {
         return false;
     }
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = PackData(fd, gen);
     ev.events = events;
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev);
 }
@@ -61,7 +68,7 @@ bool Epoller::DelFd(int fd)
         return false;
     }
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = PackData(fd, 0);
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, &ev);
 }
 
@@ -74,7 +81,13 @@ int Epoller::Wait(int timeoutMs)
 int Epoller::GetEventFd(size_t i) const
 {
     assert(i < events_.size() && i >= 0);
-    return events_[i].data.fd;
+    return static_cast<int>(events_[i].data.u64 & 0xffffffff);
+}
+
+uint32_t Epoller::GetEventGen(size_t i) const
+{
+    assert(i < events_.size() && i >= 0);
+    return static_cast<uint32_t>(events_[i].data.u64 >> 32);
 }
 
 uint32_t Epoller::GetEvents(size_t i) const
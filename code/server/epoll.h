@@ -29,13 +29,14 @@ public:
     explicit Epoller(int maxEvent = 1024);
     ~Epoller();
 
-    // fd是文件描述符
-    bool AddFd(int fd, uint32_t events);
-    bool ModFd(int fd, uint32_t events);
+    // fd是文件描述符，gen是连接槽代数，二者一起打包存放在epoll_event.data.u64中
+    bool AddFd(int fd, uint32_t events, uint32_t gen = 0);
+    bool ModFd(int fd, uint32_t events, uint32_t gen = 0);
     bool DelFd(int fd);
     int Wait(int timeoutMs = -1);
 
     int GetEventFd(size_t i) const;
+    uint32_t GetEventGen(size_t i) const;
     uint32_t GetEvents(size_t i) const;
 };
 
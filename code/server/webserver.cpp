@@ -1,18 +1,52 @@
 #include "webserver.h"
 #include <iostream>
+#include "../metrics/probes.h"
 
 WebServer::WebServer(int port, int trigMode, int timeoutMS, bool OptLinger, int sqlPort,
                      const char *sqlUser, const char *sqlPwd, const char *dbName, int connPoolNum,
-                     int threadNum, bool openLog, int logLevel, int logQueSize)
+                     int threadNum, bool openLog, int logLevel, int logQueSize,
+                     const ServerConfig &config)
+    : users_(MAX_FD), loopWakeMs_(0), loopWaiting_(false), loopTimeoutMs_(-1), timerCount_(0)
 {
     port_ = port;
     openLinger_ = OptLinger;
     timeoutMS_ = timeoutMS;
+    // 先刷新一次缓存时钟，之后由事件循环每轮刷新
+    CachedClock::SetCoarse(config.coarseClock);
+    CachedClock::Refresh();
+    // 在创建线程池、日志和数据库连接池之前开启，它们的锁从第一次获取起就有统计
+    LockStats::enabled = config.locks.enabled;
+    lockReport_ = config.locks.enabled && config.locks.reportOnExit;
+    // timeoutMS作为keep-alive空闲超时，同时也是所有阶段超时的总开关
+    HttpConn::timeout = config.timeout;
+    HttpConn::timeout.idleMS = timeoutMS;
+    HttpRequest::limits = config.limits;
+    minTimeoutMS_ = timeoutMS;
+    for (int ms : {config.timeout.headerMS, config.timeout.bodyMS, config.timeout.writeStallMS})
+    {
+        if (ms > 0 && ms < minTimeoutMS_)
+        {
+            minTimeoutMS_ = ms;
+        }
+    }
     isClose_ = false;
-    // 时间堆定时器智能指针，这是一个小顶堆数据结构
-    timer_ = std::unique_ptr<HeapTimer>(new HeapTimer());
-    // 线程池
-    threadpool_ = std::unique_ptr<ThreadPool>(new ThreadPool(threadNum));
+    // 分层时间轮定时器，节点嵌在连接槽中
+    timer_ = std::unique_ptr<TimeWheel>(new TimeWheel(
+        std::bind(&WebServer::OnTimeout_, this, std::placeholders::_1)));
+    // 线程池，静态请求通道的任务不会丢弃，其他通道队列满时拒绝请求
+    lanes_[LANE_STATIC] = std::unique_ptr<ThreadPool>(new ThreadPool(
+        threadNum, 1024, QUEUE_SPILL, config.elastic));
+    if (config.dbLane.threads > 0)
+    {
+        lanes_[LANE_DB] = std::unique_ptr<ThreadPool>(new ThreadPool(
+            config.dbLane.threads, config.dbLane.queueSize, QUEUE_DROP));
+    }
+    if (config.adminLane.threads > 0)
+    {
+        lanes_[LANE_ADMIN] = std::unique_ptr<ThreadPool>(new ThreadPool(
+            config.adminLane.threads, config.adminLane.queueSize, QUEUE_DROP));
+    }
+    adminPrefix_ = config.adminPrefix ? config.adminPrefix : "";
     epoller_ = std::unique_ptr<Epoller>(new Epoller());
 
     // getcwd获得当前终端的路径
@@ -20,8 +54,24 @@ WebServer::WebServer(int port, int trigMode, int timeoutMS, bool OptLinger, int
     assert(srcDir_);
     // 将resources挂到字符串尾
     strncat(srcDir_, "/resources/", 16);
-    HttpConn::userCount = 0;
+    HttpConn::userCount.Reset();
     HttpConn::srcDir = srcDir_;
+    HttpConn::accessLog = config.accessLog.enabled;
+    if (config.accessLog.enabled)
+    {
+        AccessLog::Instance()->Init(config.accessLog.dir,
+                                    static_cast<size_t>(config.accessLog.ringKB) * 1024,
+                                    config.accessLog.flushIntervalMs);
+    }
+    if (config.capture.enabled)
+    {
+        TrafficCapture::Instance()->Init(config.capture.dir,
+                                         static_cast<size_t>(config.capture.ringKB) * 1024,
+                                         config.capture.sampleRate,
+                                         static_cast<uint64_t>(config.capture.maxMB) * 1024 * 1024,
+                                         config.capture.flushIntervalMs);
+    }
+    HttpConn::captureTraffic = TrafficCapture::Instance()->IsOpen();
     // 连接本地MySQL
     SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);
 
@@ -34,7 +84,9 @@ WebServer::WebServer(int port, int trigMode, int timeoutMS, bool OptLinger, int
     // 输出log日志
     if (openLog)
     {
-        Log::Instance()->init(logLevel, "./log", ".log", logQueSize);
+        // 二进制日志使用单独的后缀，避免和文本日志写进同一个文件
+        Log::Instance()->init(logLevel, "./log", config.log.binary ? ".blog" : ".log", logQueSize,
+                              config.log.dropOnFull ? QUEUE_DROP : QUEUE_BLOCK, config.log);
         if (isClose_)
         {
             LOG_ERROR("========= Server init error!=========");
@@ -45,18 +97,347 @@ WebServer::WebServer(int port, int trigMode, int timeoutMS, bool OptLinger, int
             LOG_INFO("Port:%d, OpenLinger: %s", port_, OptLinger ? "true" : "false");
             // LT电平触发，是默认工作方式，在LT情况下epoll是一个效率较高的poll
             // ET边沿触发。当注册了一个EPOLLET事件时，epoll将以ET模式来操作该文件描述符，是epoll高效工作模式
-            LOG_INFO("Listen Mode: %d, OpenConn Mode: %s",
+            LOG_INFO("Listen Mode: %s, OpenConn Mode: %s",
                      (listenEvent_ & EPOLLET) ? "ET" : "LT",
                      (connEvent_ & EPOLLET ? "ET" : "LT"));
-            LOG_INFO("LogSys level: %d", logLevel);
+            LOG_INFO("LogSys level: %d, deferred: %s, binary: %s", logLevel,
+                     config.log.deferred ? "true" : "false", config.log.binary ? "true" : "false");
+            LOG_INFO("Log overload drop: %s, site limit: %d/s, sample debug: %.3f, info: %.3f",
+                     config.log.dropOnFull ? "true" : "false", config.log.siteRateLimit,
+                     config.log.debugSample, config.log.infoSample);
             LOG_INFO("srcDir: %s", HttpConn::srcDir);
             LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("Lane db: %d threads x %d, admin: %d threads x %d, admin prefix: %s",
+                     config.dbLane.threads, config.dbLane.queueSize,
+                     config.adminLane.threads, config.adminLane.queueSize, adminPrefix_.c_str());
+            if (config.elastic.enabled)
+            {
+                LOG_INFO("Elastic pool: %d~%d threads, wait p99 target: %dus, idle shrink: %dms",
+                         config.elastic.minThreads, config.elastic.maxThreads,
+                         config.elastic.targetP99Us, config.elastic.idleShrinkMs);
+            }
+            LOG_INFO("Timeout header: %dms, body: %dms, idle: %dms, write: %dms + %dB/s",
+                     HttpConn::timeout.headerMS, HttpConn::timeout.bodyMS, HttpConn::timeout.idleMS,
+                     HttpConn::timeout.writeStallMS, HttpConn::timeout.minSendRate);
+            LOG_INFO("Request limit header: %zuB, body: %zuB", config.limits.maxHeaderBytes, config.limits.maxBodyBytes);
+            LOG_INFO("Access log: %s, dir: %s", config.accessLog.enabled ? "on" : "off",
+                     config.accessLog.dir);
+            if (HttpConn::captureTraffic)
+            {
+                LOG_INFO("Traffic capture: %s, sample rate: %.3f, max: %dMB",
+                         TrafficCapture::Instance()->Path().c_str(), config.capture.sampleRate, config.capture.maxMB);
+            }
+            else if (config.capture.enabled)
+            {
+                // 录制文件必须由本进程新建，已存在或无法创建时不录制
+                LOG_ERROR("Traffic capture: cannot create %s, capture is off",
+                          TrafficCapture::Instance()->Path().c_str());
+            }
+        }
+    }
+    InitAdmin_(config);
+}
+
+/**
+ * @brief 注册管理接口，按配置经过主端口提供或单独监听本机端口
+ *
+ */
+void WebServer::InitAdmin_(const ServerConfig &config)
+{
+    ServerMetrics::enabled = config.metrics.enabled;
+    HotSpots::Init(config.hot);
+    if (config.metrics.enabled && config.metrics.path)
+    {
+        RegisterMetrics_();
+        admin_.Handle(config.metrics.path, [](const HttpRequest &, AdminReply &reply)
+                      {
+                          reply.type = "text/plain; version=0.0.4; charset=utf-8";
+                          reply.body = Metrics::Instance()->Render(); });
+        LOG_INFO("Metrics path: %s", config.metrics.path);
+    }
+    if (config.trace.sampleRate > 0 && config.trace.path)
+    {
+        RequestTracer::Instance()->Init(config.trace.sampleRate, config.trace.capacity);
+        // ?clear=1导出后清空，之后只包含新的请求
+        admin_.Handle(config.trace.path, [](const HttpRequest &request, AdminReply &reply)
+                      {
+                          bool clear = AdminServer::QueryOf(request.path(), "clear") == "1";
+                          reply.type = "application/json";
+                          reply.body = RequestTracer::Instance()->ExportChromeJson(clear); });
+        LOG_INFO("Trace path: %s, sample rate: %.4f, capacity: %d", config.trace.path,
+                 config.trace.sampleRate, config.trace.capacity);
+    }
+    // 运行状态和热点客户端包含客户端地址，只在单独监听时提供，监听都失败时在下面删除或替换
+    bool separate = config.admin.port > 0 || (config.admin.unixPath && *config.admin.unixPath);
+    // ?limit=N每类最多列出N个
+    auto hotReport = [](bool withPeers)
+    {
+        return [withPeers](const HttpRequest &request, AdminReply &reply)
+        {
+            std::string limit = AdminServer::QueryOf(request.path(), "limit");
+            reply.body = HotSpots::Report(limit.empty() ? SIZE_MAX : strtoul(limit.c_str(), nullptr, 10), withPeers);
+        };
+    };
+    if (config.hot.enabled && config.hot.path)
+    {
+        admin_.Handle(config.hot.path, hotReport(separate));
+        LOG_INFO("Hot spots path: %s, k: %d", config.hot.path, config.hot.k);
+    }
+    if (config.locks.enabled && config.locks.path)
+    {
+        admin_.Handle(config.locks.path, [](const HttpRequest &, AdminReply &reply)
+                      { reply.body = LockStats::Report(); });
+        LOG_INFO("Lock stats path: %s", config.locks.path);
+    }
+    if (separate && config.admin.statePath)
+    {
+        // ?limit=N最多列出N个连接，0表示只输出汇总
+        admin_.Handle(config.admin.statePath, [this](const HttpRequest &request, AdminReply &reply)
+                      {
+                          std::string limit = AdminServer::QueryOf(request.path(), "limit");
+                          reply.body = StateReport_(limit.empty() ? 1000 : strtoul(limit.c_str(), nullptr, 10)); });
+    }
+    if (config.admin.port > 0)
+    {
+        if (admin_.Listen(config.admin.port))
+        {
+            LOG_INFO("Admin listen: 127.0.0.1:%d", config.admin.port);
+        }
+        else
+        {
+            LOG_ERROR("Admin listen on port %d failed!", config.admin.port);
+        }
+    }
+    if (config.admin.unixPath && *config.admin.unixPath)
+    {
+        if (admin_.ListenUnix(config.admin.unixPath))
+        {
+            LOG_INFO("Admin listen: unix:%s", config.admin.unixPath);
+        }
+        else
+        {
+            LOG_ERROR("Admin listen on unix:%s failed!", config.admin.unixPath);
+        }
+    }
+    if (separate && config.admin.statePath)
+    {
+        if (admin_.IsListening())
+        {
+            LOG_INFO("State path: %s", config.admin.statePath);
+        }
+        else
+        {
+            admin_.Remove(config.admin.statePath);
+        }
+    }
+    if (separate && admin_.IsListening())
+    {
+        // 指标有锁保护，管理线程启动后登记也可以
+        if (config.metrics.enabled && config.metrics.path)
+        {
+            HotSpots::RegisterPeers();
+        }
+    }
+    else if (separate && config.hot.enabled && config.hot.path)
+    {
+        // 监听都失败时管理线程没有启动，经过主端口提供的报告不列出客户端地址
+        admin_.Remove(config.hot.path);
+        admin_.Handle(config.hot.path, hotReport(false));
+    }
+}
+
+/**
+ * @brief 运行状态快照，文本格式
+ * 事件循环和定时器的状态由事件循环每轮发布，连接表读取各连接发布的原子快照(见HttpConn::GetInfo)，
+ * 都不需要加锁，也不需要停下事件循环，读到的是近似值
+ * 事件循环处于running且距上次唤醒很久，说明事件循环被某个处理阻塞
+ *
+ * @param limit 最多列出的连接数
+ */
+std::string WebServer::StateReport_(size_t limit) const
+{
+    static const char *const LANE_NAMES[LANE_COUNT] = {"static", "db", "admin"};
+    static const char *const PHASE_NAMES[] = {"header", "body", "write", "idle"};
+    // 事件循环卡住时缓存时钟也不再刷新，这里读取实际时间
+    int64_t now = CachedClock::PreciseUs() / 1000;
+    char line[256];
+    std::string out;
+
+    int64_t wakeMs = loopWakeMs_.load(std::memory_order_relaxed);
+    snprintf(line, sizeof(line), "reactor: %s, last wakeup %lld ms ago, epoll timeout %d ms\n",
+             loopWaiting_.load(std::memory_order_relaxed) ? "waiting" : "running",
+             static_cast<long long>(wakeMs > 0 ? now - wakeMs : -1), loopTimeoutMs_.load(std::memory_order_relaxed));
+    out += line;
+    snprintf(line, sizeof(line), "timers: %zu\n", timerCount_.load(std::memory_order_relaxed));
+    out += line;
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        if (!lanes_[i])
+        {
+            continue;
+        }
+        ThreadPool::Stats stats = lanes_[i]->GetStats();
+        snprintf(line, sizeof(line), "lane %s: threads %zu, queued %zu, tasks %llu", LANE_NAMES[i],
+                 stats.threads, stats.queued, static_cast<unsigned long long>(stats.tasks));
+        out += line;
+        if (lanes_[i]->IsElastic())
+        {
+            snprintf(line, sizeof(line), ", grows %llu, shrinks %llu, wait p99 %lldus",
+                     static_cast<unsigned long long>(stats.grows), static_cast<unsigned long long>(stats.shrinks),
+                     static_cast<long long>(stats.lastWaitP99Us));
+            out += line;
+        }
+        out += "\n";
+    }
+    snprintf(line, sizeof(line), "sqlpool: free %d\n", SqlConnPool::Instance()->GetFreeConnCount());
+    out += line;
+    Log::Stats log = Log::Instance()->GetStats();
+    snprintf(line, sizeof(line), "log: rings %zu, queued %zu/%zu bytes, dropped %llu\n", log.rings,
+             log.queuedBytes, log.queueCapacity, static_cast<unsigned long long>(log.dropped));
+    out += line;
+
+    size_t phases[4] = {0};
+    size_t open = 0;
+    std::string table;
+    for (size_t fd = 0; fd < users_.Capacity(); fd++)
+    {
+        const HttpConn *conn = users_.Get(static_cast<int>(fd));
+        if (!conn)
+        {
+            continue;
+        }
+        HttpConn::Info info = conn->GetInfo();
+        open++;
+        phases[info.phase & 3]++;
+        if (open > limit)
+        {
+            continue;
+        }
+        char ip[INET_ADDRSTRLEN] = "-";
+        inet_ntop(AF_INET, &info.addr.sin_addr, ip, sizeof(ip));
+        // deadline为距当前阶段超时的时间，-1表示不限时
+        long long deadline = info.deadlineMs == INT64_MAX ? -1 : static_cast<long long>(info.deadlineMs - now);
+        snprintf(line, sizeof(line), "%-6d %-8u %15s:%-5d %-7s %10zu %10zu %10lld %10lld\n", info.fd, info.gen,
+                 ip, ntohs(info.addr.sin_port), PHASE_NAMES[info.phase & 3], info.readBytes, info.writeBytes,
+                 static_cast<long long>(now - info.openMs), deadline);
+        table += line;
+    }
+    snprintf(line, sizeof(line), "connections: %zu (header %zu, body %zu, write %zu, idle %zu), capacity %zu\n",
+             open, phases[HttpConn::PHASE_HEADER], phases[HttpConn::PHASE_BODY], phases[HttpConn::PHASE_WRITE],
+             phases[HttpConn::PHASE_IDLE], users_.Capacity());
+    out += line;
+    if (limit > 0 && open > 0)
+    {
+        snprintf(line, sizeof(line), "%-6s %-8s %21s %-7s %10s %10s %10s %10s\n", "fd", "gen", "peer", "phase",
+                 "read", "write", "age_ms", "deadline");
+        out += line;
+        out += table;
+        if (open > limit)
+        {
+            snprintf(line, sizeof(line), "... %zu more\n", open - limit);
+            out += line;
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief 登记服务器、线程池和日志的指标
+ * 连接数、队列长度这些已有的统计在抓取时读取，不额外记录
+ *
+ */
+void WebServer::RegisterMetrics_(void)
+{
+    static const char *const LANE_NAMES[LANE_COUNT] = {"static", "db", "admin"};
+    Metrics *metrics = Metrics::Instance();
+    ServerMetrics::Register();
+    if (LockStats::enabled)
+    {
+        LockStats::Register();
+    }
+    HotSpots::Register();
+    metrics->AddGauge("webserver_active_connections", "Open client connections.", "", []
+                      { return static_cast<double>(HttpConn::userCount.Load()); });
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        if (!lanes_[i])
+        {
+            continue;
+        }
+        ThreadPool *pool = lanes_[i].get();
+        std::string labels = std::string("lane=\"") + LANE_NAMES[i] + "\"";
+        metrics->AddGauge("webserver_threadpool_threads", "Worker threads per lane.", labels, [pool]
+                          { return static_cast<double>(pool->GetStats().threads); });
+        metrics->AddGauge("webserver_threadpool_queue_depth", "Tasks waiting in each lane.", labels, [pool]
+                          { return static_cast<double>(pool->GetStats().queued); });
+        metrics->AddCounterFunc("webserver_threadpool_tasks_total", "Tasks executed per lane.", labels, [pool]
+                                { return static_cast<double>(pool->GetStats().tasks); });
+        if (!pool->IsElastic())
+        {
+            continue;
         }
+        metrics->AddCounterFunc("webserver_threadpool_grows_total", "Threads added by the elastic controller.",
+                                labels, [pool]
+                                { return static_cast<double>(pool->GetStats().grows); });
+        metrics->AddCounterFunc("webserver_threadpool_shrinks_total", "Threads removed by the elastic controller.",
+                                labels, [pool]
+                                { return static_cast<double>(pool->GetStats().shrinks); });
+        metrics->AddGauge("webserver_threadpool_wait_p99_seconds",
+                          "Task queueing time p99 over the last elastic control interval.", labels, [pool]
+                          { return pool->GetStats().lastWaitP99Us / 1e6; });
+    }
+    metrics->AddCounterFunc("webserver_log_lines_total", "Log lines written to file.", "", []
+                            { return static_cast<double>(Log::Instance()->GetStats().lines); });
+    metrics->AddCounterFunc("webserver_log_dropped_lines_total", "Log lines dropped by the overload policy.",
+                            "reason=\"full\"", []
+                            { return static_cast<double>(Log::Instance()->GetStats().dropped); });
+    metrics->AddCounterFunc("webserver_log_dropped_lines_total", "Log lines dropped by the overload policy.",
+                            "reason=\"rate_limited\"", []
+                            { return static_cast<double>(Log::Instance()->GetStats().rateLimited); });
+    metrics->AddCounterFunc("webserver_log_dropped_lines_total", "Log lines dropped by the overload policy.",
+                            "reason=\"sampled\"", []
+                            { return static_cast<double>(Log::Instance()->GetStats().sampled); });
+    metrics->AddGauge("webserver_log_queued_bytes", "Bytes waiting in the log buffers.", "", []
+                      { return static_cast<double>(Log::Instance()->GetStats().queuedBytes); });
+    metrics->AddCounterFunc("webserver_access_log_dropped_total", "Access log records dropped on full buffers.",
+                            "", []
+                            { return static_cast<double>(AccessLog::Instance()->Dropped()); });
+    if (HttpConn::captureTraffic)
+    {
+        metrics->AddCounterFunc("webserver_capture_connections_total", "Connections recorded by traffic capture.",
+                                "", []
+                                { return static_cast<double>(TrafficCapture::Instance()->Connections()); });
+        metrics->AddCounterFunc("webserver_capture_bytes_total", "Request bytes written to the capture file.",
+                                "", []
+                                { return static_cast<double>(TrafficCapture::Instance()->Bytes()); });
+        metrics->AddCounterFunc("webserver_capture_dropped_total", "Capture records dropped on full buffers.",
+                                "", []
+                                { return static_cast<double>(TrafficCapture::Instance()->Dropped()); });
     }
 }
 
 WebServer::~WebServer()
 {
+    // 管理线程的处理函数会访问线程池，先停止
+    admin_.Stop();
+    // 再等线程池执行完剩余的任务，任务会访问连接、定时器和epoller，之后清空定时器，连接表最后释放
+    for (auto &lane : lanes_)
+    {
+        lane.reset();
+    }
+    timer_->clear();
+    if (lockReport_)
+    {
+        std::string report = LockStats::Report();
+        size_t begin = 0;
+        LOG_INFO("Lock stats at exit:");
+        while (begin < report.size())
+        {
+            size_t end = report.find('\n', begin);
+            LOG_INFO("%s", report.substr(begin, end - begin).c_str());
+            begin = end == std::string::npos ? report.size() : end + 1;
+        }
+    }
     // 关闭监听文件描述符
     close(listenFd_);
     isClose_ = true;
@@ -114,37 +495,50 @@ void WebServer::Start(void)
         if (timeoutMS_ > 0)
         {
             timeMS = timer_->GetNextTick();
+            timerCount_.store(timer_->size(), std::memory_order_relaxed);
         }
+        loopTimeoutMs_.store(timeMS, std::memory_order_relaxed);
+        loopWaiting_.store(true, std::memory_order_relaxed);
         // 非阻塞等待文件描述符事件
         int eventCnt = epoller_->Wait(timeMS);
+        loopWaiting_.store(false, std::memory_order_relaxed);
+        USDT_PROBE1(loop_wakeup, eventCnt);
+        // 每轮只读取一次系统时间，本轮处理的事件都使用这个时间
+        CachedClock::Refresh();
+        loopWakeMs_.store(CachedClock::NowMs(), std::memory_order_relaxed);
         // 内核态检测到有文件描述符有事件发生
         for (int i = 0; i < eventCnt; i++)
         {
             // 处理事件
             int fd = epoller_->GetEventFd(i);
             uint32_t events = epoller_->GetEvents(i);
+            USDT_PROBE2(event_dispatch, fd, events);
 
             if (fd == listenFd_)
             {
                 // 监听线程
                 DealListen_();
+                continue;
+            }
+            // 代数不一致说明fd已被关闭或复用，丢弃过期事件
+            HttpConn *client = users_.Find(fd, epoller_->GetEventGen(i));
+            if (!client)
+            {
+                LOG_DEBUG("Stale event on fd[%d]", fd);
             }
             else if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
             {
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);
+                CloseConn_(client);
             }
             else if (events & EPOLLIN)
             {
                 // 有文件描述符读入数据
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]);
+                DealRead_(client);
             }
             else if (events & EPOLLOUT)
             {
                 // 有文件描述符写出数据
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);
+                DealWrite_(client);
             }
             else
             {
@@ -174,6 +568,7 @@ void WebServer::CloseConn_(HttpConn *client)
 {
     assert(client);
     LOG_INFO("Client[%d] quit!", client->GetFd());
+    USDT_PROBE1(conn_close, client->GetFd());
     // 删除文件描述符
     epoller_->DelFd(client->GetFd());
     client->Close();
@@ -182,16 +577,28 @@ void WebServer::CloseConn_(HttpConn *client)
 void WebServer::AddClient_(int fd, sockaddr_in addr)
 {
     assert(fd > 0);
-    users_[fd].Init(fd, addr);
+    uint32_t gen = 0;
+    HttpConn *client = users_.Acquire(fd, &gen);
+    if (!client)
+    {
+        // fd超出连接表容量，即连接数量超过最大客户端文件描述符数量
+        SendError_(fd, "Server busy!");
+        ServerMetrics::rejected++;
+        LOG_WARN("Clients is full!");
+        return;
+    }
+    client->Init(fd, addr, gen);
+    USDT_PROBE3(conn_open, fd, addr.sin_addr.s_addr, ntohs(addr.sin_port));
     if (timeoutMS_ > 0)
     {
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
+        // 定时器节点随槽复用，旧连接残留的定时器在这里被重新设置
+        timer_->add(users_.Timer(fd), ArmTime_(client));
     }
     // 往epoller中添加文件描述符，使epoll自动监听
-    epoller_->AddFd(fd, EPOLLIN | connEvent_);
+    epoller_->AddFd(fd, EPOLLIN | connEvent_, gen);
     // 每一个新的连接都要设为非阻塞模式
     SetFdNonblock(fd);
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    LOG_INFO("Client[%d] in!", fd);
 }
 
 /**
@@ -211,14 +618,12 @@ void WebServer::DealListen_(void)
         {
             return;
         }
-        else if (HttpConn::userCount >= MAX_FD)
+        if (ServerMetrics::enabled)
         {
-            // 连接数量超过最大客户端文件描述符数量
-            SendError_(fd, "Server busy!");
-            LOG_WARN("Clients is full!");
-            return;
+            ServerMetrics::accepted++;
         }
         // 服务器接收HTTP请求，此时与客户端浏览器建立TCP连接
+        // 连接数量是否超过上限由连接表容量判断，fd超出容量时AddClient_直接拒绝
         AddClient_(fd, addr);
     } while (listenEvent_ & EPOLLET);
 }
@@ -231,15 +636,60 @@ void WebServer::DealListen_(void)
 void WebServer::DealRead_(HttpConn *client)
 {
     assert(client);
+    // EPOLLONESHOT保证此时没有工作线程在处理该连接，持有计数在交还之后才减，可能还未归零
+    client->BeginRequest();
+    client->Trace(RequestTracer::STAGE_READABLE);
     ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
+    client->Hold();
+    // lambda只捕获两个指针，直接存放在任务内部，不分配内存
+    lanes_[LANE_STATIC]->AddTask([this, client]
+                                 { OnRead_(client); });
 }
 
 void WebServer::DealWrite_(HttpConn *client)
 {
     assert(client);
     ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
+    client->Hold();
+    lanes_[LANE_STATIC]->AddTask([this, client]
+                                 { OnWrite_(client); });
+}
+
+/**
+ * @brief 工作线程处理完后把连接交还给epoll
+ * 先ModFd再释放持有：释放之后事件循环才可能因超时关闭连接，这时不会再有ModFd作用到被复用的fd上
+ *
+ * @param client 工作线程持有的连接
+ * @param events 交还后关注的事件
+ */
+void WebServer::Handoff_(HttpConn *client, uint32_t events)
+{
+    epoller_->ModFd(client->GetFd(), connEvent_ | events, client->GetGen());
+    client->Release();
+}
+
+void WebServer::Drop_(HttpConn *client)
+{
+    CloseConn_(client);
+    client->Release();
+}
+
+/**
+ * @brief 计算连接定时器下一次检查的时间
+ * 工作线程切换阶段时不操作定时器，新阶段的期限不会早于切换时刻加上最短的阶段超时
+ * 所以定时器最迟在minTimeoutMS_后检查一次，就不会错过任何阶段的期限
+ *
+ * @param client HTTP连接
+ * @return int 距离下一次检查的时间，单位ms
+ */
+int WebServer::ArmTime_(HttpConn *client)
+{
+    int64_t remain = client->GetDeadline() - TimeWheel::NowMs();
+    if (remain > minTimeoutMS_)
+    {
+        remain = minTimeoutMS_;
+    }
+    return remain < 0 ? 0 : static_cast<int>(remain);
 }
 
 void WebServer::ExtentTime_(HttpConn *client)
@@ -247,37 +697,136 @@ void WebServer::ExtentTime_(HttpConn *client)
     assert(client);
     if (timeoutMS_ > 0)
     {
-        timer_->adjust(client->GetFd(), timeoutMS_);
+        // 期限由连接当前阶段决定，收到零碎数据不会延长请求头和请求体的期限
+        // 检查时间推后时只修改节点的到期时间，由时间轮惰性重排
+        WheelNode *node = users_.Timer(client->GetFd());
+        if (node->IsLinked())
+        {
+            timer_->adjust(node, ArmTime_(client));
+        }
+        else
+        {
+            timer_->add(node, ArmTime_(client));
+        }
+    }
+}
+
+/**
+ * @brief 定时器到期，连接当前阶段的期限已过则关闭连接，否则重新挂载
+ *
+ * @param node 到期的定时器节点
+ */
+void WebServer::OnTimeout_(WheelNode *node)
+{
+    // 连接已经被工作线程关闭的，槽中没有需要处理的连接
+    HttpConn *client = users_.Get(node->id);
+    if (!client)
+    {
+        return;
     }
+    if (client->GetDeadline() > TimeWheel::NowMs())
+    {
+        timer_->add(node, ArmTime_(client));
+        return;
+    }
+    // 工作线程还持有连接(排队或正在处理)，关闭会让它继续使用已关闭甚至被复用的连接
+    // 期限已过，按最短阶段超时重新检查，交还之后仍然超时的再关闭
+    if (client->IsHeld())
+    {
+        timer_->add(node, minTimeoutMS_);
+        return;
+    }
+    LOG_INFO("Client[%d] timeout in phase %d", client->GetFd(), client->GetPhase());
+    CloseConn_(client);
 }
 
 void WebServer::OnRead_(HttpConn *client)
 {
     // OnRead要注意，是先有请求报文后服务器发送响应报文
     assert(client);
+    client->Trace(RequestTracer::STAGE_DEQUEUED);
     int ret = -1;
     int readErrno = 0;
     ret = client->read(&readErrno);
     if (ret <= 0 && readErrno != EAGAIN)
     {
-        CloseConn_(client);
+        Drop_(client);
         return;
     }
     OnProcess_(client);
 }
 
+/**
+ * @brief 根据解析出的请求选择执行通道
+ *
+ * @param client HTTP连接，已解析出完整请求
+ * @return TASK_LANE 对应通道没有单独的线程池时返回LANE_STATIC
+ */
+WebServer::TASK_LANE WebServer::Route_(HttpConn *client) const
+{
+    const HttpRequest &request = client->GetRequest();
+    TASK_LANE lane = LANE_STATIC;
+    if (request.NeedsVerify())
+    {
+        lane = LANE_DB;
+    }
+    else if (IsAdminPath_(client) ||
+             (!adminPrefix_.empty() && request.path().compare(0, adminPrefix_.size(), adminPrefix_) == 0))
+    {
+        lane = LANE_ADMIN;
+    }
+    return lanes_[lane] ? lane : LANE_STATIC;
+}
+
 void WebServer::OnProcess_(HttpConn *client)
 {
-    if (client->process())
+    if (!client->ParseRequest())
+    {
+        Handoff_(client, EPOLLIN);
+        return;
+    }
+    TASK_LANE lane = Route_(client);
+    if (lane != LANE_STATIC)
     {
-        // 将该文件描述符设为EPOLLOUT状态，这样在while循环时，内核态监听到文件描述符处于EPOLLOUT
-        // 之后就可以调用OnWrite_方法
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+        // EPOLLONESHOT保证转交之后只有目标通道的线程持有该连接，持有计数随任务一起转交
+        if (lanes_[lane]->AddTask([this, client]
+                                  { OnRespond_(client); }))
+        {
+            return;
+        }
+        LOG_WARN("Lane %d is full, reject client[%d]", lane, client->GetFd());
+        client->MakeResponse(503);
     }
     else
     {
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+        Respond_(client);
     }
+    // 将该文件描述符设为EPOLLOUT状态，这样在while循环时，内核态监听到文件描述符处于EPOLLOUT
+    // 之后就可以调用OnWrite_方法
+    Handoff_(client, EPOLLOUT);
+}
+
+void WebServer::OnRespond_(HttpConn *client)
+{
+    Respond_(client);
+    Handoff_(client, EPOLLOUT);
+}
+
+// 管理接口没有单独监听时，主端口上的管理路径由处理函数生成响应
+bool WebServer::IsAdminPath_(const HttpConn *client) const
+{
+    return !admin_.IsListening() && admin_.Has(client->GetRequest().path());
+}
+
+void WebServer::Respond_(HttpConn *client)
+{
+    AdminReply reply;
+    if (IsAdminPath_(client) && admin_.Dispatch(client->GetRequest(), reply))
+    {
+        client->MakeResponse(reply.code, reply.type, reply.body);
+        return;
+    }
+    client->MakeResponse();
 }
 
 void WebServer::OnWrite_(HttpConn *client)
@@ -289,6 +838,7 @@ void WebServer::OnWrite_(HttpConn *client)
     if (client->ToWriteBytes() == 0)
     {
         // 传输完成
+        client->FinishRequest();
         if (client->IsKeepAlive())
         {
             OnProcess_(client);
@@ -300,11 +850,11 @@ void WebServer::OnWrite_(HttpConn *client)
         if (writeErrno == EAGAIN)
         {
             // 继续传输
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+            Handoff_(client, EPOLLOUT);
             return;
         }
     }
-    CloseConn_(client);
+    Drop_(client);
 }
 
 /**
@@ -2,6 +2,8 @@
 #define WEBSERVER_H
 
 #include <unordered_map>
+#include <string>
+#include <atomic>
 #include <fcntl.h>
 #include <unistd.h>
 #include <assert.h>
@@ -11,16 +13,35 @@
 #include <arpa/inet.h>
 
 #include "epoll.h"
+#include "connslab.h"
 #include "../log/log.h"
-#include "../timer/heaptimer.h"
+#include "../timer/timewheel.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/threadpool.h"
 #include "../pool/sqlconnRAII.h"
 #include "../http/httpconn.h"
+#include "../metrics/metrics.h"
+#include "../metrics/lockstats.h"
+#include "adminserver.h"
+#include "../config/config.h"
 
 class WebServer
 {
 private:
+    /**
+     * @brief 执行通道，不同开销的请求由各自的线程池处理
+     * 读写事件和静态文件请求都在LANE_STATIC中处理，解析完请求后再按类型转交其他通道，
+     * 数据库响应慢时只会占满数据库通道，不会阻塞静态请求
+     *
+     */
+    enum TASK_LANE
+    {
+        LANE_STATIC = 0,
+        LANE_DB,
+        LANE_ADMIN,
+        LANE_COUNT,
+    };
+
     // 初始化socket
     bool InitSocket_(void);
     void InitEventMode_(int trigMode);
@@ -33,11 +54,24 @@ private:
 
     void SendError_(int fd, const char *info);
     void ExtentTime_(HttpConn *client);
+    int ArmTime_(HttpConn *client);
     void CloseConn_(HttpConn *client);
+    // 工作线程交还连接，重新关注events事件
+    void Handoff_(HttpConn *client, uint32_t events);
+    // 工作线程关闭自己持有的连接
+    void Drop_(HttpConn *client);
+    void OnTimeout_(WheelNode *node);
 
     void OnRead_(HttpConn *client);
     void OnWrite_(HttpConn *client);
     void OnProcess_(HttpConn *client);
+    void OnRespond_(HttpConn *client);
+    TASK_LANE Route_(HttpConn *client) const;
+    void Respond_(HttpConn *client);
+    bool IsAdminPath_(const HttpConn *client) const;
+    void InitAdmin_(const ServerConfig &config);
+    void RegisterMetrics_(void);
+    std::string StateReport_(size_t limit) const;
 
     // 最大连接数
     static const int MAX_FD = 65535;
@@ -47,6 +81,8 @@ private:
     int port_;
     bool openLinger_;
     int timeoutMS_;
+    // 各阶段超时中最短的一个，定时器最迟在这个时间后检查一次连接
+    int minTimeoutMS_;
     bool isClose_;
     // 监听的文件描述符
     int listenFd_;
@@ -56,10 +92,23 @@ private:
     uint32_t listenEvent_;
     uint32_t connEvent_;
 
-    std::unique_ptr<HeapTimer> timer_;
-    std::unique_ptr<ThreadPool> threadpool_;
+    // 以fd为下标的连接表，定时器节点嵌在连接中，线程池的任务也持有连接，所以先于它们声明、后于它们析构
+    ConnSlab users_;
+    std::unique_ptr<TimeWheel> timer_;
+    // 各通道的线程池，未单独配置的通道为空，请求留在LANE_STATIC中处理
+    std::unique_ptr<ThreadPool> lanes_[LANE_COUNT];
+    std::string adminPrefix_;
+    // 析构时把锁争用报告写入日志
+    bool lockReport_;
+    // 管理接口，单独监听时主端口不处理其中的路径
+    AdminServer admin_;
     std::unique_ptr<Epoller> epoller_;
-    std::unordered_map<int, HttpConn> users_;
+    // 事件循环每轮发布的状态，管理接口在其他线程读取，不需要停下事件循环
+    std::atomic<int64_t> loopWakeMs_;
+    std::atomic<bool> loopWaiting_;
+    // 本轮epoll_wait的超时，即距下一个定时器到期的时间，-1表示没有定时器
+    std::atomic<int> loopTimeoutMs_;
+    std::atomic<size_t> timerCount_;
 
 public:
     /**
@@ -78,10 +127,13 @@ public:
      * @param openLog 日志开关
      * @param logLevel 日志等级
      * @param logQueSize 日志异步队列容量
+     * @param config 可选配置，timeoutMS会覆盖其中的config.timeout.idleMS，
+     *               threadNum为静态请求通道的线程数
      */
     WebServer(int port, int trigMode, int timeoutMS, bool OptLinger, int sqlPort,
               const char *sqlUser, const char *sqlPwd, const char *dbName, int connPoolNum,
-              int threadNum, bool openLog, int logLevel, int logQueSize);
+              int threadNum, bool openLog, int logLevel, int logQueSize,
+              const ServerConfig &config = ServerConfig());
     ~WebServer();
 
     void Start(void);
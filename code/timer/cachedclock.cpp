@@ -0,0 +1,49 @@
+#include "cachedclock.h"
+
+std::atomic<int64_t> CachedClock::monoMs_(0);
+std::atomic<int64_t> CachedClock::wallUs_(0);
+std::atomic<int> CachedClock::slotIndex_(0);
+ClockSecond CachedClock::slots_[CachedClock::SLOTS];
+std::atomic<bool> CachedClock::coarse_(false);
+std::atomic_flag CachedClock::refreshing_ = ATOMIC_FLAG_INIT;
+std::atomic<bool> CachedClock::inited_(false);
+
+void CachedClock::SetCoarse(bool coarse)
+{
+    coarse_.store(coarse, std::memory_order_relaxed);
+}
+
+void CachedClock::Refresh(void)
+{
+    // 已经有线程在刷新，直接使用它的结果
+    if (refreshing_.test_and_set(std::memory_order_acquire))
+    {
+        return;
+    }
+    bool coarse = coarse_.load(std::memory_order_relaxed);
+    struct timespec mono, wall;
+    clock_gettime(coarse ? CLOCK_MONOTONIC_COARSE : CLOCK_MONOTONIC, &mono);
+    clock_gettime(coarse ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME, &wall);
+    monoMs_.store(static_cast<int64_t>(mono.tv_sec) * 1000 + mono.tv_nsec / 1000000,
+                  std::memory_order_relaxed);
+
+    // 秒数变化时才重新生成本地时间和格式化字符串
+    int index = slotIndex_.load(std::memory_order_relaxed);
+    if (!inited_.load(std::memory_order_relaxed) || slots_[index].sec != wall.tv_sec)
+    {
+        int next = (index + 1) % SLOTS;
+        ClockSecond &slot = slots_[next];
+        time_t sec = wall.tv_sec;
+        struct tm gmt;
+        slot.sec = wall.tv_sec;
+        localtime_r(&sec, &slot.tm);
+        gmtime_r(&sec, &gmt);
+        strftime(slot.logTime, sizeof(slot.logTime), "%Y-%m-%d %H:%M:%S", &slot.tm);
+        strftime(slot.httpDate, sizeof(slot.httpDate), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+        slotIndex_.store(next, std::memory_order_release);
+    }
+    wallUs_.store(static_cast<int64_t>(wall.tv_sec) * 1000000 + wall.tv_nsec / 1000,
+                  std::memory_order_relaxed);
+    inited_.store(true, std::memory_order_release);
+    refreshing_.clear(std::memory_order_release);
+}
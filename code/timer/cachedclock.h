@@ -0,0 +1,99 @@
+/**
+ * @file cachedclock.h
+ * @brief 缓存时钟，事件循环每轮刷新一次，定时器、日志和HTTP响应头都从这里读取时间
+ *
+ */
+#ifndef CACHED_CLOCK_H
+#define CACHED_CLOCK_H
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * @brief 每秒变化一次的时间信息，格式化好的字符串只在秒数变化时生成一次
+ *
+ */
+struct ClockSecond
+{
+    // 墙上时间秒数
+    int64_t sec;
+    // 本地时间
+    struct tm tm;
+    // 日志时间戳，如2022-03-12 10:00:00
+    char logTime[32];
+    // HTTP Date头，如Sat, 12 Mar 2022 02:00:00 GMT
+    char httpDate[40];
+};
+
+/**
+ * @brief 缓存的单调时钟和墙上时钟
+ * 读取只是原子变量的load，不再调用clock_gettime、gettimeofday和localtime
+ * 读到的时间最多落后一轮事件循环
+ *
+ */
+class CachedClock
+{
+private:
+    // 秒级信息轮流写入多个槽，读者拿到的槽在很多秒内都不会被覆盖
+    static const int SLOTS = 8;
+
+    static std::atomic<int64_t> monoMs_;
+    static std::atomic<int64_t> wallUs_;
+    static std::atomic<int> slotIndex_;
+    static ClockSecond slots_[SLOTS];
+    static std::atomic<bool> coarse_;
+    static std::atomic_flag refreshing_;
+    static std::atomic<bool> inited_;
+
+public:
+    /**
+     * @brief 重新读取系统时间，由事件循环在每次epoll_wait返回后调用
+     * 多个线程同时刷新时只有一个线程真正执行
+     *
+     */
+    static void Refresh(void);
+
+    // 是否使用CLOCK_MONOTONIC_COARSE和CLOCK_REALTIME_COARSE，精度为一个时钟节拍
+    static void SetCoarse(bool coarse);
+
+    // 单调时钟，单位ms
+    static int64_t NowMs(void)
+    {
+        if (!inited_.load(std::memory_order_acquire))
+        {
+            Refresh();
+        }
+        return monoMs_.load(std::memory_order_relaxed);
+    }
+
+    // 墙上时钟，单位us
+    static int64_t WallUs(void)
+    {
+        if (!inited_.load(std::memory_order_acquire))
+        {
+            Refresh();
+        }
+        return wallUs_.load(std::memory_order_relaxed);
+    }
+
+    // 当前秒的时间信息
+    static const ClockSecond &Second(void)
+    {
+        if (!inited_.load(std::memory_order_acquire))
+        {
+            Refresh();
+        }
+        return slots_[slotIndex_.load(std::memory_order_acquire)];
+    }
+
+    // 不经过缓存直接读取单调时钟，单位us，用于测量请求各阶段的耗时
+    static int64_t PreciseUs(void)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    }
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "heaptimer.h"
+#include "../metrics/probes.h"
 
 HeapTimer::HeapTimer(/* args */)
 {
@@ -15,10 +16,11 @@ void HeapTimer::siftup_(size_t i)
 {
     // 小根堆节点上移方法
     assert(i >= 0 && i < heap_.size());
-    // j是节点i的父节点
-    size_t j = (i - 1) / 2;
-    while (j >= 0)
+    // i为0时已经是根节点，size_t的(i - 1) / 2会回绕成很大的下标
+    while (i > 0)
     {
+        // j是节点i的父节点
+        size_t j = (i - 1) / 2;
         // <生效是因为在struct做了重载
         if (heap_[j] < heap_[i])
         {
@@ -26,7 +28,6 @@ void HeapTimer::siftup_(size_t i)
         }
         SwapNode_(i, j);
         i = j;
-        j = (i - 1) / 2;
     }
 }
 
@@ -165,6 +166,7 @@ void HeapTimer::tick(void)
     {
         return;
     }
+    int expired = 0;
     while (!heap_.empty())
     {
         TimerNode node = heap_.front();
@@ -174,7 +176,9 @@ void HeapTimer::tick(void)
         }
         node.cb();
         pop();
+        expired++;
     }
+    USDT_PROBE2(timer_tick, expired, heap_.size());
 }
 
 /**
@@ -0,0 +1,265 @@
+#include "timewheel.h"
+#include "../metrics/probes.h"
+
+TimeWheel::TimeWheel(const ExpireHandler &handler) : size_(0), handler_(handler)
+{
+    // 每个槽的哨兵节点首尾相连，表示空链表
+    for (auto &slot : tv1_)
+    {
+        slot.head.prev = slot.head.next = &slot.head;
+    }
+    for (auto &level : tvn_)
+    {
+        for (auto &slot : level)
+        {
+            slot.head.prev = slot.head.next = &slot.head;
+        }
+    }
+    current_ = NowMs();
+}
+
+TimeWheel::~TimeWheel()
+{
+    clear();
+}
+
+TimeWheel::Slot &TimeWheel::SlotAt_(int level, int index)
+{
+    assert(level >= 1 && level < LEVELS);
+    return tvn_[level - 1][index];
+}
+
+/**
+ * @brief 按节点的slotTick把节点挂到对应层、对应槽的链表尾
+ *
+ * @param node 未挂载的节点
+ */
+void TimeWheel::Link_(WheelNode *node)
+{
+    assert(!node->IsLinked());
+    int64_t delta = node->slotTick - current_;
+    Slot *slot = nullptr;
+    if (delta < 0)
+    {
+        // 已经过期，放到下一次处理的槽
+        slot = &tv1_[current_ & TVR_MASK];
+    }
+    else if (delta < TVR_SIZE)
+    {
+        slot = &tv1_[node->slotTick & TVR_MASK];
+    }
+    else
+    {
+        if (delta > MAX_DELTA)
+        {
+            node->slotTick = current_ + MAX_DELTA;
+            delta = MAX_DELTA;
+        }
+        for (int level = 1; level < LEVELS; level++)
+        {
+            int shift = TVR_BITS + level * TVN_BITS;
+            if (delta < (1LL << shift) || level == LEVELS - 1)
+            {
+                int index = (node->slotTick >> (shift - TVN_BITS)) & TVN_MASK;
+                slot = &SlotAt_(level, index);
+                break;
+            }
+        }
+    }
+    assert(slot);
+    WheelNode *head = &slot->head;
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimeWheel::Unlink_(WheelNode *node)
+{
+    assert(node->IsLinked());
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+}
+
+/**
+ * @brief 把第level层当前槽的节点下放到低层
+ *
+ * @param level 层数，1~4
+ */
+void TimeWheel::Cascade_(int level)
+{
+    int shift = TVR_BITS + (level - 1) * TVN_BITS;
+    int index = (current_ >> shift) & TVN_MASK;
+    WheelNode *head = &SlotAt_(level, index).head;
+    while (head->next != head)
+    {
+        WheelNode *node = head->next;
+        Unlink_(node);
+        // 下放时直接使用真实的到期时间
+        node->slotTick = node->expires;
+        Link_(node);
+    }
+    // 本层也转了一整圈，继续下放更高一层
+    if (index == 0 && level + 1 < LEVELS)
+    {
+        Cascade_(level + 1);
+    }
+}
+
+void TimeWheel::Expire_(Slot &slot)
+{
+    // 先把整条链表摘到局部哨兵上，回调中对其他节点的操作不会影响遍历
+    WheelNode local;
+    WheelNode *head = &slot.head;
+    if (head->next == head)
+    {
+        return;
+    }
+    local.next = head->next;
+    local.prev = head->prev;
+    local.next->prev = &local;
+    local.prev->next = &local;
+    head->prev = head->next = head;
+
+    while (local.next != &local)
+    {
+        WheelNode *node = local.next;
+        Unlink_(node);
+        if (node->expires > current_)
+        {
+            // 定时器在挂载之后被延后过，惰性重排到新的位置
+            node->slotTick = node->expires;
+            Link_(node);
+            continue;
+        }
+        size_--;
+        handler_(node);
+    }
+}
+
+void TimeWheel::add(WheelNode *node, int timeOut)
+{
+    assert(node);
+    if (node->IsLinked())
+    {
+        Unlink_(node);
+    }
+    else
+    {
+        size_++;
+    }
+    node->expires = NowMs() + timeOut;
+    node->slotTick = node->expires;
+    Link_(node);
+}
+
+void TimeWheel::adjust(WheelNode *node, int newExpires)
+{
+    assert(node && node->IsLinked());
+    node->expires = NowMs() + newExpires;
+    if (node->expires < node->slotTick)
+    {
+        // 提前到期的情况不能惰性处理，需要立即移动节点
+        Unlink_(node);
+        node->slotTick = node->expires;
+        Link_(node);
+    }
+}
+
+void TimeWheel::cancel(WheelNode *node)
+{
+    assert(node);
+    if (node->IsLinked())
+    {
+        Unlink_(node);
+        size_--;
+    }
+}
+
+void TimeWheel::clear(void)
+{
+    auto clearSlot = [](Slot &slot)
+    {
+        WheelNode *head = &slot.head;
+        while (head->next != head)
+        {
+            Unlink_(head->next);
+        }
+    };
+    for (auto &slot : tv1_)
+    {
+        clearSlot(slot);
+    }
+    for (auto &level : tvn_)
+    {
+        for (auto &slot : level)
+        {
+            clearSlot(slot);
+        }
+    }
+    size_ = 0;
+}
+
+void TimeWheel::tick(void)
+{
+    int64_t now = NowMs();
+    // 到期回调中重新添加的定时器会抵消一部分，探针中的到期数是近似值
+    size_t before = size_;
+    while (current_ <= now)
+    {
+        int index = current_ & TVR_MASK;
+        if (index == 0)
+        {
+            // 第0层转完一圈，从第1层下放一个槽
+            Cascade_(1);
+        }
+        Expire_(tv1_[index]);
+        current_++;
+    }
+    USDT_PROBE2(timer_tick, static_cast<int>(before > size_ ? before - size_ : 0), size_);
+}
+
+int TimeWheel::GetNextTick(void)
+{
+    tick();
+    if (size_ == 0)
+    {
+        return -1;
+    }
+    int64_t now = NowMs();
+    int64_t res = MAX_DELTA;
+    // 第0层按槽找到最近的非空槽
+    for (int i = 0; i < TVR_SIZE; i++)
+    {
+        const WheelNode *head = &tv1_[(current_ + i) & TVR_MASK].head;
+        if (head->next != head)
+        {
+            res = current_ + i - now;
+            break;
+        }
+    }
+    // 高层节点只需要在下放时醒来，取最近一次下放的时间
+    // 第0层最近的节点可能比高层节点的下放时间还晚，两者取较早的一个
+    for (int level = 1; level < LEVELS; level++)
+    {
+        int shift = TVR_BITS + (level - 1) * TVN_BITS;
+        int64_t base = current_ >> shift;
+        // current_正好在本层的边界上时，当前槽还没有下放，也要检查
+        int first = (current_ & ((1LL << shift) - 1)) == 0 ? 0 : 1;
+        for (int j = first; j <= TVN_SIZE; j++)
+        {
+            const WheelNode *head = &SlotAt_(level, (base + j) & TVN_MASK).head;
+            if (head->next != head)
+            {
+                int64_t wait = ((base + j) << shift) - now;
+                if (wait < res)
+                {
+                    res = wait;
+                }
+                break;
+            }
+        }
+    }
+    return res < 0 ? 0 : static_cast<int>(res);
+}
@@ -0,0 +1,103 @@
+#ifndef TIME_WHEEL_H
+#define TIME_WHEEL_H
+
+#include <functional>
+#include <assert.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "cachedclock.h"
+
+/**
+ * @brief 时间轮定时器节点，侵入式地嵌在连接槽中，不需要额外分配内存
+ * expires是真正的到期时间，slotTick是节点当前挂在时间轮上的位置
+ * 两者不相等时说明定时器被延后了，等到节点所在槽到期时再重新挂到正确位置（惰性重排）
+ *
+ */
+struct WheelNode
+{
+    WheelNode *prev;
+    WheelNode *next;
+    // 到期时间，单位ms
+    int64_t expires;
+    // 挂在时间轮上的到期时间，单位ms
+    int64_t slotTick;
+    // 节点所属对象的标识，一般为文件描述符
+    int id;
+
+    WheelNode() : prev(nullptr), next(nullptr), expires(0), slotTick(0), id(-1) {}
+    bool IsLinked(void) const { return prev != nullptr; }
+};
+
+// 整个时间轮共用一个到期处理函数，节点本身不保存std::function
+typedef std::function<void(WheelNode *)> ExpireHandler;
+
+/**
+ * @brief 分层时间轮定时器
+ * 第0层256个槽，每槽1ms；第1~4层各64个槽，每层的一个槽覆盖下一层一整圈
+ * 添加、延时、取消都是O(1)的链表操作，到期时高层的节点逐层下放到低层
+ *
+ */
+class TimeWheel
+{
+private:
+    static const int TVR_BITS = 8;
+    static const int TVN_BITS = 6;
+    static const int TVR_SIZE = 1 << TVR_BITS;
+    static const int TVN_SIZE = 1 << TVN_BITS;
+    static const int TVR_MASK = TVR_SIZE - 1;
+    static const int TVN_MASK = TVN_SIZE - 1;
+    static const int LEVELS = 5;
+    // 最大可表示的时间差，超过的按最大值挂载，到期后会再次重排
+    static const int64_t MAX_DELTA = (1LL << (TVR_BITS + (LEVELS - 1) * TVN_BITS)) - 1;
+
+    // 槽的头节点，链表为带哨兵的双向循环链表
+    struct Slot
+    {
+        WheelNode head;
+    };
+
+    void Link_(WheelNode *node);
+    static void Unlink_(WheelNode *node);
+    void Cascade_(int level);
+    void Expire_(Slot &slot);
+    Slot &SlotAt_(int level, int index);
+
+    Slot tv1_[TVR_SIZE];
+    Slot tvn_[LEVELS - 1][TVN_SIZE];
+    // 时间轮当前处理到的时间，单位ms
+    int64_t current_;
+    size_t size_;
+    ExpireHandler handler_;
+
+public:
+    explicit TimeWheel(const ExpireHandler &handler);
+    ~TimeWheel();
+
+    /**
+     * @brief 添加定时器，节点已在时间轮中则重新设置到期时间
+     *
+     * @param node 定时器节点
+     * @param timeOut 过期时间，单位ms
+     */
+    void add(WheelNode *node, int timeOut);
+    /**
+     * @brief 延后定时器，只修改到期时间，不移动节点
+     *
+     * @param node 定时器节点
+     * @param newExpires 新的过期时间，单位ms
+     */
+    void adjust(WheelNode *node, int newExpires);
+    void cancel(WheelNode *node);
+    void clear(void);
+    // 处理所有到期的节点
+    void tick(void);
+    // 处理到期节点，并返回距离下一次需要处理的时间，没有定时器返回-1
+    int GetNextTick(void);
+    size_t size(void) const { return size_; }
+
+    // 单调时钟当前时间，单位ms，所有到期时间都以此为基准
+    // 使用缓存时钟，时间在事件循环每轮开始时刷新
+    static int64_t NowMs(void) { return CachedClock::NowMs(); }
+};
+
+#endif
@@ -0,0 +1,328 @@
+/**
+ * @file accesslog.cpp
+ * @brief 读取访问日志文件，导出为CSV或文本，或者输出汇总统计
+ *
+ * 用法：accesslog csv|text|stats 访问日志文件...
+ *   csv   每个请求一行，带表头
+ *   text  每个请求一行，格式和常见的访问日志类似
+ *   stats 请求数、吞吐、状态码分布、总耗时和各阶段耗时的分位数、请求最多的路径
+ * 不指定文件时从标准输入读取，结果写到标准输出
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <unordered_map>
+
+#include "../code/log/accesslog.h"
+#include "../code/metrics/histogram.h"
+
+namespace
+{
+    enum OUTPUT_MODE
+    {
+        MODE_CSV,
+        MODE_TEXT,
+        MODE_STATS,
+    };
+
+    // 各阶段耗时，和AccessRecord中的顺序一致
+    enum STAGE
+    {
+        STAGE_TOTAL,
+        STAGE_RECV,
+        STAGE_QUEUE,
+        STAGE_HANDLE,
+        STAGE_SEND,
+        STAGE_COUNT,
+    };
+    const char *const STAGE_NAMES[STAGE_COUNT] = {"total", "recv", "queue", "handle", "send"};
+    const int TOP_PATHS = 10;
+
+    struct Stats
+    {
+        uint64_t requests = 0;
+        uint64_t bytes = 0;
+        int64_t firstUs = INT64_MAX;
+        int64_t lastUs = 0;
+        std::map<int, uint64_t> status;
+        uint64_t methods[AccessLog::METHOD_COUNT] = {0};
+        std::vector<uint64_t> latency[STAGE_COUNT];
+        uint64_t latencySum[STAGE_COUNT] = {0};
+        std::unordered_map<std::string, uint64_t> paths;
+
+        Stats()
+        {
+            for (auto &counts : latency)
+            {
+                counts.assign(Histogram::BUCKETS, 0);
+            }
+        }
+    };
+
+    bool ReadExact(FILE *fp, void *buf, size_t len)
+    {
+        return fread(buf, 1, len, fp) == len;
+    }
+
+    uint32_t TotalUs(const AccessRecord &record)
+    {
+        return record.recvUs + record.queueUs + record.handleUs + record.sendUs;
+    }
+
+    void FormatTime(int64_t timeUs, char *buf, size_t size)
+    {
+        time_t sec = static_cast<time_t>(timeUs / 1000000);
+        struct tm t;
+        localtime_r(&sec, &t);
+        size_t n = strftime(buf, size, "%Y-%m-%d %H:%M:%S", &t);
+        snprintf(buf + n, size - n, ".%06ld", static_cast<long>(timeUs % 1000000));
+    }
+
+    // CSV字段中含有逗号、引号或换行时加引号，引号写两次
+    void PrintCsvField(const std::string &field)
+    {
+        if (field.find_first_of(",\"\r\n") == std::string::npos)
+        {
+            fputs(field.c_str(), stdout);
+            return;
+        }
+        putchar('"');
+        for (char c : field)
+        {
+            if (c == '"')
+            {
+                putchar('"');
+            }
+            putchar(c);
+        }
+        putchar('"');
+    }
+
+    void Print(OUTPUT_MODE mode, const AccessRecord &record, const std::string &path)
+    {
+        char timeBuf[48];
+        FormatTime(record.timeUs, timeBuf, sizeof(timeBuf));
+        struct in_addr addr;
+        addr.s_addr = record.peerIp;
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+        if (mode == MODE_CSV)
+        {
+            printf("%s,%s,%u,%s,", timeBuf, ip, record.peerPort, AccessLog::MethodName(record.method));
+            PrintCsvField(path);
+            printf(",%u,%llu,%u,%u,%u,%u,%u,%u\n", record.status,
+                   static_cast<unsigned long long>(record.bytes), record.keepAlive,
+                   record.recvUs, record.queueUs, record.handleUs, record.sendUs, TotalUs(record));
+        }
+        else
+        {
+            printf("%s %s:%u \"%s %s\" %u %llu %uus (recv %u, queue %u, handle %u, send %u)%s\n",
+                   timeBuf, ip, record.peerPort, AccessLog::MethodName(record.method), path.c_str(),
+                   record.status, static_cast<unsigned long long>(record.bytes), TotalUs(record),
+                   record.recvUs, record.queueUs, record.handleUs, record.sendUs,
+                   record.keepAlive ? " keep-alive" : "");
+        }
+    }
+
+    void Account(Stats &stats, const AccessRecord &record, const std::string &path)
+    {
+        stats.requests++;
+        stats.bytes += record.bytes;
+        stats.firstUs = std::min(stats.firstUs, record.timeUs);
+        stats.lastUs = std::max(stats.lastUs, record.timeUs);
+        stats.status[record.status]++;
+        stats.methods[record.method < AccessLog::METHOD_COUNT ? record.method : 0]++;
+        const uint32_t values[STAGE_COUNT] = {TotalUs(record), record.recvUs, record.queueUs,
+                                              record.handleUs, record.sendUs};
+        for (int i = 0; i < STAGE_COUNT; i++)
+        {
+            stats.latency[i][Histogram::Index(values[i])]++;
+            stats.latencySum[i] += values[i];
+        }
+        stats.paths[path]++;
+    }
+
+    void PrintStats(const Stats &stats)
+    {
+        printf("requests: %llu\n", static_cast<unsigned long long>(stats.requests));
+        if (stats.requests == 0)
+        {
+            return;
+        }
+        char first[48], last[48];
+        FormatTime(stats.firstUs, first, sizeof(first));
+        FormatTime(stats.lastUs, last, sizeof(last));
+        double spanSec = (stats.lastUs - stats.firstUs) / 1e6;
+        printf("span: %s ~ %s (%.3fs)\n", first, last, spanSec);
+        if (spanSec > 0)
+        {
+            printf("throughput: %.1f req/s, %.2f MB/s\n", stats.requests / spanSec,
+                   stats.bytes / spanSec / (1024 * 1024));
+        }
+        printf("bytes: %llu\n", static_cast<unsigned long long>(stats.bytes));
+
+        printf("\nstatus:\n");
+        for (const auto &item : stats.status)
+        {
+            printf("  %3d  %10llu  %6.2f%%\n", item.first, static_cast<unsigned long long>(item.second),
+                   100.0 * item.second / stats.requests);
+        }
+        printf("\nmethod:\n");
+        for (int i = 0; i < AccessLog::METHOD_COUNT; i++)
+        {
+            if (stats.methods[i] > 0)
+            {
+                printf("  %-6s %10llu\n", AccessLog::MethodName(i),
+                       static_cast<unsigned long long>(stats.methods[i]));
+            }
+        }
+
+        printf("\nlatency(us):  %10s %10s %10s %10s %10s %10s\n", "avg", "p50", "p90", "p99", "p99.9", "max");
+        for (int i = 0; i < STAGE_COUNT; i++)
+        {
+            const std::vector<uint64_t> &counts = stats.latency[i];
+            printf("  %-10s  %10llu %10llu %10llu %10llu %10llu %10llu\n", STAGE_NAMES[i],
+                   static_cast<unsigned long long>(stats.latencySum[i] / stats.requests),
+                   static_cast<unsigned long long>(Histogram::Percentile(counts, 0.5)),
+                   static_cast<unsigned long long>(Histogram::Percentile(counts, 0.9)),
+                   static_cast<unsigned long long>(Histogram::Percentile(counts, 0.99)),
+                   static_cast<unsigned long long>(Histogram::Percentile(counts, 0.999)),
+                   static_cast<unsigned long long>(Histogram::Percentile(counts, 1.0)));
+        }
+
+        std::vector<std::pair<uint64_t, std::string>> top;
+        for (const auto &item : stats.paths)
+        {
+            top.emplace_back(item.second, item.first);
+        }
+        size_t n = std::min(top.size(), static_cast<size_t>(TOP_PATHS));
+        std::partial_sort(top.begin(), top.begin() + n, top.end(),
+                          [](const std::pair<uint64_t, std::string> &a, const std::pair<uint64_t, std::string> &b)
+                          { return a.first > b.first || (a.first == b.first && a.second < b.second); });
+        printf("\ntop paths:\n");
+        for (size_t i = 0; i < n; i++)
+        {
+            printf("  %10llu  %s\n", static_cast<unsigned long long>(top[i].first), top[i].second.c_str());
+        }
+    }
+
+    /**
+     * @brief 读取一个访问日志文件
+     *
+     * @return int 0表示成功，1表示文件格式错误或被截断
+     */
+    int Read(FILE *fp, const char *name, OUTPUT_MODE mode, Stats &stats)
+    {
+        char magic[sizeof(AccessLog::FILE_MAGIC)];
+        if (!ReadExact(fp, magic, sizeof(magic)) ||
+            memcmp(magic, AccessLog::FILE_MAGIC, sizeof(magic)) != 0)
+        {
+            fprintf(stderr, "%s: not an access log file\n", name);
+            return 1;
+        }
+        // 同一个文件可能由多次运行的服务器追加写入，编号以最近一次的定义为准
+        std::unordered_map<uint32_t, std::string> paths;
+        std::string unknown = "<?>";
+        int type;
+        while ((type = fgetc(fp)) != EOF)
+        {
+            bool ok = true;
+            if (type == AccessLog::ENTRY_PATH)
+            {
+                uint32_t id;
+                uint16_t len;
+                char buf[65536];
+                ok = ReadExact(fp, &id, sizeof(id)) && ReadExact(fp, &len, sizeof(len)) &&
+                     ReadExact(fp, buf, len);
+                if (ok)
+                {
+                    paths[id].assign(buf, len);
+                }
+            }
+            else if (type == AccessLog::ENTRY_ACCESS)
+            {
+                AccessRecord record;
+                ok = ReadExact(fp, &record, sizeof(record));
+                if (ok)
+                {
+                    auto it = paths.find(record.pathId);
+                    const std::string &path = it != paths.end() ? it->second : unknown;
+                    if (mode == MODE_STATS)
+                    {
+                        Account(stats, record, path);
+                    }
+                    else
+                    {
+                        Print(mode, record, path);
+                    }
+                }
+            }
+            else
+            {
+                fprintf(stderr, "%s: bad entry type 0x%02x\n", name, type);
+                return 1;
+            }
+            if (!ok)
+            {
+                fprintf(stderr, "%s: truncated entry\n", name);
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    OUTPUT_MODE mode;
+    if (argc >= 2 && strcmp(argv[1], "csv") == 0)
+    {
+        mode = MODE_CSV;
+    }
+    else if (argc >= 2 && strcmp(argv[1], "text") == 0)
+    {
+        mode = MODE_TEXT;
+    }
+    else if (argc >= 2 && strcmp(argv[1], "stats") == 0)
+    {
+        mode = MODE_STATS;
+    }
+    else
+    {
+        fprintf(stderr, "usage: %s csv|text|stats [file...]\n", argv[0]);
+        return 2;
+    }
+    if (mode == MODE_CSV)
+    {
+        printf("time,peer,port,method,path,status,bytes,keep_alive,recv_us,queue_us,handle_us,send_us,total_us\n");
+    }
+
+    Stats stats;
+    int ret = 0;
+    if (argc < 3)
+    {
+        ret = Read(stdin, "<stdin>", mode, stats);
+    }
+    for (int i = 2; i < argc; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        if (fp == nullptr)
+        {
+            perror(argv[i]);
+            ret = 1;
+            continue;
+        }
+        ret |= Read(fp, argv[i], mode, stats);
+        fclose(fp);
+    }
+    if (mode == MODE_STATS)
+    {
+        PrintStats(stats);
+    }
+    return ret;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file logdecode.cpp
+ * @brief 把二进制日志文件导出为文本，输出格式和文本日志相同
+ *
+ * 用法：logdecode 日志文件...
+ * 不指定文件时从标准输入读取，结果写到标准输出
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "../code/log/logformat.h"
+
+namespace
+{
+    // 单行日志的最大长度，和Log::LINE_MAX_LEN一致
+    const size_t LINE_MAX_LEN = 4096;
+
+    bool ReadExact(FILE *fp, void *buf, size_t len)
+    {
+        return fread(buf, 1, len, fp) == len;
+    }
+
+    // 按文本日志的格式输出时间戳和等级
+    void PrintPrefix(int64_t timeUs, int level)
+    {
+        time_t sec = static_cast<time_t>(timeUs / 1000000);
+        struct tm t;
+        localtime_r(&sec, &t);
+        char buf[32];
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &t);
+        printf("%s.%06ld %s", buf, static_cast<long>(timeUs % 1000000), LogFormat::LevelTitle(level));
+    }
+
+    /**
+     * @brief 导出一个二进制日志文件
+     *
+     * @return int 0表示成功，1表示文件格式错误或被截断
+     */
+    int Decode(FILE *fp, const char *name)
+    {
+        char magic[sizeof(LogFormat::BINARY_MAGIC)];
+        if (!ReadExact(fp, magic, sizeof(magic)) ||
+            memcmp(magic, LogFormat::BINARY_MAGIC, sizeof(magic)) != 0)
+        {
+            fprintf(stderr, "%s: not a binary log file\n", name);
+            return 1;
+        }
+        // 同一个文件可能由多次运行的服务器追加写入，编号以最近一次的定义为准
+        std::unordered_map<uint32_t, std::pair<int, std::string>> formats;
+        std::vector<char> data;
+        char line[LINE_MAX_LEN];
+        int type;
+        while ((type = fgetc(fp)) != EOF)
+        {
+            int64_t timeUs;
+            uint32_t id;
+            uint16_t level;
+            uint32_t len;
+            bool ok = true;
+            switch (type)
+            {
+            case LogFormat::ENTRY_FORMAT:
+                ok = ReadExact(fp, &id, sizeof(id)) && ReadExact(fp, &level, sizeof(level)) &&
+                     ReadExact(fp, &len, sizeof(len));
+                data.resize(len);
+                ok = ok && ReadExact(fp, data.data(), len);
+                if (ok)
+                {
+                    formats[id] = std::make_pair(static_cast<int>(level), std::string(data.data(), len));
+                }
+                break;
+            case LogFormat::ENTRY_RECORD:
+            {
+                ok = ReadExact(fp, &timeUs, sizeof(timeUs)) && ReadExact(fp, &id, sizeof(id)) &&
+                     ReadExact(fp, &len, sizeof(len));
+                data.resize(len);
+                ok = ok && ReadExact(fp, data.data(), len);
+                if (!ok)
+                {
+                    break;
+                }
+                auto it = formats.find(id);
+                if (it == formats.end())
+                {
+                    fprintf(stderr, "%s: undefined format id %u\n", name, id);
+                    break;
+                }
+                LogFormat::Render(it->second.second.c_str(), data.data(), len, line, sizeof(line));
+                PrintPrefix(timeUs, it->second.first);
+                printf("%s\n", line);
+                break;
+            }
+            case LogFormat::ENTRY_TEXT:
+                ok = ReadExact(fp, &timeUs, sizeof(timeUs)) && ReadExact(fp, &level, sizeof(level)) &&
+                     ReadExact(fp, &len, sizeof(len));
+                data.resize(len);
+                ok = ok && ReadExact(fp, data.data(), len);
+                if (ok)
+                {
+                    // 文本记录已经包含时间戳、等级和换行
+                    fwrite(data.data(), 1, len, stdout);
+                }
+                break;
+            default:
+                fprintf(stderr, "%s: bad entry type 0x%02x\n", name, type);
+                return 1;
+            }
+            if (!ok)
+            {
+                fprintf(stderr, "%s: truncated entry\n", name);
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        return Decode(stdin, "<stdin>");
+    }
+    int ret = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        if (fp == nullptr)
+        {
+            perror(argv[i]);
+            ret = 1;
+            continue;
+        }
+        ret |= Decode(fp, argv[i]);
+        fclose(fp);
+    }
+    return ret;
+}